@@ -38,6 +38,14 @@ static inline auto iequals(const std::string &str1, const std::string &str2)
          });
 }
 
+static inline auto icontains(const std::string &str, const std::string &sub)
+    -> bool {
+  return std::search(str.begin(), str.end(), sub.begin(), sub.end(),
+                     [](auto a, auto b) {
+                       return std::tolower(a) == std::tolower(b);
+                     }) != str.end();
+}
+
 auto main(int argc, char *argv[]) -> int {
   omp_set_num_threads(THREADS);
   Eigen::initParallel();
@@ -50,6 +58,12 @@ auto main(int argc, char *argv[]) -> int {
   std::string outputDestination;
   std::string input;
   std::string input1;
+  double deadlineSeconds = 0.0;
+  std::string certificatePath;
+  // weighted automata in the binary format are mapped, not read as text
+  std::string inputBinary;
+  std::string input1Binary;
+  std::string binaryPath;
   std::shared_ptr<UserInterface> ui;
 
   try {
@@ -75,11 +89,47 @@ auto main(int argc, char *argv[]) -> int {
         "", "string");
     TCLAP::ValueArg<std::string> outputArg("o", "output", "path to output file",
                                            false, "", "string");
+    TCLAP::ValueArg<double> deadlineArg(
+        "d", "deadline",
+        "wall-clock limit for the reduction in seconds, returns the best "
+        "intermediate result on expiry",
+        false, 0.0, "double");
+    TCLAP::ValueArg<std::string> certificateArg(
+        "C", "certificate",
+        "path to write a reduction certificate to, which is checked instead "
+        "of a full equivalence check",
+        false, "", "string");
+    TCLAP::ValueArg<std::string> binaryArg(
+        "b", "binary",
+        "path to write the parsed weighted automaton to in the binary format, "
+        "which is memory mapped instead of parsed when given as input",
+        false, "", "string");
+    TCLAP::ValueArg<uint> rankArg(
+        "R", "rank",
+        "rank of the truncated SVD reduction of weighted automata, 0 selects "
+        "it by the tolerance",
+        false, 0, "uint");
+    TCLAP::ValueArg<double> toleranceArg(
+        "e", "tolerance",
+        "share of the Frobenius norm of the Hankel matrix the truncated SVD "
+        "reduction may discard",
+        false, DEFAULT_SVD_TOLERANCE, "double");
+    TCLAP::ValueArg<uint> horizonArg(
+        "k", "horizon",
+        "length up to which the finite horizon reduction of weighted automata "
+        "preserves all words",
+        false, DEFAULT_FINITE_HORIZON, "uint");
 
     for (auto *arg :
          {&taskArg, &modelArg, &methodArg, &inputArg, &input1Arg, &outputArg}) {
       cmd.add(arg);
     }
+    cmd.add(deadlineArg);
+    cmd.add(certificateArg);
+    cmd.add(binaryArg);
+    cmd.add(rankArg);
+    cmd.add(toleranceArg);
+    cmd.add(horizonArg);
     cmd.add(tuiSwitch);
     cmd.add(guiSwitch);
     cmd.parse(argc, argv);
@@ -90,6 +140,9 @@ auto main(int argc, char *argv[]) -> int {
     std::string inputStr = inputArg.getValue();
     std::string input1Str = input1Arg.getValue();
     std::string outputStr = outputArg.getValue();
+    deadlineSeconds = deadlineArg.getValue();
+    certificatePath = certificateArg.getValue();
+    binaryPath = binaryArg.getValue();
     bool tuiBool = tuiSwitch.getValue();
     bool guiBool = guiSwitch.getValue();
 
@@ -131,7 +184,37 @@ auto main(int argc, char *argv[]) -> int {
         exit(-1);
       }
 
-      input = UserInterface::read_file(inputStr);
+      const bool weightedAutomaton =
+          std::dynamic_pointer_cast<WeightedAutomatonModel>(model) != nullptr;
+      if (rankArg.isSet() || toleranceArg.isSet()) {
+        if (!weightedAutomaton) {
+          std::cerr << "The SVD parameters are only supported for weighted "
+                    << "automata!" << std::endl;
+          exit(-1);
+        }
+        try {
+          std::static_pointer_cast<WeightedAutomatonModel>(model)
+              ->set_svd_parameters(rankArg.getValue(),
+                                   toleranceArg.getValue());
+        } catch (std::invalid_argument &e) {
+          std::cerr << e.what() << std::endl;
+          exit(-1);
+        }
+      }
+      if (horizonArg.isSet()) {
+        if (!weightedAutomaton) {
+          std::cerr << "The horizon is only supported for weighted automata!"
+                    << std::endl;
+          exit(-1);
+        }
+        std::static_pointer_cast<WeightedAutomatonModel>(model)
+            ->set_finite_horizon(horizonArg.getValue());
+      }
+      if (weightedAutomaton && WeightedAutomatonModel::is_binary(inputStr)) {
+        inputBinary = inputStr;
+      } else {
+        input = UserInterface::read_file(inputStr);
+      }
 
       std::filesystem::path outputPath(outputStr);
       if (outputPath.has_filename()) {
@@ -145,13 +228,24 @@ auto main(int argc, char *argv[]) -> int {
       outputMethod = UserInterface::IOMethod::File;
 
       if (task == UserInterface::Reduction && !methodStr.empty()) {
-        // currently only two methods are supported, one per models so ignore
-        // what the user says and just use it Intentionally bad design,
-        // sufficient for now
+        // pick the first method whose name contains the given string, fall
+        // back to the default method of the model otherwise
         reductionMethod = 0;
+        const auto methods = model->get_reduction_methods();
+        for (uint i = 0; i < methods.size(); i++) {
+          if (icontains(methods[i]->get_name(), methodStr)) {
+            reductionMethod = i;
+            break;
+          }
+        }
       }
       if (task == UserInterface::Equivalence && !input1Str.empty()) {
-        input1 = UserInterface::read_file(input1Str);
+        if (weightedAutomaton &&
+            WeightedAutomatonModel::is_binary(input1Str)) {
+          input1Binary = input1Str;
+        } else {
+          input1 = UserInterface::read_file(input1Str);
+        }
       }
 
     } else {
@@ -217,17 +311,74 @@ auto main(int argc, char *argv[]) -> int {
       }
     }
 
+    if (!binaryPath.empty() &&
+        std::dynamic_pointer_cast<WeightedAutomatonModel>(model) == nullptr) {
+      std::cerr << "The binary format is only supported for weighted automata!"
+                << std::endl;
+      exit(-1);
+    }
+    auto load = [&model](std::string &text, const std::string &binary) {
+      if (binary.empty()) {
+        return model->parse(text);
+      }
+      return std::static_pointer_cast<WeightedAutomatonModel>(model)
+          ->load_binary(binary);
+    };
+    auto store = [&binaryPath](
+                     const std::shared_ptr<RepresentationInterface> &parsed) {
+      if (!binaryPath.empty()) {
+        WeightedAutomatonModel::write_binary(parsed, binaryPath);
+        std::cout << "Wrote binary automaton to " << binaryPath << std::endl;
+      }
+    };
+
     switch (task) {
     case UserInterface::Reduction: {
-      auto representation = model->parse(input);
+      if (!certificatePath.empty()) {
+        if (std::dynamic_pointer_cast<WeightedAutomatonModel>(model) ==
+            nullptr) {
+          std::cerr << "Certificates are only supported for weighted automata!"
+                    << std::endl;
+          exit(-1);
+        }
+        if (!WeightedAutomatonModel::emits_certificate(
+                model->get_reduction_methods()[reductionMethod])) {
+          std::cerr << "Only the Schützenberger reduction emits certificates!"
+                    << std::endl;
+          exit(-1);
+        }
+      }
+      auto representation = load(input, inputBinary);
+      store(representation);
+      if (!certificatePath.empty()) {
+        WeightedAutomatonModel::request_certificate(
+            model->get_reduction_methods()[reductionMethod], certificatePath);
+      }
+      const Deadline deadline =
+          deadlineSeconds > 0.0
+              ? Deadline(std::chrono::duration_cast<
+                         std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(deadlineSeconds)))
+              : Deadline();
       auto start = std::chrono::high_resolution_clock::now();
       auto reduced_representation =
           model->get_reduction_methods()[reductionMethod]->reduce(
-              representation);
+              representation, deadline);
       auto finish = std::chrono::high_resolution_clock::now();
       std::chrono::duration<double> elapsed = finish - start;
       std::cout << "Finished reduction in " << elapsed.count() << " s"
                 << std::endl;
+      if (std::dynamic_pointer_cast<WeightedAutomatonModel>(model) != nullptr) {
+        if (auto error = WeightedAutomatonModel::estimated_error(
+                model->get_reduction_methods()[reductionMethod])) {
+          std::cout << "Estimated approximation error: " << *error
+                    << std::endl;
+        }
+      }
+      if (deadline.expired()) {
+        std::cout << "Deadline expired, the result may not be minimal"
+                  << std::endl;
+      }
       auto summary =
           model->summarize_reduction(representation, reduced_representation);
 
@@ -236,14 +387,30 @@ auto main(int argc, char *argv[]) -> int {
       } else if (outputMethod == UserInterface::IOMethod::Display) {
         ui->display(summary);
       }
+      if (!certificatePath.empty()) {
+        const bool valid = WeightedAutomatonModel::verify_certificate(
+            representation, reduced_representation, certificatePath);
+        std::cout << "Finished certificate check: "
+                  << (valid ? "valid" : "invalid") << std::endl;
+        break;
+      }
+      if (std::dynamic_pointer_cast<WeightedAutomatonModel>(model) !=
+              nullptr &&
+          WeightedAutomatonModel::is_approximate(
+              model->get_reduction_methods()[reductionMethod])) {
+        std::cout << "Skipped Equivalence check: the reduction is approximate"
+                  << std::endl;
+        break;
+      }
       const bool result = representation->equivalent(reduced_representation);
       const std::string resStr = result ? "equivalent" : "not equivalent";
       std::cout << "Finished Equivalence check: " << resStr << std::endl;
       break;
     }
     case UserInterface::Equivalence: {
-      auto representation0 = model->parse(input);
-      auto representation1 = model->parse(input1);
+      auto representation0 = load(input, inputBinary);
+      store(representation0);
+      auto representation1 = load(input1, input1Binary);
       const bool result = representation0->equivalent(representation1);
       const std::string resStr = result ? "equivalent" : "not equivalent";
       std::cout << "Finished Equivalence check: " << resStr << std::endl;
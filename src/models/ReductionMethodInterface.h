@@ -1,6 +1,8 @@
 #ifndef STOCHASTIC_SYSTEM_MINIMIZATION_REDUCTIONMETHODINTERFACE_H
 #define STOCHASTIC_SYSTEM_MINIMIZATION_REDUCTIONMETHODINTERFACE_H
 
+#include "../util/Deadline.h"
+#include "../util/DeadlineExceededException.h"
 #include "RepresentationInterface.h"
 #include <memory>
 
@@ -10,8 +12,16 @@ public:
 
   [[nodiscard]] virtual inline auto get_name() const -> std::string = 0;
 
+  [[nodiscard]] inline auto
+  reduce(const std::shared_ptr<RepresentationInterface> &instance)
+      -> std::shared_ptr<RepresentationInterface> {
+    return reduce(instance, Deadline());
+  }
+
+  // Once the deadline expired the reduction stops and returns the best valid
+  // intermediate result, i.e. an equivalent but possibly non-minimal instance
   [[nodiscard]] virtual inline auto
-  reduce(const std::shared_ptr<RepresentationInterface> &)
+  reduce(const std::shared_ptr<RepresentationInterface> &, const Deadline &)
       -> std::shared_ptr<RepresentationInterface> = 0;
 };
 
@@ -0,0 +1,3 @@
+#include "CanonicalRewriteSystem.h"
+
+CanonicalRewriteSystem::~CanonicalRewriteSystem() = default;
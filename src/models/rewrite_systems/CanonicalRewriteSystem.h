@@ -0,0 +1,198 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_CANONICALREWRITESYSTEM_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_CANONICALREWRITESYSTEM_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../util/FloatingPointCompare.h"
+#include "../../util/Hashing.h"
+#include "SpeciesDictionary.h"
+#include "Stoichiometry.h"
+
+// Normal form of a rewrite system that does not depend on the order of the
+// atoms, species, rules or terms it was written in. Species are identified by
+// their composition spelled with atom names and renumbered in sorted order.
+// The terms of a hand side are merged per species and sorted, rules are
+// sorted by their hand sides and rules with equal hand sides are merged with
+// the sum of their rates. Two systems are syntactically equivalent iff their
+// normal forms are equal, which is decided in linear time after the
+// O(R log R) normalisation, and rejected in constant time if the hashes
+// differ.
+class CanonicalRewriteSystem {
+public:
+  // atom names with their counts, sorted by name
+  using SpeciesKey = std::vector<std::pair<std::string, unsigned int>>;
+  using Terms = std::vector<std::array<unsigned int, 2>>;
+
+private:
+  std::vector<SpeciesKey> species;
+  std::vector<double> rates;
+  Stoichiometry lhs;
+  Stoichiometry rhs;
+  // structural hash over the species and the hand sides, rates are compared
+  // with a tolerance and thus not hashed
+  uint64_t hash;
+
+  static void hash_string(uint64_t &h, const std::string &value) {
+    hash_combine(h, value.size());
+    for (const auto &c : value) {
+      hash_combine(h, static_cast<unsigned char>(c));
+    }
+  }
+
+  void compute_hash() {
+    this->hash = HASH_SEED;
+    hash_combine(this->hash, this->species.size());
+    for (const auto &key : this->species) {
+      hash_combine(this->hash, key.size());
+      for (const auto &[atom, count] : key) {
+        hash_string(this->hash, atom);
+        hash_combine(this->hash, count);
+      }
+    }
+    hash_combine(this->hash, this->rates.size());
+    for (size_t j = 0; j < this->rates.size(); j++) {
+      for (const Stoichiometry *side : {&this->lhs, &this->rhs}) {
+        hash_combine(this->hash, side->size(j));
+        auto spec = side->species_of(j);
+        auto fac = side->factors_of(j);
+        for (size_t k = 0; k < spec.size(); k++) {
+          hash_combine(this->hash, (static_cast<uint64_t>(spec[k]) << 32U) |
+                                       fac[k]);
+        }
+      }
+    }
+  }
+
+public:
+  CanonicalRewriteSystem(const SpeciesDictionary &dictionary,
+                         const std::vector<double> &mRates,
+                         const Stoichiometry &mLhs, const Stoichiometry &mRhs)
+      : species({}), rates({}), lhs(), rhs(), hash(0) {
+    // canonical species order by composition
+    std::vector<SpeciesKey> keys(dictionary.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      const auto &composition = dictionary.get_species()[i];
+      for (size_t a = 0; a < composition.size(); a++) {
+        if (composition[a] != 0) {
+          keys[i].emplace_back(dictionary.get_atoms()[a], composition[a]);
+        }
+      }
+      std::sort(keys[i].begin(), keys[i].end());
+    }
+    std::vector<unsigned int> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&keys](unsigned int a, unsigned int b) {
+                return keys[a] < keys[b];
+              });
+    std::vector<unsigned int> renamed(keys.size());
+    this->species.reserve(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      renamed[order[i]] = static_cast<unsigned int>(i);
+      this->species.push_back(std::move(keys[order[i]]));
+    }
+
+    // canonical hand sides, then rules sorted and merged
+    std::vector<std::pair<Terms, Terms>> sides(mRates.size());
+    for (size_t j = 0; j < mRates.size(); j++) {
+      sides[j] = {normalize(mLhs.terms(j), renamed),
+                  normalize(mRhs.terms(j), renamed)};
+    }
+    std::vector<size_t> rules(mRates.size());
+    std::iota(rules.begin(), rules.end(), 0);
+    std::sort(rules.begin(), rules.end(), [&sides](size_t a, size_t b) {
+      return sides[a] < sides[b];
+    });
+    for (size_t r = 0; r < rules.size(); r++) {
+      if (r > 0 && sides[rules[r]] == sides[rules[r - 1]]) {
+        this->rates.back() += mRates[rules[r]];
+        continue;
+      }
+      this->rates.push_back(mRates[rules[r]]);
+      this->lhs.append(sides[rules[r]].first);
+      this->rhs.append(sides[rules[r]].second);
+    }
+    this->compute_hash();
+  }
+
+  ~CanonicalRewriteSystem();
+
+  // Terms with renamed species, merged per species and sorted by species.
+  // Terms with factor 0 are dropped.
+  static auto normalize(std::span<const std::array<unsigned int, 2>> terms,
+                        const std::vector<unsigned int> &renamed = {})
+      -> Terms {
+    Terms result = {};
+    result.reserve(terms.size());
+    for (const auto &term : terms) {
+      if (term[0] != 0) {
+        result.push_back(
+            {term[0], renamed.empty() ? term[1] : renamed[term[1]]});
+      }
+    }
+    std::sort(result.begin(), result.end(),
+              [](const auto &a, const auto &b) { return a[1] < b[1]; });
+    size_t merged = 0;
+    for (size_t k = 0; k < result.size(); k++) {
+      if (merged > 0 && result[merged - 1][1] == result[k][1]) {
+        result[merged - 1][0] += result[k][0];
+      } else {
+        result[merged++] = result[k];
+      }
+    }
+    result.resize(merged);
+    return result;
+  }
+
+  [[nodiscard]] inline auto get_hash() const -> uint64_t { return this->hash; }
+
+  [[nodiscard]] inline auto get_species() const
+      -> const std::vector<SpeciesKey> & {
+    return this->species;
+  }
+
+  [[nodiscard]] inline auto get_rates() const -> const std::vector<double> & {
+    return this->rates;
+  }
+
+  [[nodiscard]] inline auto get_lhs_matrix() const -> const Stoichiometry & {
+    return this->lhs;
+  }
+
+  [[nodiscard]] inline auto get_rhs_matrix() const -> const Stoichiometry & {
+    return this->rhs;
+  }
+
+  // Equal structure and rates equal up to floating_point_compare
+  [[nodiscard]] auto equals(const CanonicalRewriteSystem &other) const
+      -> bool {
+    if (this->hash != other.hash || this->rates.size() != other.rates.size() ||
+        this->species != other.species) {
+      return false;
+    }
+    for (size_t j = 0; j < this->rates.size(); j++) {
+      if (!floating_point_compare(this->rates[j], other.rates[j]) ||
+          !std::ranges::equal(this->lhs.species_of(j),
+                              other.lhs.species_of(j)) ||
+          !std::ranges::equal(this->lhs.factors_of(j),
+                              other.lhs.factors_of(j)) ||
+          !std::ranges::equal(this->rhs.species_of(j),
+                              other.rhs.species_of(j)) ||
+          !std::ranges::equal(this->rhs.factors_of(j),
+                              other.rhs.factors_of(j))) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_CANONICALREWRITESYSTEM_H
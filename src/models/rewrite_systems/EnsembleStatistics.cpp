@@ -0,0 +1,3 @@
+#include "EnsembleStatistics.h"
+
+EnsembleStatistics::~EnsembleStatistics() = default;
@@ -0,0 +1,172 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_ENSEMBLESTATISTICS_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_ENSEMBLESTATISTICS_H
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Sums and sums of squares of species counts over the trajectories of an
+// ensemble, sampled at fixed time points. Counts are integers, so the sums
+// are exact and do not depend on the order the trajectories were added in.
+class EnsembleStatistics {
+private:
+  std::vector<double> timePoints;
+  std::vector<unsigned int> observables;
+  uint64_t trajectories;
+  // entry t * observables + o belongs to time point t and observable o
+  std::vector<int64_t> sums;
+  std::vector<int64_t> sumsOfSquares;
+
+  static constexpr std::array<char, 8> MAGIC = {'S', 'S', 'A', 'E',
+                                                'N', 'S', '0', '1'};
+
+  template <typename T> static void write_value(std::ofstream &out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  template <typename T> static auto read_value(std::ifstream &in) -> T {
+    T value;
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (!in.good()) {
+      throw std::invalid_argument("Truncated ensemble statistics!");
+    }
+    return value;
+  }
+
+  // Bytes between the read position and the end of the file
+  static auto remaining(std::ifstream &in) -> uint64_t {
+    auto pos = in.tellg();
+    in.seekg(0, std::ios::end);
+    auto end = in.tellg();
+    in.seekg(pos);
+    return static_cast<uint64_t>(end - pos);
+  }
+
+public:
+  EnsembleStatistics(std::vector<double> mTimePoints,
+                     std::vector<unsigned int> mObservables,
+                     uint64_t mTrajectories, std::vector<int64_t> mSums,
+                     std::vector<int64_t> mSumsOfSquares)
+      : timePoints(std::move(mTimePoints)),
+        observables(std::move(mObservables)), trajectories(mTrajectories),
+        sums(std::move(mSums)), sumsOfSquares(std::move(mSumsOfSquares)) {
+    size_t entries = this->timePoints.size() * this->observables.size();
+    if (this->sums.size() != entries || this->sumsOfSquares.size() != entries) {
+      throw std::invalid_argument(
+          "Ensemble statistics need one sum per time point and observable!");
+    }
+  }
+
+  ~EnsembleStatistics();
+
+  [[nodiscard]] inline auto get_time_points() const
+      -> const std::vector<double> & {
+    return this->timePoints;
+  }
+
+  [[nodiscard]] inline auto get_observables() const
+      -> const std::vector<unsigned int> & {
+    return this->observables;
+  }
+
+  [[nodiscard]] inline auto get_trajectories() const -> uint64_t {
+    return this->trajectories;
+  }
+
+  [[nodiscard]] inline auto sum(size_t t, size_t o) const -> int64_t {
+    return this->sums[t * this->observables.size() + o];
+  }
+
+  [[nodiscard]] inline auto mean(size_t t, size_t o) const -> double {
+    return static_cast<double>(this->sum(t, o)) /
+           static_cast<double>(this->trajectories);
+  }
+
+  // Unbiased sample variance
+  [[nodiscard]] inline auto variance(size_t t, size_t o) const -> double {
+    if (this->trajectories < 2) {
+      return 0.0;
+    }
+    auto n = static_cast<double>(this->trajectories);
+    auto s = static_cast<double>(this->sum(t, o));
+    auto sq = static_cast<double>(
+        this->sumsOfSquares[t * this->observables.size() + o]);
+    return (sq - s * s / n) / (n - 1.0);
+  }
+
+  // Layout: magic, number of trajectories, time points and observables,
+  // then the time points, the observed species, the sums and the sums of
+  // squares, all as 64 bit values
+  void write(const std::string &path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      throw std::runtime_error("Cannot open " + path + " for writing!");
+    }
+    out.write(MAGIC.data(), MAGIC.size());
+    write_value(out, this->trajectories);
+    write_value(out, static_cast<uint64_t>(this->timePoints.size()));
+    write_value(out, static_cast<uint64_t>(this->observables.size()));
+    for (const auto &t : this->timePoints) {
+      write_value(out, t);
+    }
+    for (const auto &o : this->observables) {
+      write_value(out, static_cast<uint64_t>(o));
+    }
+    out.write(reinterpret_cast<const char *>(this->sums.data()),
+              static_cast<std::streamsize>(sizeof(int64_t) * this->sums.size()));
+    out.write(reinterpret_cast<const char *>(this->sumsOfSquares.data()),
+              static_cast<std::streamsize>(sizeof(int64_t) *
+                                           this->sumsOfSquares.size()));
+    if (!out.good()) {
+      throw std::runtime_error("Failed to write the ensemble statistics to " +
+                               path + "!");
+    }
+  }
+
+  static auto read(const std::string &path) -> EnsembleStatistics {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+      throw std::runtime_error("Cannot open " + path + " for reading!");
+    }
+    std::array<char, 8> magic = {};
+    in.read(magic.data(), magic.size());
+    if (!in.good() || magic != MAGIC) {
+      throw std::invalid_argument(path + " is not an ensemble statistics file!");
+    }
+    auto trajectories = read_value<uint64_t>(in);
+    auto times = read_value<uint64_t>(in);
+    auto observed = read_value<uint64_t>(in);
+    // the times + observed + 2 * times * observed values have to fit into
+    // the rest of the file, which bounds the allocations below without
+    // overflow
+    uint64_t words = remaining(in) / sizeof(uint64_t);
+    if (times > words || observed > words - times ||
+        (observed > 0 && times > (words - times - observed) / 2 / observed)) {
+      throw std::invalid_argument("Corrupt ensemble statistics!");
+    }
+    std::vector<double> timePoints(times);
+    for (auto &t : timePoints) {
+      t = read_value<double>(in);
+    }
+    std::vector<unsigned int> observables(observed);
+    for (auto &o : observables) {
+      o = static_cast<unsigned int>(read_value<uint64_t>(in));
+    }
+    std::vector<int64_t> sums(times * observed);
+    std::vector<int64_t> sumsOfSquares(times * observed);
+    for (auto &s : sums) {
+      s = read_value<int64_t>(in);
+    }
+    for (auto &s : sumsOfSquares) {
+      s = read_value<int64_t>(in);
+    }
+    return {std::move(timePoints), std::move(observables), trajectories,
+            std::move(sums), std::move(sumsOfSquares)};
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_ENSEMBLESTATISTICS_H
@@ -0,0 +1,3 @@
+#include "MassActionKinetics.h"
+
+MassActionKinetics::~MassActionKinetics() = default;
@@ -0,0 +1,203 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_MASSACTIONKINETICS_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_MASSACTIONKINETICS_H
+
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "RewriteSystem.h"
+#include "Stoichiometry.h"
+
+// Stochastic mass-action kinetics of a rewrite system. A rule with rate k
+// and reagents a_1 S_1 + ... + a_n S_n fires with propensity
+//   k * prod_i C(x_i, a_i) = k * m / (a_1 + ... + a_n)! * prod_i x_i^(a_i)
+// in state x, where m is the multinomial coefficient of the lhs as used by
+// MaximalAggregation and x^(a) the falling factorial. Repeated terms of a
+// species are merged first, so A + A and 2A fire alike. Besides the
+// propensities this holds the net state change of every rule and the
+// dependency graph, i.e. the rules whose propensity may change when a rule
+// fires, so simulators only need to recompute those.
+class MassActionKinetics {
+private:
+  std::shared_ptr<RewriteSystem> system;
+  // lhs of every rule with the terms merged per species
+  Stoichiometry reagents;
+  // k * m / (sum of the lhs factors)! per rule
+  std::vector<double> scaledRates;
+  // net change of rule i: species changeSpecies[changeOffsets[i] ...
+  // changeOffsets[i + 1] - 1] by the corresponding changes
+  std::vector<size_t> changeOffsets;
+  std::vector<unsigned int> changeSpecies;
+  std::vector<long> changes;
+  // rules whose propensity depends on rule i firing, same layout
+  std::vector<size_t> dependentOffsets;
+  std::vector<size_t> dependents;
+
+  void init_changes() {
+    const Stoichiometry &lhs = this->system->get_lhs_matrix();
+    const Stoichiometry &rhs = this->system->get_rhs_matrix();
+    size_t species = this->system->get_species_list().size();
+    std::vector<long> delta(species, 0);
+    std::vector<unsigned int> touched = {};
+    this->changeOffsets = {0};
+    for (size_t i = 0; i < lhs.rules(); i++) {
+      auto add = [&](std::span<const unsigned int> spec,
+                     std::span<const unsigned int> factors, long sign) {
+        for (size_t k = 0; k < spec.size(); k++) {
+          if (spec[k] >= species) {
+            throw std::invalid_argument("Rule refers to an unknown species!");
+          }
+          touched.push_back(spec[k]);
+          delta[spec[k]] += sign * static_cast<long>(factors[k]);
+        }
+      };
+      add(lhs.species_of(i), lhs.factors_of(i), -1);
+      add(rhs.species_of(i), rhs.factors_of(i), 1);
+      for (const auto &s : touched) {
+        if (delta[s] != 0) {
+          this->changeSpecies.push_back(s);
+          this->changes.push_back(delta[s]);
+          delta[s] = 0;
+        }
+      }
+      touched.clear();
+      this->changeOffsets.push_back(this->changeSpecies.size());
+    }
+  }
+
+  void init_dependencies() {
+    const Stoichiometry &lhs = this->reagents;
+    size_t species = this->system->get_species_list().size();
+    // rules by reagent in compressed row storage
+    std::vector<size_t> reagentOffsets(species + 1, 0);
+    for (size_t i = 0; i < lhs.rules(); i++) {
+      for (const auto &s : lhs.species_of(i)) {
+        reagentOffsets[s + 1]++;
+      }
+    }
+    for (size_t s = 0; s < species; s++) {
+      reagentOffsets[s + 1] += reagentOffsets[s];
+    }
+    std::vector<size_t> rulesOf(reagentOffsets.back());
+    std::vector<size_t> fill(reagentOffsets.begin(), reagentOffsets.end() - 1);
+    for (size_t i = 0; i < lhs.rules(); i++) {
+      for (const auto &s : lhs.species_of(i)) {
+        rulesOf[fill[s]++] = i;
+      }
+    }
+
+    // last rule that listed a dependent, to skip duplicates
+    std::vector<size_t> seenBy(lhs.rules(), lhs.rules());
+    this->dependentOffsets = {0};
+    for (size_t i = 0; i < lhs.rules(); i++) {
+      for (const auto &s : this->changed_species(i)) {
+        for (size_t k = reagentOffsets[s]; k < reagentOffsets[s + 1]; k++) {
+          if (seenBy[rulesOf[k]] != i) {
+            seenBy[rulesOf[k]] = i;
+            this->dependents.push_back(rulesOf[k]);
+          }
+        }
+      }
+      this->dependentOffsets.push_back(this->dependents.size());
+    }
+  }
+
+public:
+  explicit MassActionKinetics(std::shared_ptr<RewriteSystem> mSystem)
+      : system(std::move(mSystem)), reagents(), scaledRates({}),
+        changeOffsets({}), changeSpecies({}), changes({}),
+        dependentOffsets({}), dependents({}) {
+    const Stoichiometry &systemLhs = this->system->get_lhs_matrix();
+    for (size_t i = 0; i < systemLhs.rules(); i++) {
+      this->reagents.append(
+          CanonicalRewriteSystem::normalize(systemLhs.terms(i)));
+    }
+    const Stoichiometry &lhs = this->reagents;
+    this->scaledRates.reserve(lhs.rules());
+    for (size_t i = 0; i < lhs.rules(); i++) {
+      unsigned long mcoeff = lhs.multinomial(i);
+      if (mcoeff == 0) {
+        throw std::invalid_argument(
+            "The sum of the factors in a rules lhs is greater than 20!");
+      }
+      unsigned int order = 0;
+      for (const auto &factor : lhs.factors_of(i)) {
+        order += factor;
+      }
+      this->scaledRates.push_back(this->system->get_rates()[i] *
+                                  static_cast<double>(mcoeff) /
+                                  static_cast<double>(FACTORIALS[order]));
+    }
+    init_changes();
+    init_dependencies();
+  }
+
+  ~MassActionKinetics();
+
+  [[nodiscard]] inline auto get_system() const
+      -> const std::shared_ptr<RewriteSystem> & {
+    return this->system;
+  }
+
+  [[nodiscard]] inline auto rules() const -> size_t {
+    return this->scaledRates.size();
+  }
+
+  [[nodiscard]] inline auto species() const -> size_t {
+    return this->system->get_species_list().size();
+  }
+
+  // The lhs the propensities are computed from, one term per species
+  [[nodiscard]] inline auto get_reagents() const -> const Stoichiometry & {
+    return this->reagents;
+  }
+
+  [[nodiscard]] inline auto propensity(size_t rule,
+                                       std::span<const long> state) const
+      -> double {
+    auto reagents = this->reagents.species_of(rule);
+    auto factors = this->reagents.factors_of(rule);
+    double result = this->scaledRates[rule];
+    for (size_t k = 0; k < reagents.size(); k++) {
+      long x = state[reagents[k]];
+      for (unsigned int j = 0; j < factors[k]; j++) {
+        if (x - static_cast<long>(j) <= 0) {
+          return 0.0;
+        }
+        result *= static_cast<double>(x - static_cast<long>(j));
+      }
+    }
+    return result;
+  }
+
+  [[nodiscard]] inline auto changed_species(size_t rule) const
+      -> std::span<const unsigned int> {
+    return {this->changeSpecies.data() + this->changeOffsets[rule],
+            this->changeOffsets[rule + 1] - this->changeOffsets[rule]};
+  }
+
+  [[nodiscard]] inline auto changes_of(size_t rule) const
+      -> std::span<const long> {
+    return {this->changes.data() + this->changeOffsets[rule],
+            this->changeOffsets[rule + 1] - this->changeOffsets[rule]};
+  }
+
+  // Rules whose propensity may change if the rule fires
+  [[nodiscard]] inline auto dependents_of(size_t rule) const
+      -> std::span<const size_t> {
+    return {this->dependents.data() + this->dependentOffsets[rule],
+            this->dependentOffsets[rule + 1] - this->dependentOffsets[rule]};
+  }
+
+  // Fires the rule the given number of times
+  inline void fire(size_t rule, std::span<long> state, long times = 1) const {
+    auto spec = changed_species(rule);
+    auto delta = changes_of(rule);
+    for (size_t k = 0; k < spec.size(); k++) {
+      state[spec[k]] += times * delta[k];
+    }
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_MASSACTIONKINETICS_H
@@ -0,0 +1,3 @@
+#include "MassActionOde.h"
+
+MassActionOde::~MassActionOde() = default;
@@ -0,0 +1,230 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_MASSACTIONODE_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_MASSACTIONODE_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "../../util/DefsConstants.h"
+#include "RewriteSystem.h"
+#include "Stoichiometry.h"
+
+// Mean-field mass-action ODE x' = N * v(x) of a rewrite system, where N is
+// the species x rules matrix of net changes and the flux of rule j with rate
+// k_j and reagents a_1 S_1 + ... + a_n S_n is v_j(x) = k_j * prod_i x_i^a_i,
+// the ODE semantics MaximalAggregation preserves. The rules are compiled
+// into flat reagent arrays and a sparse N once. The Jacobian N * dv/dx is
+// assembled analytically; the patterns of dv/dx and of the product are
+// computed once and only their values are overwritten.
+class MassActionOde {
+private:
+  std::shared_ptr<RewriteSystem> system;
+  std::vector<double> rates;
+  // reagents of rule j are reagents[offsets[j]] ... with their factors
+  std::vector<size_t> offsets;
+  std::vector<long> reagents;
+  std::vector<double> factors;
+  // species x rules net changes
+  MatSpD N;
+  // rules x species partial derivatives of the fluxes, the pattern is fixed
+  // and the values are overwritten in place
+  MatSpD dv;
+  // position of the entry of reagent term k in the values of dv
+  std::vector<long> dvPos;
+  // species x species Jacobian on the pattern of N * dv. Entry p is the sum
+  // of jFactors[i] * dv[jDvPos[i]] for jOffsets[p] <= i < jOffsets[p + 1].
+  MatSpD J;
+  std::vector<size_t> jOffsets;
+  std::vector<double> jFactors;
+  std::vector<long> jDvPos;
+
+  // position of the entry (row, col) in the values of a compressed matrix
+  static auto position(const MatSpD &mat, long row, long col) -> long {
+    const long *begin = mat.innerIndexPtr() + mat.outerIndexPtr()[col];
+    const long *end = mat.innerIndexPtr() + mat.outerIndexPtr()[col + 1];
+    return static_cast<long>(std::lower_bound(begin, end, row) -
+                             mat.innerIndexPtr());
+  }
+
+  void init_jacobian_pattern() {
+    long species = this->N.rows();
+    // (position in J, factor of N, position in dv) of every product term
+    std::vector<std::tuple<long, double, long>> terms = {};
+    std::vector<Eigen::Triplet<double, long>> triplets = {};
+    for (long c = 0; c < species; c++) {
+      for (long q = this->dv.outerIndexPtr()[c];
+           q < this->dv.outerIndexPtr()[c + 1]; q++) {
+        long j = this->dv.innerIndexPtr()[q];
+        for (long n = this->N.outerIndexPtr()[j];
+             n < this->N.outerIndexPtr()[j + 1]; n++) {
+          triplets.emplace_back(this->N.innerIndexPtr()[n], c, 0.0);
+        }
+      }
+    }
+    this->J = MatSpD(species, species);
+    this->J.setFromTriplets(triplets.begin(), triplets.end());
+    this->J.makeCompressed();
+    for (long c = 0; c < species; c++) {
+      for (long q = this->dv.outerIndexPtr()[c];
+           q < this->dv.outerIndexPtr()[c + 1]; q++) {
+        long j = this->dv.innerIndexPtr()[q];
+        for (long n = this->N.outerIndexPtr()[j];
+             n < this->N.outerIndexPtr()[j + 1]; n++) {
+          terms.emplace_back(position(this->J, this->N.innerIndexPtr()[n], c),
+                             this->N.valuePtr()[n], q);
+        }
+      }
+    }
+    std::stable_sort(terms.begin(), terms.end(),
+                     [](const auto &a, const auto &b) {
+                       return std::get<0>(a) < std::get<0>(b);
+                     });
+    this->jOffsets = std::vector<size_t>(
+        static_cast<size_t>(this->J.nonZeros()) + 1, 0);
+    this->jFactors = {};
+    this->jDvPos = {};
+    this->jFactors.reserve(terms.size());
+    this->jDvPos.reserve(terms.size());
+    for (const auto &[p, factor, q] : terms) {
+      this->jOffsets[static_cast<size_t>(p) + 1]++;
+      this->jFactors.push_back(factor);
+      this->jDvPos.push_back(q);
+    }
+    for (size_t p = 0; p + 1 < this->jOffsets.size(); p++) {
+      this->jOffsets[p + 1] += this->jOffsets[p];
+    }
+  }
+
+  void init_derivative_pattern() {
+    size_t species = this->system->get_species_list().size();
+    std::vector<Eigen::Triplet<double, long>> triplets = {};
+    for (size_t j = 0; j < this->rates.size(); j++) {
+      for (size_t k = this->offsets[j]; k < this->offsets[j + 1]; k++) {
+        triplets.emplace_back(static_cast<long>(j), this->reagents[k], 1.0);
+      }
+    }
+    this->dv = MatSpD(static_cast<long>(this->rates.size()),
+                      static_cast<long>(species));
+    // repeated reagents of a rule share one entry
+    this->dv.setFromTriplets(triplets.begin(), triplets.end(),
+                             [](const double &a, const double &) { return a; });
+    this->dv.makeCompressed();
+    this->dvPos = std::vector<long>(this->reagents.size());
+    for (size_t j = 0; j < this->rates.size(); j++) {
+      for (size_t k = this->offsets[j]; k < this->offsets[j + 1]; k++) {
+        long col = this->reagents[k];
+        long start = this->dv.outerIndexPtr()[col];
+        long end = this->dv.outerIndexPtr()[col + 1];
+        const long *rows = this->dv.innerIndexPtr();
+        long pos = start;
+        while (pos < end && rows[pos] != static_cast<long>(j)) {
+          pos++;
+        }
+        this->dvPos[k] = pos;
+      }
+    }
+  }
+
+public:
+  explicit MassActionOde(std::shared_ptr<RewriteSystem> mSystem)
+      : system(std::move(mSystem)), rates(), offsets({0}), reagents({}),
+        factors({}), N(), dv(), dvPos({}), J(), jOffsets({}), jFactors({}),
+        jDvPos({}) {
+    const Stoichiometry &lhs = this->system->get_lhs_matrix();
+    const Stoichiometry &rhs = this->system->get_rhs_matrix();
+    size_t species = this->system->get_species_list().size();
+    this->rates = this->system->get_rates();
+    std::vector<Eigen::Triplet<double, long>> triplets = {};
+    for (size_t j = 0; j < lhs.rules(); j++) {
+      auto spec = lhs.species_of(j);
+      auto fac = lhs.factors_of(j);
+      for (size_t k = 0; k < spec.size(); k++) {
+        if (spec[k] >= species) {
+          throw std::invalid_argument("Rule refers to an unknown species!");
+        }
+        this->reagents.push_back(spec[k]);
+        this->factors.push_back(fac[k]);
+        triplets.emplace_back(spec[k], static_cast<long>(j),
+                              -static_cast<double>(fac[k]));
+      }
+      this->offsets.push_back(this->reagents.size());
+      spec = rhs.species_of(j);
+      fac = rhs.factors_of(j);
+      for (size_t k = 0; k < spec.size(); k++) {
+        if (spec[k] >= species) {
+          throw std::invalid_argument("Rule refers to an unknown species!");
+        }
+        triplets.emplace_back(spec[k], static_cast<long>(j),
+                              static_cast<double>(fac[k]));
+      }
+    }
+    this->N = MatSpD(static_cast<long>(species),
+                     static_cast<long>(this->rates.size()));
+    this->N.setFromTriplets(triplets.begin(), triplets.end());
+    this->N.prune(0.0);
+    this->N.makeCompressed();
+    this->init_derivative_pattern();
+    this->init_jacobian_pattern();
+  }
+
+  ~MassActionOde();
+
+  [[nodiscard]] inline auto species() const -> long { return this->N.rows(); }
+
+  [[nodiscard]] inline auto get_net_changes() const -> const MatSpD & {
+    return this->N;
+  }
+
+  // v(x), the flux of every rule
+  void fluxes(const Eigen::VectorXd &x, Eigen::VectorXd &v) const {
+    v.resize(static_cast<long>(this->rates.size()));
+    for (size_t j = 0; j < this->rates.size(); j++) {
+      double flux = this->rates[j];
+      for (size_t k = this->offsets[j]; k < this->offsets[j + 1]; k++) {
+        flux *= std::pow(x[this->reagents[k]], this->factors[k]);
+      }
+      v[static_cast<long>(j)] = flux;
+    }
+  }
+
+  // dx = N * v(x)
+  void rhs(const Eigen::VectorXd &x, Eigen::VectorXd &dx) const {
+    Eigen::VectorXd v;
+    this->fluxes(x, v);
+    dx = this->N * v;
+  }
+
+  // N * dv/dx(x), on the same pattern for every x. The reference stays valid
+  // until the next call.
+  [[nodiscard]] auto jacobian(const Eigen::VectorXd &x) -> const MatSpD & {
+    double *values = this->dv.valuePtr();
+    std::fill(values, values + this->dv.nonZeros(), 0.0);
+    for (size_t j = 0; j < this->rates.size(); j++) {
+      for (size_t k = this->offsets[j]; k < this->offsets[j + 1]; k++) {
+        // d/dx_s of k_j * prod_i x_i^a_i, repeated reagents add up
+        double partial = this->rates[j] * this->factors[k] *
+                         std::pow(x[this->reagents[k]], this->factors[k] - 1);
+        for (size_t l = this->offsets[j]; l < this->offsets[j + 1]; l++) {
+          if (l != k) {
+            partial *= std::pow(x[this->reagents[l]], this->factors[l]);
+          }
+        }
+        values[this->dvPos[k]] += partial;
+      }
+    }
+    double *jValues = this->J.valuePtr();
+    for (size_t p = 0; p + 1 < this->jOffsets.size(); p++) {
+      double sum = 0.0;
+      for (size_t i = this->jOffsets[p]; i < this->jOffsets[p + 1]; i++) {
+        sum += this->jFactors[i] * values[this->jDvPos[i]];
+      }
+      jValues[p] = sum;
+    }
+    return this->J;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_MASSACTIONODE_H
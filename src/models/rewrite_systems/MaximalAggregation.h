@@ -1,28 +1,32 @@
 #ifndef STOCHASTIC_SYSTEM_MINIMIZATION_MAXIMALAGGREGATION_H
 #define STOCHASTIC_SYSTEM_MINIMIZATION_MAXIMALAGGREGATION_H
 
+#include "../../util/RateGrouping.h"
 #include "../ReductionMethodInterface.h"
+#include "RateAccumulator.h"
+#include "ReactantLabelTable.h"
+#include "RefinablePartition.h"
 #include "RewriteSystem.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iterator>
-#include <mutex>
 #include <set>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 class MaximalAggregation : public ReductionMethodInterface {
 private:
   // The rewrite System under consideration
   std::shared_ptr<RewriteSystem> system;
-  // current partition: vector holding vectors of indices of the species
-  std::vector<std::vector<unsigned int>> part;
-  // holds labels of the partitions
-  std::vector<long> partLabels;
+  // current partition of the species
+  RefinablePartition part;
   // holds multinomial coefficients for each reaction
   std::vector<unsigned long> mcoeffs;
   // holds all reactants to be considered when computing fr/br; species, reagent
-  std::set<std::vector<std::array<unsigned int, 2>>> reactantLabels;
+  ReactantLabelTable reactantLabels;
   // gives the position of the label for decreasing Si per rule
   std::vector<std::vector<long>> labelPos;
   // holds all rules with non-zero net flux per species
@@ -30,19 +34,68 @@ private:
       nonZeroFluxRulesPerSpecies;
   // holds all rules having a certain species in their lhs
   std::vector<std::vector<size_t>> lhsContainsSpec;
-  // Used for caching the forward/backward rate values
-  MatDenDPtr M;
+  // forward/backward rates per species and label, one accumulator per
+  // splitter of the current batch
+  std::vector<RateAccumulator> M;
+  // number of splitters processed concurrently, 1 refines sequentially
+  size_t batchSize;
 
 public:
-  MaximalAggregation() = default;
+  // Pending splitters by block number with constant time membership
+  class SplitterQueue {
+  private:
+    std::vector<size_t> blocks;
+    std::vector<bool> queued;
+
+  public:
+    inline void push(size_t blockNo) {
+      if (blockNo >= this->queued.size()) {
+        this->queued.resize(blockNo + 1, false);
+      }
+      if (!this->queued[blockNo]) {
+        this->queued[blockNo] = true;
+        this->blocks.emplace_back(blockNo);
+      }
+    }
+
+    inline auto pop() -> size_t {
+      size_t blockNo = this->blocks.back();
+      this->blocks.pop_back();
+      this->queued[blockNo] = false;
+      return blockNo;
+    }
+
+    [[nodiscard]] inline auto contains(size_t blockNo) const -> bool {
+      return blockNo < this->queued.size() && this->queued[blockNo];
+    }
+
+    [[nodiscard]] inline auto empty() const -> bool {
+      return this->blocks.empty();
+    }
+  };
+
+  explicit MaximalAggregation(size_t mBatchSize = 1)
+      : batchSize(std::max<size_t>(1, mBatchSize)) {}
   ~MaximalAggregation() override;
 
   [[nodiscard]] std::string get_name() const override {
-    return "Maximal Aggregation";
+    return this->batchSize > 1 ? "Parallel Maximal Aggregation"
+                               : "Maximal Aggregation";
   }
 
+  [[nodiscard]] inline auto get_batch_size() const -> size_t {
+    return this->batchSize;
+  }
+
+  [[nodiscard]] inline const RefinablePartition &get_partition() const {
+    return this->part;
+  }
+
+  using ReductionMethodInterface::reduce;
+
   std::shared_ptr<RepresentationInterface>
-  reduce(const std::shared_ptr<RepresentationInterface> &ptr) override {
+  reduce(const std::shared_ptr<RepresentationInterface> &ptr,
+         const Deadline &deadline) override {
     auto rewriteSystem = static_pointer_cast<RewriteSystem>(ptr);
     std::vector<unsigned int> initBlock = {};
     for (unsigned int i = 0; i < rewriteSystem->get_species_list().size();
@@ -50,347 +103,463 @@ public:
       initBlock.emplace_back(i);
     }
     std::vector<std::vector<unsigned int>> initPart = {initBlock};
-    return this->reduce(rewriteSystem, initPart);
+    return this->reduce(rewriteSystem, initPart, deadline);
   }
 
+  // On expiry the system reduced by the last completed pass is returned; the
+  // partially refined partition is not stable yet and is only available via
+  // get_partition()
   std::shared_ptr<RewriteSystem>
   reduce(const std::shared_ptr<RewriteSystem> &ptr,
-         std::vector<std::vector<unsigned int>> &initPart) {
+         std::vector<std::vector<unsigned int>> &initPart,
+         const Deadline &deadline = Deadline()) {
     this->system = ptr;
-    this->part = initPart;
-    this->part = this->largest_equivalent_parition(true);
-    this->system = this->apply_reduction();
-
-    this->part = this->largest_equivalent_parition(false);
-    this->system = this->apply_reduction();
-
+    this->part = RefinablePartition(initPart);
+    try {
+      this->largest_equivalent_parition(true, deadline);
+      this->system = this->apply_reduction();
+
+      // the backward pass starts over on the species of the reduced system
+      this->part = single_block(this->system->get_species_list().size());
+      this->largest_equivalent_parition(false, deadline);
+      this->system = this->apply_reduction();
+    } catch (const DeadlineExceededException &) {
+      // this->system still holds the last completed pass
+    }
     return this->system;
   }
 
   std::vector<std::vector<unsigned int>>
-  largest_equivalent_parition(bool forward) {
+  largest_equivalent_parition(bool forward,
+                              const Deadline &deadline = Deadline()) {
     this->init();
     if (!forward) {
       this->backward_prepartitioning();
     }
-    std::vector<std::vector<unsigned int>> splitters = this->part;
-    std::vector<unsigned int> currentBlock;
+    SplitterQueue splitters;
+    for (size_t i = 0; i < this->part.size(); i++) {
+      splitters.push(i);
+    }
+    this->refine(forward, splitters, deadline);
+    return this->part.to_vectors();
+  }
+
+  // Forward partition of a system after a change of its rules, starting from
+  // the forward partition of the system before the change. delta holds the
+  // added and removed rules, and both versions of rules whose rate changed.
+  // The blocks containing a species of delta and the species new to the
+  // system are merged into one block, all other blocks are kept, and only
+  // the merged block and the blocks the merged species have rates w.r.t. are
+  // queued as splitters.
+  // This is not incremental in the size of the change: the changed system is
+  // indexed from scratch as in reduce(), which costs O(rules + species), and
+  // only the refinement starts from the merged block.
+  // The result is always a forward equivalence that refines the previous
+  // partition outside of the merged block, but it may be finer than the
+  // maximal one: species outside the merged block that the change makes
+  // equivalent stay apart. Use largest_equivalent_parition() from a single
+  // block where the maximal partition is needed.
+  std::vector<std::vector<unsigned int>> update_partition(
+      const std::shared_ptr<RewriteSystem> &changedSystem,
+      const std::vector<std::vector<unsigned int>> &previousPartition,
+      const std::vector<std::shared_ptr<RewriteSystem::Rule>> &delta,
+      const Deadline &deadline = Deadline()) {
+    size_t species = changedSystem->get_species_list().size();
+    std::vector<bool> affected(species, false);
+    for (const auto &rule : delta) {
+      for (const auto *hs : {&rule->get_lhs(), &rule->get_rhs()}) {
+        for (const auto &term : *hs) {
+          if (term[1] >= species) {
+            throw std::invalid_argument(
+                "The rule delta refers to a species unknown to the system!");
+          }
+          affected[term[1]] = true;
+        }
+      }
+    }
+
+    std::vector<std::vector<unsigned int>> start = {};
+    std::vector<unsigned int> merged = {};
+    std::vector<bool> covered(species, false);
+    bool touched;
+    for (const auto &block : previousPartition) {
+      touched = false;
+      for (const auto &s : block) {
+        if (s >= species) {
+          throw std::invalid_argument(
+              "The previous partition contains a species unknown to the "
+              "system!");
+        }
+        covered[s] = true;
+        touched = touched || affected[s];
+      }
+      if (touched) {
+        merged.insert(merged.end(), block.begin(), block.end());
+      } else {
+        start.push_back(block);
+      }
+    }
+    for (unsigned int s = 0; s < species; s++) {
+      if (!covered[s]) {
+        merged.emplace_back(s);
+      }
+    }
+    if (!merged.empty()) {
+      start.push_back(merged);
+    }
+
+    this->system = changedSystem;
+    this->part = RefinablePartition(start);
+    this->init();
+
+    SplitterQueue splitters;
+    if (!merged.empty()) {
+      splitters.push(this->part.get_block_number(merged[0]));
+      // the merged species have to be separated again by the blocks of the
+      // species their rules produce or consume
+      for (const auto &s : merged) {
+        for (const auto &ruleIdx : this->lhsContainsSpec[s]) {
+          for (const auto &flux : non_zero_fluxes(*(this->system), ruleIdx)) {
+            splitters.push(this->part.get_block_number(std::get<0>(flux)));
+          }
+        }
+      }
+    }
+    this->refine(true, splitters, deadline);
+    return this->part.to_vectors();
+  }
+
+  // Splits until no splitter is pending. Blocks not in the queue must be
+  // stable splitters of the current partition. Only the forward pass is
+  // batched, see split.
+  void refine(bool forward, SplitterQueue &splitters,
+              const Deadline &deadline = Deadline()) {
+    std::vector<size_t> batch;
+    const size_t limit = forward ? this->batchSize : 1;
     while (!splitters.empty()) {
-      currentBlock = splitters.back();
-      splitters.pop_back();
-      this->split(forward, currentBlock, splitters);
+      deadline.check();
+      batch.clear();
+      while (!splitters.empty() && batch.size() < limit) {
+        batch.emplace_back(splitters.pop());
+      }
+      this->split(forward, batch, splitters);
     }
-    return this->part;
   }
 
-  // Build labels, pos vector, mcoeff, matrix M
-  void init() {
-    const std::vector<std::shared_ptr<RewriteSystem::Rule>> &rules =
-        this->system->get_rules();
-    const std::vector<std::vector<unsigned int>> &speciesList =
-        this->system->get_species_list();
+  static auto single_block(size_t species) -> RefinablePartition {
+    std::vector<unsigned int> block = {};
+    for (unsigned int i = 0; i < species; i++) {
+      block.emplace_back(i);
+    }
+    return RefinablePartition({block});
+  }
 
-    std::vector<long> pos;
-    std::vector<std::array<unsigned int, 2>> reagents;
-    std::vector<std::array<unsigned int, 2>> alteredReagents;
-    std::mutex labelPosMutex = std::mutex();
-    std::mutex reactantLabelsMutex = std::mutex();
-    std::mutex posMutex = std::mutex();
-    std::set<std::vector<std::array<unsigned int, 2>>>::iterator findIt;
+  // Build labels, pos vector, mcoeff, matrix M. The work per rule runs in
+  // parallel, everything shared is assembled in rule order afterwards, so
+  // the result does not depend on the number of threads.
+  void init() {
+    const RewriteSystem &rs = *(this->system);
+    const Stoichiometry &lhs = rs.get_lhs_matrix();
+    size_t rules = rs.get_number_of_rules();
+    size_t species = rs.get_species_list().size();
+    long noRules = static_cast<long>(rules);
 
-    double ns;
-    std::mutex nonZeroFluxMutex = std::mutex();
-
-    this->partLabels = std::vector<long>(this->part.size(), -1L);
-    std::vector<size_t> empty = {};
-    this->lhsContainsSpec = std::vector<std::vector<size_t>>(
-        this->system->get_species_list().size(), empty);
-    std::vector<long> emptyL = {};
-    this->labelPos = std::vector<std::vector<long>>(
-        this->system->get_rules().size(), emptyL);
-    std::vector<std::tuple<size_t, double>> emptyTup = {};
-    this->nonZeroFluxRulesPerSpecies =
-        std::vector<std::vector<std::tuple<size_t, double>>>(
-            this->system->get_species_list().size(), emptyTup);
-    this->reactantLabels = {};
-
-    //#pragma omp parallel default(none)
-    //    {
-    //#pragma omp single default(none)
-    //      {
-    //#pragma omp task default(none) shared(rules)
-    //{
     this->set_mcoeffs();
-    //}
 
-    //#pragma omp taskloop default(none) num_threads(THREADS) if (!TEST)             \
-//    shared(rules, labelPosMutex,                                      \
-//           reactantLabelsMutex) private(pos, diff, candidate)
-    for (size_t i = 0; i < rules.size(); i++) {
-      reagents = rules[i]->get_lhs();
-      for (size_t k = 0; k < reagents.size(); k++) {
-        // generate reduced reagents
-        alteredReagents = {};
-        for (const auto &elem : reagents) {
-          alteredReagents.push_back(elem);
-        }
-        alteredReagents[k][0]--;
-        if (alteredReagents[k][0] == 0) {
-          alteredReagents.erase(
-              std::next(alteredReagents.begin(), static_cast<long>(k)));
-        }
-        std::lock_guard<std::mutex> guard(reactantLabelsMutex);
-        this->reactantLabels.emplace(alteredReagents);
+    // reduced reagents and non-zero fluxes of each rule
+    std::vector<std::vector<std::vector<std::array<unsigned int, 2>>>>
+        alteredReagents(rules);
+    std::vector<std::vector<std::tuple<unsigned int, double>>> fluxes(rules);
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(rs, lhs, alteredReagents, fluxes, noRules)
+    for (long i = 0; i < noRules; i++) {
+      auto rule = static_cast<size_t>(i);
+      alteredReagents[rule] =
+          reduced_reagents(lhs.factors_of(rule), lhs.species_of(rule));
+      fluxes[rule] = non_zero_fluxes(rs, rule);
+    }
+
+    this->reactantLabels.clear();
+    for (const auto &labels : alteredReagents) {
+      for (const auto &label : labels) {
+        this->reactantLabels.intern(label);
       }
     }
+    this->reactantLabels.sort();
+
+    // the position of the label where the k-th reagent was reduced by 1
+    this->labelPos = std::vector<std::vector<long>>(rules);
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(alteredReagents, noRules)
+    for (long i = 0; i < noRules; i++) {
+      std::vector<long> pos = {};
+      for (const auto &label : alteredReagents[static_cast<size_t>(i)]) {
+        pos.emplace_back(this->reactantLabels.find(label));
+      }
+      this->labelPos[static_cast<size_t>(i)] = pos;
+    }
 
-    //#pragma omp taskloop default(none) num_threads(THREADS) if (!TEST)             \
-//    shared(rules, speciesList, nonZeroFluxMutex,                                      \
-//           ) private(ns)
-    for (unsigned int i = 0; i < speciesList.size(); i++) {
-      for (size_t j = 0; j < rules.size(); j++) {
-        ns =
-            static_cast<double>(
-                get_factor_for_species(i, rules[j]->get_rhs())) -
-            static_cast<double>(get_factor_for_species(i, rules[j]->get_lhs()));
-        if (!floating_point_compare(ns, 0.0)) {
-          std::lock_guard<std::mutex> guard(nonZeroFluxMutex);
-          this->nonZeroFluxRulesPerSpecies[i].emplace_back(
-              j, ns * rules[j]->get_rate());
-        }
+    this->lhsContainsSpec = std::vector<std::vector<size_t>>(species);
+    this->nonZeroFluxRulesPerSpecies =
+        std::vector<std::vector<std::tuple<size_t, double>>>(species);
+    for (size_t i = 0; i < rules; i++) {
+      for (const auto &s : lhs.species_of(i)) {
+        this->lhsContainsSpec[s].emplace_back(i);
+      }
+      for (const auto &[s, flux] : fluxes[i]) {
+        this->nonZeroFluxRulesPerSpecies[s].emplace_back(i, flux);
       }
     }
-    //}
-    //}
 
-    // Once again to build the pos vector. Cant be done in the above iteration
-    // as indexes keep changing
+    this->M = std::vector<RateAccumulator>(this->batchSize,
+                                           RateAccumulator(species));
+  }
 
-    //#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)             \
-//    shared(rules, labelPosMutex,                                      \
-//           reactantLabelsMutex) private(pos, diff, candidate)
-    for (size_t i = 0; i < rules.size(); i++) {
-      reagents = rules[i]->get_lhs();
-      pos = std::vector<long>(reagents.size());
-      //#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)             \
-//    shared(rules, labelPosMutex,                                      \
-//           reactantLabelsMutex) private(pos, diff, candidate)
-      for (size_t k = 0; k < reagents.size(); k++) {
-        // generate reduced reagents
-        alteredReagents = {};
-        for (const auto &elem : reagents) {
-          alteredReagents.push_back(elem);
+  // The canonical reagents with the k-th one reduced by 1 for each k
+  static auto reduced_reagents(std::span<const unsigned int> factors,
+                               std::span<const unsigned int> species)
+      -> std::vector<std::vector<std::array<unsigned int, 2>>> {
+    std::vector<std::vector<std::array<unsigned int, 2>>> result = {};
+    std::vector<std::array<unsigned int, 2>> altered;
+    for (size_t k = 0; k < factors.size(); k++) {
+      altered = {};
+      for (size_t j = 0; j < factors.size(); j++) {
+        altered.push_back({factors[j], species[j]});
+      }
+      altered[k][0]--;
+      if (altered[k][0] == 0) {
+        altered.erase(std::next(altered.begin(), static_cast<long>(k)));
+      }
+      result.push_back(ReactantLabelTable::canonical(altered));
+    }
+    return result;
+  }
+
+  // Net stoichiometry times rate for each species the rule changes
+  static auto non_zero_fluxes(const RewriteSystem &rs, size_t rule)
+      -> std::vector<std::tuple<unsigned int, double>> {
+    const Stoichiometry &lhs = rs.get_lhs_matrix();
+    const Stoichiometry &rhs = rs.get_rhs_matrix();
+    std::vector<std::tuple<unsigned int, double>> result = {};
+    std::vector<unsigned int> seen = {};
+    double ns;
+    for (const auto *hs : {&lhs, &rhs}) {
+      for (const auto &s : hs->species_of(rule)) {
+        if (std::find(seen.begin(), seen.end(), s) != seen.end()) {
+          continue;
         }
-        alteredReagents[k][0]--;
-        if (alteredReagents[k][0] == 0) {
-          alteredReagents.erase(
-              std::next(alteredReagents.begin(), static_cast<long>(k)));
+        seen.emplace_back(s);
+        ns = static_cast<double>(rhs.factor(rule, s)) -
+             static_cast<double>(lhs.factor(rule, s));
+        if (!floating_point_compare(ns, 0.0)) {
+          result.emplace_back(s, ns * rs.get_rates()[rule]);
         }
-        findIt = this->reactantLabels.find(alteredReagents);
-        std::lock_guard<std::mutex> guard(posMutex);
-        pos[k] = std::distance(this->reactantLabels.begin(), findIt);
-        this->lhsContainsSpec[reagents[k][1]].emplace_back(i);
       }
-      std::lock_guard<std::mutex> guard(labelPosMutex);
-      this->labelPos[i] = pos;
     }
-
-    this->M =
-        std::make_shared<MatDenD>(speciesList.size(), reactantLabels.size());
-    this->M->fill(0.0);
+    return result;
   }
 
   void backward_prepartitioning() {
     std::vector<double> v =
         std::vector(this->system->get_species_list().size(), 0.0);
-    for (const auto &rule : this->system->get_rules()) {
-      if (rule->get_lhs().size() == 0) {
-        for (const auto &term : rule->get_rhs()) {
-          v[term[1]] += static_cast<double>(term[0]) * rule->get_rate();
+    const Stoichiometry &lhs = this->system->get_lhs_matrix();
+    const Stoichiometry &rhs = this->system->get_rhs_matrix();
+    for (size_t i = 0; i < this->system->get_number_of_rules(); i++) {
+      if (lhs.size(i) == 0) {
+        auto species = rhs.species_of(i);
+        auto factors = rhs.factors_of(i);
+        for (size_t k = 0; k < species.size(); k++) {
+          v[species[k]] +=
+              static_cast<double>(factors[k]) * this->system->get_rates()[i];
         }
       }
     }
-    std::vector<std::vector<unsigned int>> newPart = {};
-    std::vector<unsigned int> newBlock;
-    for (size_t i = 0; i < this->part.size(); i++) {
-      newBlock = {};
-      std::sort(
-          std::begin(part[i]), std::end(part[i]),
-          [v](const auto &lhs, const auto &rhs) { return v[lhs] < v[rhs]; });
-      double prev = v[part[i][0]];
-      newBlock.emplace_back(part[i][0]);
-      for (size_t j = 1; j < part[i].size(); j++) {
-        if (floating_point_compare<double>(v[part[i][j]], prev)) {
-          newBlock.emplace_back(part[i][j]);
-        } else {
-          newPart.emplace_back(newBlock);
-          newBlock = {};
-          prev = v[part[i][j]];
+    size_t blocks = this->part.size();
+    std::vector<std::vector<unsigned int>> groups;
+    size_t group;
+    for (size_t i = 0; i < blocks; i++) {
+      auto block = this->part.block(i);
+      std::vector<unsigned int> members(block.begin(), block.end());
+      RateGrouping grouping;
+      groups = {};
+      for (const auto &species : members) {
+        group = grouping.insert(v[species]);
+        if (group == groups.size()) {
+          groups.emplace_back();
         }
+        groups[group].emplace_back(species);
       }
+      this->part.split(i, groups);
     }
-    this->part = newPart;
   }
 
-  void split(bool forward, std::vector<unsigned int> &currentSplitter,
-             std::vector<std::vector<unsigned int>> &split) {
-    // of species with non-zero
-    std::set<unsigned int> nonZeroRateSpecies = std::set<unsigned int>();
-    std::vector<unsigned int> partitionsContainingNZRS = {};
+  void split(bool forward, size_t currentSplitter, SplitterQueue &splitters) {
+    split(forward, std::vector<size_t>{currentSplitter}, splitters);
+  }
 
-    for (const auto &sj : currentSplitter) {
-      if (forward) {
-        compute_forward_rate(sj, nonZeroRateSpecies);
-      } else {
-        compute_backward_rate(sj, currentSplitter, nonZeroRateSpecies);
-      }
+  // Splits w.r.t. all splitters of the batch at once. The rates of the batch
+  // are computed on the same partition, each splitter into its own
+  // accumulator, and the blocks are split by the combined signatures.
+  // Forward rates w.r.t. a splitter only depend on its members, so a batch
+  // makes the partition stable w.r.t. each of its splitters as splitting one
+  // after the other would, and refinement ends in the same coarsest stable
+  // partition. Backward rates lump the reagents by their current blocks,
+  // which another splitter of the batch may split, hence backward batches
+  // must hold a single splitter.
+  void split(bool forward, const std::vector<size_t> &batch,
+             SplitterQueue &splitters) {
+    long slots = static_cast<long>(batch.size());
+#pragma omp parallel for default(none) num_threads(THREADS)                    \
+    if (!TEST && slots > 1) shared(forward, batch, slots) schedule(dynamic)
+    for (long slot = 0; slot < slots; slot++) {
+      this->accumulate_rates(forward, batch[static_cast<size_t>(slot)],
+                             this->M[static_cast<size_t>(slot)]);
     }
-    std::vector<unsigned int> marked = {};
-    size_t blockNo;
-    for (const auto &element : nonZeroRateSpecies) {
-      blockNo = get_block_number(element);
-      this->partLabels[blockNo] = -1;
-      if (!floating_point_compare(this->M->row(element).norm(), 0.0)) {
-        if (!contains_marked(marked, blockNo)) {
-          partitionsContainingNZRS.emplace_back(blockNo);
+    for (size_t slot = 0; slot < batch.size(); slot++) {
+      for (const auto &element : this->M[slot].get_touched()) {
+        if (!this->M[slot].is_zero_row(element)) {
+          this->part.mark(element);
         }
       }
-      marked.push_back(element);
     }
 
-    bool isSplitter = false;
     std::vector<std::vector<unsigned int>> newBlocks;
-    std::vector<unsigned int> currentPartition;
-    std::vector<unsigned int> newPartition = {};
-    while (!partitionsContainingNZRS.empty()) {
-      blockNo = partitionsContainingNZRS.back();
-      partitionsContainingNZRS.pop_back();
-      currentPartition = this->part[blockNo];
-      for (size_t i = 0; i < currentPartition.size(); i++) {
-        for (size_t j = 0; j < marked.size(); j++) {
-          if (currentPartition[i] == marked[j]) {
-            newPartition.push_back(currentPartition[i]);
-            currentPartition.erase(currentPartition.begin() +
-                                   static_cast<long>(i));
-          }
-        }
-      }
-      newBlocks = split_marked(newPartition);
+    std::vector<size_t> newBlockNumbers;
+    std::vector<size_t> touchedBlocks = this->part.touched_blocks();
+    for (const auto &blockNo : touchedBlocks) {
+      newBlocks = split_marked(blockNo, batch.size());
+      if (newBlocks.size() == 1 &&
+          newBlocks[0].size() == this->part.block_size(blockNo)) {
+        continue;
+      }
+      newBlockNumbers = this->part.split(blockNo, newBlocks);
+      enqueue_parts(forward, blockNo, newBlockNumbers, splitters);
+    }
+    this->part.unmark_all();
+    for (size_t slot = 0; slot < batch.size(); slot++) {
+      this->M[slot].clear();
+    }
+  }
 
-      if (currentPartition.empty()) {
-        this->part[blockNo] = newPartition;
-        this->partLabels[blockNo] = -1L;
+  // Rates of all species w.r.t. one splitter; reads the partition only
+  void accumulate_rates(bool forward, size_t splitter, RateAccumulator &acc) {
+    // columns of the lumped reagents of the backward rates
+    ReactantLabelTable lumpedLabels;
+    for (const auto &sj : this->part.block(splitter)) {
+      if (forward) {
+        compute_forward_rate(sj, acc);
       } else {
-        this->part.push_back(newPartition);
-        this->partLabels.emplace_back(-1L);
-        // check if we the current partition is contained in the splitters
-        for (const auto &block : split) {
-          if (equal_block(block, this->part[blockNo])) {
-            isSplitter = true;
-          }
-        }
-        if (!isSplitter) {
-          split.emplace_back(this->part[blockNo]);
-        }
+        compute_backward_rate(sj, splitter, lumpedLabels, acc);
       }
-      for (size_t j = 0; j < newBlocks.size(); j++) {
-        split.emplace_back(newBlocks[j]);
-        if (j != 0) {
-          this->part.emplace_back(newBlocks[j]);
-          this->partLabels.emplace_back(-1L);
+    }
+  }
+
+  // Paige-Tarjan: if the split block is no pending splitter, the partition is
+  // stable w.r.t. the union of its parts. As forward rates are additive in
+  // the splitter, stability w.r.t. the largest part follows from the others.
+  // Backward rates depend on the blocks of the lumped reagents, hence all
+  // parts are processed there.
+  void enqueue_parts(bool forward, size_t blockNo,
+                     const std::vector<size_t> &newBlockNumbers,
+                     SplitterQueue &splitters) const {
+    size_t largest = blockNo;
+    if (forward && !splitters.contains(blockNo)) {
+      for (const auto &newBlock : newBlockNumbers) {
+        if (this->part.block_size(newBlock) > this->part.block_size(largest)) {
+          largest = newBlock;
         }
       }
+    } else {
+      splitters.push(blockNo);
     }
-    unsigned int currentSpecies;
-    Eigen::RowVectorXd zeroVect = Eigen::MatrixXd::Zero(
-        1, static_cast<long>(this->reactantLabels.size()));
-    while (!nonZeroRateSpecies.empty()) {
-      currentSpecies = *nonZeroRateSpecies.rbegin();
-      nonZeroRateSpecies.erase(std::prev(nonZeroRateSpecies.end()));
-      this->M->row(currentSpecies) = zeroVect;
+    if (largest != blockNo) {
+      splitters.push(blockNo);
+    }
+    for (const auto &newBlock : newBlockNumbers) {
+      if (newBlock != largest) {
+        splitters.push(newBlock);
+      }
     }
   }
 
-  inline auto split_marked(std::vector<unsigned int> &markedPartition) const
+  // Groups the marked species of a block by equal rows of M, see
+  // RateGrouping for the equality of rates
+  [[nodiscard]] inline auto split_marked(size_t blockNo, size_t slots = 1) const
       -> std::vector<std::vector<unsigned int>> {
-    // Asumption: nothing added to partition or splitters so far
     std::vector<std::vector<unsigned int>> result = {};
-    std::vector<unsigned int> newBlock;
-    // used to cache the indexes of the element to delete to avoid
-    //  1. changing the collection that is iterated over while iterating (UB)
-    //  2. avoid another iteration or a set difference to look up the indexes
-    std::vector<size_t> indexesToDelete;
-    double classRate;
-    std::vector<unsigned int> &currentBlock = markedPartition;
-
-    while (!currentBlock.empty()) {
-      classRate = this->M->row(currentBlock[0]).sum();
-      newBlock = {};
-      indexesToDelete = {};
-      for (size_t i = 0; i < currentBlock.size(); i++) {
-        if (!floating_point_compare<double>(
-                this->M->row(static_cast<long>(currentBlock[i])).sum(),
-                classRate)) {
-          newBlock.push_back(currentBlock[i]);
-          indexesToDelete.push_back(i);
-        }
-      }
-      for (const auto &index : indexesToDelete) {
-        currentBlock.erase(currentBlock.begin() + static_cast<long>(index));
-      }
-      result.emplace_back(currentBlock);
-      currentBlock = newBlock;
+    RateGrouping grouping;
+    std::vector<long long> keys;
+    std::vector<double> rates;
+    size_t group;
+    for (const auto &species : this->part.marked(blockNo)) {
+      signature(species, slots, keys, rates);
+      group = grouping.insert(keys, rates);
+      if (group == result.size()) {
+        result.emplace_back();
+      }
+      result[group].emplace_back(species);
     }
     return result;
   }
 
-  void compute_forward_rate(unsigned int species,
-                            std::set<unsigned int> &nonZeroRateSpecies) {
-    size_t ruleIdx;
-    std::shared_ptr<RewriteSystem::Rule> rule;
+  // Non-zero entries of the rows of the species in the first slots
+  // accumulators ordered by slot and label, as {slot, label} keys and rates
+  void signature(unsigned int species, size_t slots,
+                 std::vector<long long> &keys,
+                 std::vector<double> &rates) const {
+    keys.clear();
+    rates.clear();
+    for (size_t slot = 0; slot < slots; slot++) {
+      for (const auto &[label, rate] : this->M[slot].sorted_row(species)) {
+        keys.push_back(static_cast<long long>(slot));
+        keys.push_back(label);
+        rates.push_back(rate);
+      }
+    }
+  }
+
+  void compute_forward_rate(unsigned int species) {
+    compute_forward_rate(species, this->M[0]);
+  }
+
+  void compute_forward_rate(unsigned int species, RateAccumulator &acc) const {
+    const Stoichiometry &lhs = this->system->get_lhs_matrix();
     double rate;
-    unsigned long mcoeff;
-    std::vector<long> pos;
-    std::vector<std::array<unsigned int, 2>> terms;
-    for (size_t i = 0; i < this->nonZeroFluxRulesPerSpecies[species].size();
-         i++) {
-      ruleIdx = std::get<0>(this->nonZeroFluxRulesPerSpecies[species][i]);
-      rule = this->system->get_rules()[ruleIdx];
-      rate = std::get<1>(this->nonZeroFluxRulesPerSpecies[species][i]);
-      mcoeff = this->mcoeffs[ruleIdx];
-      pos = this->labelPos[ruleIdx];
-      terms = rule->get_lhs();
-      for (size_t j = 0; j < terms.size(); j++) {
-        update_m(terms[j][1], pos[j], rate / static_cast<double>(mcoeff),
-                 nonZeroRateSpecies);
-      }
-    }
-  }
-  void compute_backward_rate(unsigned int species,
-                             std::vector<unsigned int> &currentSplitter,
-                             std::set<unsigned int> &nonZeroRateSpecies) {
-    std::shared_ptr<RewriteSystem::Rule> rule;
-    std::vector<std::array<unsigned int, 2>> lhs;
-    std::vector<std::array<unsigned int, 2>> rhs;
+    for (const auto &[ruleIdx, flux] : this->nonZeroFluxRulesPerSpecies[species]) {
+      rate = flux / static_cast<double>(this->mcoeffs[ruleIdx]);
+      const std::vector<long> &pos = this->labelPos[ruleIdx];
+      auto reagents = lhs.species_of(ruleIdx);
+      for (size_t j = 0; j < reagents.size(); j++) {
+        acc.add(reagents[j], pos[j], rate);
+      }
+    }
+  }
+  void compute_backward_rate(
+      unsigned int species, size_t currentSplitter,
+      ReactantLabelTable &lumpedLabels, RateAccumulator &acc) const {
+    const Stoichiometry &lhs = this->system->get_lhs_matrix();
+    const Stoichiometry &rhs = this->system->get_rhs_matrix();
+    std::span<const unsigned int> reagents;
+    std::span<const unsigned int> products;
+    std::span<const unsigned int> factors;
     double alpha;
     size_t ruleIdx;
     size_t termIdx = 0;
-    std::vector<std::array<unsigned int, 2>> alteredReagents;
+    std::span<const ReactantLabelTable::Term> alteredReagents;
     unsigned int ct;
     std::vector<std::array<unsigned int, 2>> rhoMDash;
     size_t partNo;
     unsigned int currentSpecies;
-    long col = -1;
-    bool found = false;
+    long col;
+    bool found;
 
     for (size_t i = 0; i < this->lhsContainsSpec[species].size(); i++) {
       ruleIdx = this->lhsContainsSpec[species][i];
-      rule = this->system->get_rules()[ruleIdx];
-      lhs = rule->get_lhs();
+      reagents = lhs.species_of(ruleIdx);
       // We know that the rule must contain the species, i.e. posIdx is well
       // defined after the loop
-      for (size_t j = 0; i < lhs.size(); j++) {
-        if (lhs[j][1] == species) {
+      for (size_t j = 0; j < reagents.size(); j++) {
+        if (reagents[j] == species) {
           termIdx = j;
         }
       }
@@ -398,24 +567,21 @@ public:
       // using pos as it saves per rule the position of the label where the j-th
       // term was reduced by 1, i.e. pos[RuleIdx][termIdx] is the index to the
       // label where Sj was subtracted from
-      alteredReagents = *(std::next(this->reactantLabels.begin(),
-                                    this->labelPos[ruleIdx][termIdx]));
+      alteredReagents =
+          this->reactantLabels.label(this->labelPos[ruleIdx][termIdx]);
       ct = 1;
+      // the altered reagents up to the current partition, i.e. with the
+      // species replaced by their block numbers
       rhoMDash = {};
       for (size_t j = 0; j < alteredReagents.size(); j++) {
         currentSpecies = alteredReagents[j][1];
         partNo = this->get_block_number(currentSpecies);
-        if (this->equal_block(this->part[partNo], currentSplitter) &&
-            currentSpecies != species) {
+        if (equal_block(partNo, currentSplitter) && currentSpecies != species) {
           ct++;
         }
-        if (this->partLabels[partNo] == -1L) {
-          this->partLabels[partNo] = currentSpecies;
-        }
-        // Error prone?
-
+        found = false;
         for (size_t k = 0; k < rhoMDash.size(); k++) {
-          if (rhoMDash[k][1] == this->partLabels[partNo]) {
+          if (rhoMDash[k][1] == partNo) {
             found = true;
             rhoMDash[k][0] += alteredReagents[j][0];
             break;
@@ -423,209 +589,177 @@ public:
         }
         if (!found) {
           rhoMDash.push_back(
-              {alteredReagents[j][0],
-               static_cast<unsigned int>(this->partLabels[partNo])});
+              {alteredReagents[j][0], static_cast<unsigned int>(partNo)});
         }
       }
-      // Optimize me
-      long k = 0;
-      for (const auto &label : this->reactantLabels) {
-        if (equal_reagents(label, rhoMDash)) {
-          col = k;
-          break;
-        }
-        k++;
-      }
-      if (col == -1) {
-        std::cout << "rhoMDash in compute br was not found in the labels"
-                  << std::endl;
-      }
+      std::sort(rhoMDash.begin(), rhoMDash.end(),
+                [](const auto &lhsTerm, const auto &rhsTerm) {
+                  return lhsTerm[1] < rhsTerm[1];
+                });
+      col = lumpedLabels.intern(rhoMDash);
 
-      alpha = rule->get_rate();
+      alpha = this->system->get_rates()[ruleIdx];
       for (size_t j = 0; j < alteredReagents.size(); j++) {
-        update_m(alteredReagents[j][1], col,
-                 -alpha * alteredReagents[j][0] / ct, nonZeroRateSpecies);
+        acc.add(alteredReagents[j][1], col, -alpha * alteredReagents[j][0] / ct);
       }
-      rhs = rule->get_rhs();
-      for (size_t j = 0; j < rhs.size(); j++) {
-        update_m(rhs[j][1], col, alpha * rhs[j][0] / ct, nonZeroRateSpecies);
+      products = rhs.species_of(ruleIdx);
+      factors = rhs.factors_of(ruleIdx);
+      for (size_t j = 0; j < products.size(); j++) {
+        acc.add(products[j], col, alpha * factors[j] / ct);
       }
     }
   }
 
+  // Quotient of the system by the current partition in one pass over the
+  // species and one over the rules. Each block becomes a species, blocks of
+  // more than one species get a new entry in the mapping. A lumped species
+  // stands for the sum over its block, so the rate of a rule is divided by
+  // |B|^a per reagent aS with S in B, as if the block were uniformly
+  // distributed. Rules that coincide after lumping are merged by summing
+  // their rates, rules without net effect are dropped.
   std::shared_ptr<RewriteSystem> apply_reduction() {
-    std::vector<std::string> mapping = this->system->get_mapping();
-    std::vector<std::vector<unsigned int>> speciesList =
+    const std::vector<std::vector<unsigned int>> &oldSpecies =
         this->system->get_species_list();
-    std::vector<std::shared_ptr<RewriteSystem::Rule>> rules;
-    // use to cache order of the new species field in terms of blocks
-    // e.g. if block 2 was added to the mapping first, the species description
-    // will be 0...0 10... where 0...0 is the name for all previous species
-    // and 10... contains the names of the newly formed composite species
-    std::vector<size_t> collapsedSpec = {};
-    std::vector<size_t> reductionMap;
-
-    std::vector<unsigned int> specV;
-    std::string accumulateName;
-    for (size_t i = 0; i < this->part.size(); i++) {
-      if (this->part[i].size() > 1) {
-        specV = this->system->get_species_list()[this->part[i][0]];
-        accumulateName = "{" + this->system->get_name_for_species(specV);
-        for (size_t j = 1; j < this->part[i].size(); j++) {
-          specV = this->system->get_species_list()[this->part[i][j]];
-          accumulateName += ", " + this->system->get_name_for_species(specV);
-        }
-        accumulateName += "}";
-        mapping.emplace_back(accumulateName);
-        collapsedSpec.emplace_back(i);
-      }
-    }
+    size_t atoms = this->system->get_mapping().size();
+    std::vector<std::string> mapping = this->system->get_mapping();
+    std::vector<std::vector<unsigned int>> speciesList = {};
 
-    size_t lumped = this->system->get_mapping().size() - mapping.size();
-    std::vector<unsigned int> accumulateSpecies;
-    size_t partNo;
-    long collapsedSpecNo;
-    std::vector<size_t>::iterator findResult;
-    for (size_t i = 0; i < speciesList.size(); i++) {
-      partNo = get_block_number(static_cast<unsigned int>(i));
-      if (this->part[partNo].size() > 1) {
-        findResult =
-            std::find(collapsedSpec.begin(), collapsedSpec.end(), partNo);
-        if (findResult != collapsedSpec.end()) {
-          collapsedSpecNo = std::distance(collapsedSpec.begin(), findResult);
-          speciesList[i] = std::vector<unsigned int>(mapping.size(), 0);
-          speciesList[i][this->system->get_mapping().size() +
-                         static_cast<size_t>(collapsedSpecNo)] = 1;
-          collapsedSpec.erase(std::next(collapsedSpec.begin(), collapsedSpecNo));
+    // the new species of each block, numbered in order of the first member
+    std::vector<long> blockSpecies(this->part.size(), -1);
+    std::vector<unsigned int> speciesMap(oldSpecies.size());
+    std::vector<size_t> lumpedBlocks = {};
+    size_t blockNo;
+    for (unsigned int i = 0; i < oldSpecies.size(); i++) {
+      blockNo = this->part.get_block_number(i);
+      if (blockSpecies[blockNo] < 0) {
+        blockSpecies[blockNo] = static_cast<long>(speciesList.size());
+        if (this->part.block_size(blockNo) > 1) {
+          lumpedBlocks.emplace_back(blockNo);
+          speciesList.emplace_back();
         } else {
-          speciesList.erase(
-              std::next(speciesList.begin(), static_cast<long>(i)));
-          i--;
-        }
-      } else {
-        for (size_t j = 0; j < lumped; j++) {
-          speciesList[i].emplace_back(0);
+          speciesList.emplace_back(oldSpecies[i]);
         }
       }
-      reductionMap.push_back(i);
+      speciesMap[i] = static_cast<unsigned int>(blockSpecies[blockNo]);
+    }
+    for (const auto &lumpedBlock : lumpedBlocks) {
+      mapping.emplace_back(block_name(lumpedBlock));
+    }
+    for (auto &species : speciesList) {
+      species.resize(mapping.size(), 0);
+    }
+    for (size_t k = 0; k < lumpedBlocks.size(); k++) {
+      speciesList[static_cast<size_t>(blockSpecies[lumpedBlocks[k]])]
+                 [atoms + k] = 1;
     }
 
+    // merged rules by the ids of their lumped hand sides
+    ReactantLabelTable sides;
+    std::unordered_map<uint64_t, size_t> ruleIdx = {};
+    std::vector<std::array<long, 2>> ruleSides = {};
+    std::vector<double> rates = {};
     std::vector<std::array<unsigned int, 2>> lhs;
     std::vector<std::array<unsigned int, 2>> rhs;
-    std::array<unsigned int, 2> term;
-    double rate;
     double denom;
-    for (const auto &rule : this->system->get_rules()) {
-      // TODO adjust rules according to mapping
-      lhs = {};
-      for (size_t m = 0; m < rule->get_lhs().size(); m++) {
-        term = rule->get_lhs()[m];
-        term[1] = static_cast<unsigned int>(reductionMap[term[1]]);
-        lhs.push_back(term);
-      }
-      rhs = {};
-      for (size_t m = 0; m < rule->get_rhs().size(); m++) {
-        term = rule->get_rhs()[m];
-        term[1] = static_cast<unsigned int>(reductionMap[term[1]]);
-        rhs.push_back(term);
+    uint64_t key;
+    const Stoichiometry &oldLhs = this->system->get_lhs_matrix();
+    const Stoichiometry &oldRhs = this->system->get_rhs_matrix();
+    for (size_t i = 0; i < this->system->get_number_of_rules(); i++) {
+      lhs = lump_terms(oldLhs, i, speciesMap);
+      rhs = lump_terms(oldRhs, i, speciesMap);
+      if (lhs == rhs) {
+        continue;
       }
       denom = 1.0;
-      for (size_t n = 0; n < lhs.size(); n++) {
-        partNo = get_block_number(lhs[n][1]);
-        denom *= std::pow(this->part[partNo].size(), lhs[n][0]);
-      }
-      rate = rule->get_rate();
-      rate = rate / denom;
-      rules.emplace_back(std::make_shared<RewriteSystem::Rule>(rate, lhs, rhs));
+      auto reagents = oldLhs.species_of(i);
+      auto factors = oldLhs.factors_of(i);
+      for (size_t k = 0; k < reagents.size(); k++) {
+        denom *= std::pow(static_cast<double>(this->part.block_size(
+                              this->part.get_block_number(reagents[k]))),
+                          factors[k]);
+      }
+      std::array<long, 2> ids = {sides.intern(lhs), sides.intern(rhs)};
+      key = (static_cast<uint64_t>(ids[0]) << 32U) |
+            static_cast<uint64_t>(ids[1]);
+      auto [it, inserted] = ruleIdx.try_emplace(key, rates.size());
+      if (inserted) {
+        ruleSides.push_back(ids);
+        rates.emplace_back(0.0);
+      }
+      rates[it->second] += this->system->get_rates()[i] / denom;
     }
 
-    return std::make_shared<RewriteSystem>(mapping, speciesList, rules);
+    Stoichiometry newLhs;
+    Stoichiometry newRhs;
+    for (const auto &ids : ruleSides) {
+      newLhs.append(sides.label(ids[0]));
+      newRhs.append(sides.label(ids[1]));
+    }
+    return std::make_shared<RewriteSystem>(mapping, speciesList, rates,
+                                           std::move(newLhs),
+                                           std::move(newRhs));
   }
 
-  inline void update_m(unsigned int species, long colIdx, double val,
-                       std::set<unsigned int> &nonZeroRateSpecies) {
-    nonZeroRateSpecies.insert(species);
-    long rowIdx = static_cast<long>(species);
-
-    this->M->coeffRef(rowIdx, colIdx) = this->M->coeff(rowIdx, colIdx) + val;
+  // Terms of a row with the species replaced by their lumped species, in
+  // canonical order
+  static auto lump_terms(const Stoichiometry &hs, size_t rule,
+                         const std::vector<unsigned int> &speciesMap)
+      -> std::vector<std::array<unsigned int, 2>> {
+    auto species = hs.species_of(rule);
+    auto factors = hs.factors_of(rule);
+    std::vector<std::array<unsigned int, 2>> result(species.size());
+    for (size_t k = 0; k < species.size(); k++) {
+      result[k] = {factors[k], speciesMap[species[k]]};
+    }
+    return ReactantLabelTable::canonical(result);
   }
 
-  void set_mcoeffs() {
-    unsigned int upper = 0;
-    unsigned long long int lower;
-    const std::vector<std::shared_ptr<RewriteSystem::Rule>> &rules =
-        this->system->get_rules();
-
-    this->mcoeffs = std::vector(rules.size(), 0uL);
-
-    std::mutex mcoeffsMutex = std::mutex();
-    //#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
-//    shared(this->mcoeffs, mcoeffsMutex, rules) private(upper, lower)
-    for (size_t i = 0; i < rules.size(); i++) {
-      upper = 0;
-      lower = 1;
-      //#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
-//    shared(upper, lower, i)
-      for (const auto &term : rules[i]->get_lhs()) {
-        upper += term[0];
-        lower *= FACTORIALS[term[0]];
-      }
-      if (upper > 20) {
-        throw std::invalid_argument(
-            "the sum of the factors in a rules lhs is greater than 20. This "
-            "implies that a number needs to be calculated with that is larger "
-            "as the largest number a computer can accurately represent. Please "
-            "reduce the factors to the minimal possible values");
-      }
-      std::lock_guard<std::mutex> guard(mcoeffsMutex);
-      this->mcoeffs[i] = FACTORIALS[upper] / lower;
+  // "{S1, S2, ...}" with the members in order of their index
+  [[nodiscard]] auto block_name(size_t blockNo) const -> std::string {
+    auto block = this->part.block(blockNo);
+    std::vector<unsigned int> members(block.begin(), block.end());
+    std::sort(members.begin(), members.end());
+    std::string name = "{";
+    for (size_t j = 0; j < members.size(); j++) {
+      if (j > 0) {
+        name += ", ";
+      }
+      name += this->system->get_name_for_species(members[j]);
     }
+    return name + "}";
   }
 
-  static inline auto
-  get_factor_for_species(unsigned int species,
-                         const std::vector<std::array<unsigned int, 2>> &hs)
-      -> unsigned int {
-    for (const auto &term : hs) {
-      if (term[1] == species) {
-        return term[0];
-      }
+  void set_mcoeffs() {
+    const Stoichiometry &lhs = this->system->get_lhs_matrix();
+    long noRules = static_cast<long>(this->system->get_number_of_rules());
+    bool tooLarge = false;
+
+    this->mcoeffs = std::vector(lhs.rules(), 0uL);
+
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(lhs, noRules) reduction(|| : tooLarge)
+    for (long i = 0; i < noRules; i++) {
+      this->mcoeffs[static_cast<size_t>(i)] =
+          lhs.multinomial(static_cast<size_t>(i));
+      tooLarge = tooLarge || this->mcoeffs[static_cast<size_t>(i)] == 0;
+    }
+    // exceptions must not leave the parallel region
+    if (tooLarge) {
+      throw std::invalid_argument(
+          "the sum of the factors in a rules lhs is greater than 20. This "
+          "implies that a number needs to be calculated with that is larger "
+          "as the largest number a computer can accurately represent. Please "
+          "reduce the factors to the minimal possible values");
     }
-    return 0;
   }
 
-  inline auto get_block_number(unsigned int species) -> size_t {
-    for (size_t i = 0; i < this->part.size(); i++) {
-      for (const auto &index : this->part[i]) {
-        if (index == species) {
-          return i;
-        }
-      }
-    }
-    throw std::logic_error(
-        "The species must be contained in one of the partitions!");
+  [[nodiscard]] inline auto get_block_number(unsigned int species) const
+      -> size_t {
+    return this->part.get_block_number(species);
   }
 
-  static inline auto equal_block(const std::vector<unsigned int> &part0,
-                                 const std::vector<unsigned int> &part1)
-      -> bool {
-    if (part0.size() != part1.size()) {
-      return false;
-    }
-    bool found = false;
-    for (const auto elem0 : part0) {
-      for (const auto elem1 : part1) {
-        if (elem0 == elem1) {
-          found = true;
-        }
-      }
-      if (found == false) {
-        return false;
-      } else {
-        found = false;
-      }
-    }
-    return true;
+  static inline auto equal_block(size_t block0, size_t block1) -> bool {
+    return block0 == block1;
   }
 
   static inline auto
@@ -651,16 +785,8 @@ public:
     return true;
   }
 
-  inline auto contains_marked(std::vector<unsigned int> &markedSpec,
-                              size_t partNo) -> bool {
-    for (const auto &elem : this->part[partNo]) {
-      for (const auto &species : markedSpec) {
-        if (elem == species) {
-          return true;
-        }
-      }
-    }
-    return false;
+  [[nodiscard]] inline auto contains_marked(size_t partNo) const -> bool {
+    return this->part.contains_marked(partNo);
   }
 
   // All below methods are used for testing only
@@ -668,17 +794,16 @@ public:
     this->system = mSystem;
   }
   void set_part(const std::vector<std::vector<unsigned int>> &mPart) {
-    this->part = mPart;
+    this->part = RefinablePartition(mPart);
   }
   const std::shared_ptr<RewriteSystem> &get_system() { return this->system; }
-  const std::vector<std::vector<unsigned int>> &get_part() {
-    return this->part;
+  [[nodiscard]] std::vector<std::vector<unsigned int>> get_part() const {
+    return this->part.to_vectors();
   }
   const std::vector<unsigned long> &get_mcoeffs() const {
     return this->mcoeffs;
   }
-  const std::set<std::vector<std::array<unsigned int, 2>>> &
-  get_reactant_labels() const {
+  const ReactantLabelTable &get_reactant_labels() const {
     return this->reactantLabels;
   }
   const std::vector<std::vector<long>> &get_label_pos() const {
@@ -691,7 +816,11 @@ public:
   const std::vector<std::vector<size_t>> &get_lhs_contains_spec() const {
     return this->lhsContainsSpec;
   }
-  const MatDenDPtr &get_m() { return this->M; }
+  // Dense snapshot of the rates accumulated so far, for inspection only
+  [[nodiscard]] auto get_m() const -> MatDenDPtr {
+    return std::make_shared<MatDenD>(
+        this->M[0].to_dense(static_cast<long>(this->reactantLabels.size())));
+  }
 };
 
 #endif // STOCHASTIC_SYSTEM_MINIMIZATION_MAXIMALAGGREGATION_H
@@ -0,0 +1,3 @@
+#include "OdeIntegrator.h"
+
+OdeIntegrator::~OdeIntegrator() = default;
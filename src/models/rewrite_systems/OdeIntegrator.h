@@ -0,0 +1,315 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_ODEINTEGRATOR_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_ODEINTEGRATOR_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../util/Deadline.h"
+#include "../../util/DefsConstants.h"
+#include "MassActionOde.h"
+
+enum OdeMethod {
+  // explicit Runge-Kutta 5(4) of Dormand and Prince
+  DormandPrince = 0,
+  // linearly implicit, L-stable Rosenbrock method ROS2 of Verwer et al.
+  // with linearly implicit Euler as error estimate, for stiff systems
+  Rosenbrock = 1
+};
+
+// Adaptive integration of a mass-action ODE. The step size is controlled by
+// the RMS norm of the local error estimate scaled by
+// absTol + relTol * |x_i|, and steps end exactly on the requested time
+// points.
+class OdeIntegrator {
+private:
+  OdeMethod method;
+  double relTol;
+  double absTol;
+  unsigned long maxSteps;
+  // statistics of the last integration
+  unsigned long steps;
+  unsigned long rejected;
+  unsigned long rhsEvaluations;
+  unsigned long jacobianEvaluations;
+
+  static constexpr double SAFETY = 0.9;
+  static constexpr double MIN_FACTOR = 0.2;
+  static constexpr double MAX_FACTOR = 5.0;
+
+  // W = I - c J on the union of the fixed pattern of J and the diagonal. The
+  // pattern and its fill-reducing ordering are analysed once, each step only
+  // overwrites the values and refactorises.
+  class ShiftedJacobian {
+  private:
+    MatSpD W;
+    // position in W of entry p of J and of the diagonal entry i
+    std::vector<long> jPos;
+    std::vector<long> diagPos;
+    Eigen::SparseLU<MatSpD, Eigen::COLAMDOrdering<long>> lu;
+
+    static auto position(const MatSpD &mat, long row, long col) -> long {
+      const long *begin = mat.innerIndexPtr() + mat.outerIndexPtr()[col];
+      const long *end = mat.innerIndexPtr() + mat.outerIndexPtr()[col + 1];
+      return static_cast<long>(std::lower_bound(begin, end, row) -
+                               mat.innerIndexPtr());
+    }
+
+  public:
+    explicit ShiftedJacobian(const MatSpD &J)
+        : W(J.rows(), J.cols()), jPos({}), diagPos({}), lu() {
+      std::vector<Eigen::Triplet<double, long>> triplets = {};
+      for (long c = 0; c < J.outerSize(); c++) {
+        triplets.emplace_back(c, c, 0.0);
+        for (long p = J.outerIndexPtr()[c]; p < J.outerIndexPtr()[c + 1];
+             p++) {
+          triplets.emplace_back(J.innerIndexPtr()[p], c, 0.0);
+        }
+      }
+      this->W.setFromTriplets(triplets.begin(), triplets.end());
+      this->W.makeCompressed();
+      this->jPos.reserve(static_cast<size_t>(J.nonZeros()));
+      this->diagPos.reserve(static_cast<size_t>(J.cols()));
+      for (long c = 0; c < J.outerSize(); c++) {
+        this->diagPos.push_back(position(this->W, c, c));
+        for (long p = J.outerIndexPtr()[c]; p < J.outerIndexPtr()[c + 1];
+             p++) {
+          this->jPos.push_back(position(this->W, J.innerIndexPtr()[p], c));
+        }
+      }
+      this->lu.analyzePattern(this->W);
+    }
+
+    // factorises I - c J for J on the pattern given at construction, returns
+    // false if it is singular
+    auto factorize(const MatSpD &J, double c) -> bool {
+      double *values = this->W.valuePtr();
+      std::fill(values, values + this->W.nonZeros(), 0.0);
+      for (size_t i = 0; i < this->diagPos.size(); i++) {
+        values[this->diagPos[i]] = 1.0;
+      }
+      const double *jValues = J.valuePtr();
+      for (size_t p = 0; p < this->jPos.size(); p++) {
+        values[this->jPos[p]] -= c * jValues[p];
+      }
+      this->lu.factorize(this->W);
+      return this->lu.info() == Eigen::Success;
+    }
+
+    [[nodiscard]] auto solve(const Eigen::VectorXd &b) const
+        -> Eigen::VectorXd {
+      return this->lu.solve(b);
+    }
+  };
+
+  [[nodiscard]] auto error_norm(const Eigen::VectorXd &err,
+                                const Eigen::VectorXd &x,
+                                const Eigen::VectorXd &xNew) const -> double {
+    if (err.size() == 0) {
+      return 0.0;
+    }
+    double sum = 0.0;
+    for (long i = 0; i < err.size(); i++) {
+      double scale = this->absTol +
+                     this->relTol * std::max(std::fabs(x[i]), std::fabs(xNew[i]));
+      sum += (err[i] / scale) * (err[i] / scale);
+    }
+    return std::sqrt(sum / static_cast<double>(err.size()));
+  }
+
+  // Dormand-Prince step, returns the solution and the error estimate
+  void dormand_prince_step(const MassActionOde &ode, const Eigen::VectorXd &x,
+                           const Eigen::VectorXd &k1, double h,
+                           Eigen::VectorXd &xNew, Eigen::VectorXd &k7,
+                           Eigen::VectorXd &err) {
+    Eigen::VectorXd k2;
+    Eigen::VectorXd k3;
+    Eigen::VectorXd k4;
+    Eigen::VectorXd k5;
+    Eigen::VectorXd k6;
+    ode.rhs(x + h * (1.0 / 5.0) * k1, k2);
+    ode.rhs(x + h * ((3.0 / 40.0) * k1 + (9.0 / 40.0) * k2), k3);
+    ode.rhs(x + h * ((44.0 / 45.0) * k1 - (56.0 / 15.0) * k2 +
+                     (32.0 / 9.0) * k3),
+            k4);
+    ode.rhs(x + h * ((19372.0 / 6561.0) * k1 - (25360.0 / 2187.0) * k2 +
+                     (64448.0 / 6561.0) * k3 - (212.0 / 729.0) * k4),
+            k5);
+    ode.rhs(x + h * ((9017.0 / 3168.0) * k1 - (355.0 / 33.0) * k2 +
+                     (46732.0 / 5247.0) * k3 + (49.0 / 176.0) * k4 -
+                     (5103.0 / 18656.0) * k5),
+            k6);
+    xNew = x + h * ((35.0 / 384.0) * k1 + (500.0 / 1113.0) * k3 +
+                    (125.0 / 192.0) * k4 - (2187.0 / 6784.0) * k5 +
+                    (11.0 / 84.0) * k6);
+    // first same as last: k7 is the slope at the new point
+    ode.rhs(xNew, k7);
+    err = h * ((71.0 / 57600.0) * k1 - (71.0 / 16695.0) * k3 +
+               (71.0 / 1920.0) * k4 - (17253.0 / 339200.0) * k5 +
+               (22.0 / 525.0) * k6 - (1.0 / 40.0) * k7);
+    this->rhsEvaluations += 6;
+  }
+
+  // ROS2 step with W = I - gamma h J, returns false if W is singular
+  auto rosenbrock_step(const MassActionOde &ode, const Eigen::VectorXd &x,
+                       const Eigen::VectorXd &f, const MatSpD &J, double h,
+                       ShiftedJacobian &W, Eigen::VectorXd &xNew,
+                       Eigen::VectorXd &err) -> bool {
+    const double gamma = 1.0 + 1.0 / std::sqrt(2.0);
+    if (!W.factorize(J, gamma * h)) {
+      return false;
+    }
+    Eigen::VectorXd k1 = W.solve(f);
+    Eigen::VectorXd f2;
+    ode.rhs(x + h * k1, f2);
+    Eigen::VectorXd k2 = W.solve(f2 - 2.0 * k1);
+    xNew = x + h * (1.5 * k1 + 0.5 * k2);
+    // difference to the linearly implicit Euler solution x + h k1
+    err = h * 0.5 * (k1 + k2);
+    this->rhsEvaluations++;
+    return true;
+  }
+
+public:
+  explicit OdeIntegrator(OdeMethod mMethod = OdeMethod::DormandPrince,
+                         double mRelTol = 1e-6, double mAbsTol = 1e-9,
+                         unsigned long mMaxSteps = 10000000)
+      : method(mMethod), relTol(mRelTol), absTol(mAbsTol),
+        maxSteps(mMaxSteps), steps(0), rejected(0), rhsEvaluations(0),
+        jacobianEvaluations(0) {}
+
+  ~OdeIntegrator();
+
+  [[nodiscard]] inline auto get_steps() const -> unsigned long {
+    return this->steps;
+  }
+
+  [[nodiscard]] inline auto get_rejected() const -> unsigned long {
+    return this->rejected;
+  }
+
+  [[nodiscard]] inline auto get_rhs_evaluations() const -> unsigned long {
+    return this->rhsEvaluations;
+  }
+
+  [[nodiscard]] inline auto get_jacobian_evaluations() const
+      -> unsigned long {
+    return this->jacobianEvaluations;
+  }
+
+  // Solution at each of the ascending, non-negative time points, starting
+  // from x0 at time 0. Throws if the step size underflows, the step limit is
+  // reached or the deadline expires.
+  auto integrate(MassActionOde &ode, const Eigen::VectorXd &x0,
+                 const std::vector<double> &timePoints,
+                 const Deadline &deadline = Deadline())
+      -> std::vector<Eigen::VectorXd> {
+    if (x0.size() != ode.species()) {
+      throw std::invalid_argument(
+          "The initial state needs one value per species!");
+    }
+    if (!std::is_sorted(timePoints.begin(), timePoints.end()) ||
+        (!timePoints.empty() && timePoints.front() < 0.0)) {
+      throw std::invalid_argument(
+          "The time points have to be non-negative and ascending!");
+    }
+    this->steps = 0;
+    this->rejected = 0;
+    this->rhsEvaluations = 0;
+    this->jacobianEvaluations = 0;
+    // order of the error estimate plus one
+    const double exponent =
+        this->method == OdeMethod::DormandPrince ? 1.0 / 5.0 : 1.0 / 2.0;
+
+    std::vector<Eigen::VectorXd> result = {};
+    Eigen::VectorXd x = x0;
+    Eigen::VectorXd f;
+    Eigen::VectorXd fNew;
+    Eigen::VectorXd xNew;
+    Eigen::VectorXd err;
+    // the Jacobian lives in the ode and keeps its pattern across evaluations
+    const MatSpD *J = nullptr;
+    std::optional<ShiftedJacobian> W = std::nullopt;
+    ode.rhs(x, f);
+    this->rhsEvaluations++;
+    double t = 0.0;
+    double h = this->initial_step(x, f, timePoints);
+    bool jacobianCurrent = false;
+
+    for (const auto &tOut : timePoints) {
+      while (t < tOut) {
+        if (this->steps + this->rejected >= this->maxSteps) {
+          throw std::runtime_error("Maximum number of ODE steps reached!");
+        }
+        deadline.check();
+        bool last = t + h >= tOut;
+        double step = last ? tOut - t : h;
+        if (step <= 1e-14 * std::max(1.0, std::fabs(t))) {
+          throw std::runtime_error("ODE step size underflow at t = " +
+                                   std::to_string(t) + "!");
+        }
+        bool solved = true;
+        if (this->method == OdeMethod::DormandPrince) {
+          this->dormand_prince_step(ode, x, f, step, xNew, fNew, err);
+        } else {
+          if (!jacobianCurrent) {
+            J = &ode.jacobian(x);
+            this->jacobianEvaluations++;
+            jacobianCurrent = true;
+            if (!W) {
+              W.emplace(*J);
+            }
+          }
+          solved = this->rosenbrock_step(ode, x, f, *J, step, *W, xNew, err);
+        }
+        double norm = solved ? this->error_norm(err, x, xNew)
+                             : std::numeric_limits<double>::infinity();
+        if (std::isfinite(norm) && norm <= 1.0) {
+          t = last ? tOut : t + step;
+          x = xNew;
+          if (this->method == OdeMethod::DormandPrince) {
+            f = fNew;
+          } else {
+            ode.rhs(x, f);
+            this->rhsEvaluations++;
+            jacobianCurrent = false;
+          }
+          this->steps++;
+        } else {
+          this->rejected++;
+        }
+        double factor =
+            !std::isfinite(norm)
+                ? MIN_FACTOR
+                : (norm == 0.0 ? MAX_FACTOR
+                               : std::clamp(SAFETY * std::pow(norm, -exponent),
+                                            MIN_FACTOR, MAX_FACTOR));
+        // a step shortened to hit the time point does not limit the next one
+        h = (last && norm <= 1.0) ? std::max(h, step * factor) : step * factor;
+      }
+      result.push_back(x);
+    }
+    return result;
+  }
+
+private:
+  // 1 % of the ratio of the scaled norms of x and x', bounded by the horizon
+  [[nodiscard]] auto initial_step(const Eigen::VectorXd &x,
+                                  const Eigen::VectorXd &f,
+                                  const std::vector<double> &timePoints) const
+      -> double {
+    double horizon = timePoints.empty() ? 1.0 : timePoints.back();
+    Eigen::VectorXd zero = Eigen::VectorXd::Zero(x.size());
+    double d0 = this->error_norm(x, x, zero);
+    double d1 = this->error_norm(f, x, zero);
+    double h = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    return std::max(std::min(h, horizon), 1e-12);
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_ODEINTEGRATOR_H
@@ -0,0 +1,3 @@
+#include "RateAccumulator.h"
+
+RateAccumulator::~RateAccumulator() = default;
@@ -0,0 +1,111 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_RATEACCUMULATOR_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_RATEACCUMULATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../util/DefsConstants.h"
+#include "../../util/FloatingPointCompare.h"
+
+// Sparse species x label matrix of the rates accumulated for one splitter.
+// Only touched cells are stored, so memory is proportional to the updates
+// and clearing costs as much as the updates did.
+class RateAccumulator {
+private:
+  // position of a (species, label) cell in the row of the species
+  std::unordered_map<uint64_t, size_t> cells;
+  // touched (label, value) cells per species in insertion order
+  std::vector<std::vector<std::pair<long, double>>> rows;
+  // species with at least one touched cell in order of the first touch
+  std::vector<unsigned int> touched;
+
+  static inline auto key(unsigned int species, long label) -> uint64_t {
+    return (static_cast<uint64_t>(species) << 32U) |
+           static_cast<uint64_t>(static_cast<uint32_t>(label));
+  }
+
+public:
+  RateAccumulator() = default;
+
+  explicit RateAccumulator(size_t species)
+      : cells({}), rows(species), touched({}) {}
+
+  ~RateAccumulator();
+
+  inline void add(unsigned int species, long label, double val) {
+    auto [it, inserted] =
+        this->cells.try_emplace(key(species, label), this->rows[species].size());
+    if (inserted) {
+      if (this->rows[species].empty()) {
+        this->touched.emplace_back(species);
+      }
+      this->rows[species].emplace_back(label, val);
+    } else {
+      this->rows[species][it->second].second += val;
+    }
+  }
+
+  [[nodiscard]] inline auto get_touched() const
+      -> const std::vector<unsigned int> & {
+    return this->touched;
+  }
+
+  [[nodiscard]] inline auto row(unsigned int species) const
+      -> const std::vector<std::pair<long, double>> & {
+    return this->rows[species];
+  }
+
+  [[nodiscard]] inline auto coeff(unsigned int species, long label) const
+      -> double {
+    auto it = this->cells.find(key(species, label));
+    return it == this->cells.end() ? 0.0 : this->rows[species][it->second].second;
+  }
+
+  [[nodiscard]] inline auto is_zero_row(unsigned int species) const -> bool {
+    return std::all_of(
+        this->rows[species].begin(), this->rows[species].end(),
+        [](const auto &cell) { return floating_point_compare(cell.second, 0.0); });
+  }
+
+  // Non-zero cells of the row ordered by label
+  [[nodiscard]] auto sorted_row(unsigned int species) const
+      -> std::vector<std::pair<long, double>> {
+    std::vector<std::pair<long, double>> result = {};
+    for (const auto &cell : this->rows[species]) {
+      if (!floating_point_compare(cell.second, 0.0)) {
+        result.emplace_back(cell);
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  // Erases the touched cells one by one: unordered_map::clear visits every
+  // bucket and the buckets never shrink, so it would cost the peak size of
+  // any earlier splitter
+  inline void clear() {
+    for (const auto &species : this->touched) {
+      for (const auto &cell : this->rows[species]) {
+        this->cells.erase(key(species, cell.first));
+      }
+      this->rows[species].clear();
+    }
+    this->touched.clear();
+  }
+
+  [[nodiscard]] auto to_dense(long labels) const -> MatDenD {
+    MatDenD result = MatDenD::Zero(static_cast<long>(this->rows.size()), labels);
+    for (const auto &species : this->touched) {
+      for (const auto &cell : this->rows[species]) {
+        result(species, cell.first) = cell.second;
+      }
+    }
+    return result;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_RATEACCUMULATOR_H
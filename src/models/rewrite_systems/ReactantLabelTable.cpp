@@ -0,0 +1,3 @@
+#include "ReactantLabelTable.h"
+
+ReactantLabelTable::~ReactantLabelTable() = default;
@@ -0,0 +1,124 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_REACTANTLABELTABLE_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_REACTANTLABELTABLE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "../../util/Hashing.h"
+
+// Interned multisets of {stoichiometry, species} terms. All labels are stored
+// back to back in one array, a hash of the canonical form maps a label to its
+// id and ids map back to labels in constant time.
+class ReactantLabelTable {
+public:
+  using Term = std::array<unsigned int, 2>;
+
+private:
+  // terms of label i are terms[offsets[i]] ... terms[offsets[i + 1] - 1]
+  std::vector<Term> terms;
+  std::vector<size_t> offsets;
+  // ids of the labels by hash
+  std::unordered_map<uint64_t, std::vector<long>> index;
+
+  static auto hash(std::span<const Term> label) -> uint64_t {
+    uint64_t h = HASH_SEED;
+    for (const auto &term : label) {
+      hash_combine(h, (static_cast<uint64_t>(term[1]) << 32U) | term[0]);
+    }
+    return h;
+  }
+
+  [[nodiscard]] auto lookup(std::span<const Term> label, uint64_t h) const
+      -> long {
+    auto it = this->index.find(h);
+    if (it == this->index.end()) {
+      return -1;
+    }
+    for (const auto &id : it->second) {
+      if (std::ranges::equal(this->label(id), label)) {
+        return id;
+      }
+    }
+    return -1;
+  }
+
+public:
+  ReactantLabelTable() : terms({}), offsets({0}), index({}) {}
+
+  ~ReactantLabelTable();
+
+  // Terms sorted by species with the stoichiometries of repeated species
+  // summed up, so that equal multisets have equal representations
+  static auto canonical(std::vector<Term> label) -> std::vector<Term> {
+    std::sort(label.begin(), label.end(),
+              [](const Term &lhs, const Term &rhs) { return lhs[1] < rhs[1]; });
+    std::vector<Term> result = {};
+    for (const auto &term : label) {
+      if (!result.empty() && result.back()[1] == term[1]) {
+        result.back()[0] += term[0];
+      } else {
+        result.push_back(term);
+      }
+    }
+    return result;
+  }
+
+  // Id of the canonical label, adding it if it is new
+  auto intern(std::span<const Term> label) -> long {
+    uint64_t h = hash(label);
+    long id = lookup(label, h);
+    if (id < 0) {
+      id = static_cast<long>(this->size());
+      this->terms.insert(this->terms.end(), label.begin(), label.end());
+      this->offsets.push_back(this->terms.size());
+      this->index[h].push_back(id);
+    }
+    return id;
+  }
+
+  // Id of the canonical label or -1 if it was never interned
+  [[nodiscard]] auto find(std::span<const Term> label) const -> long {
+    return lookup(label, hash(label));
+  }
+
+  [[nodiscard]] inline auto label(long id) const -> std::span<const Term> {
+    auto i = static_cast<size_t>(id);
+    return {this->terms.data() + this->offsets[i],
+            this->offsets[i + 1] - this->offsets[i]};
+  }
+
+  [[nodiscard]] inline auto size() const -> size_t {
+    return this->offsets.size() - 1;
+  }
+
+  // Renumbers the labels in lexicographic order, which makes the ids
+  // independent of the order of interning
+  void sort() {
+    std::vector<long> order(this->size());
+    std::iota(order.begin(), order.end(), 0L);
+    std::sort(order.begin(), order.end(), [this](long lhs, long rhs) {
+      auto l = this->label(lhs);
+      auto r = this->label(rhs);
+      return std::lexicographical_compare(l.begin(), l.end(), r.begin(),
+                                          r.end());
+    });
+    ReactantLabelTable sorted;
+    for (const auto &id : order) {
+      sorted.intern(this->label(id));
+    }
+    *this = std::move(sorted);
+  }
+
+  void clear() {
+    this->terms.clear();
+    this->offsets = {0};
+    this->index.clear();
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_REACTANTLABELTABLE_H
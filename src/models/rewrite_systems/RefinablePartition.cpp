@@ -0,0 +1,3 @@
+#include "RefinablePartition.h"
+
+RefinablePartition::~RefinablePartition() = default;
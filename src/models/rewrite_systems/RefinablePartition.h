@@ -0,0 +1,177 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_REFINABLEPARTITION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_REFINABLEPARTITION_H
+
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Refinable partition of the species 0..n-1 (Valmari, Lehtinen). The
+// elements are stored block by block in one array, each block is a range
+// [first, end) in it and the marked elements of a block form the prefix
+// [first, markedEnd). Looking up the block of a species, marking a species
+// and splitting a block only touch the elements involved.
+class RefinablePartition {
+private:
+  // species ordered by block
+  std::vector<unsigned int> elements;
+  // position of each species in elements
+  std::vector<size_t> location;
+  // block number of each species
+  std::vector<size_t> blockOf;
+  // range of each block in elements
+  std::vector<size_t> first;
+  std::vector<size_t> end;
+  // end of the marked prefix of each block
+  std::vector<size_t> markedEnd;
+  // blocks containing marked elements
+  std::vector<size_t> touched;
+
+public:
+  RefinablePartition() = default;
+
+  // The blocks must contain each of the species 0..n-1 exactly once
+  explicit RefinablePartition(
+      const std::vector<std::vector<unsigned int>> &blocks) {
+    size_t n = 0;
+    for (const auto &block : blocks) {
+      n += block.size();
+    }
+    this->location = std::vector<size_t>(n, n);
+    this->blockOf = std::vector<size_t>(n, 0);
+    for (const auto &block : blocks) {
+      if (block.empty()) {
+        continue;
+      }
+      size_t blockNo = this->first.size();
+      this->first.push_back(this->elements.size());
+      this->markedEnd.push_back(this->elements.size());
+      for (const auto &species : block) {
+        if (species >= n || this->location[species] != n) {
+          throw std::invalid_argument(
+              "Each species must be contained in exactly one block!");
+        }
+        this->location[species] = this->elements.size();
+        this->blockOf[species] = blockNo;
+        this->elements.push_back(species);
+      }
+      this->end.push_back(this->elements.size());
+    }
+  }
+
+  ~RefinablePartition();
+
+  // number of blocks
+  [[nodiscard]] inline auto size() const -> size_t { return this->first.size(); }
+
+  [[nodiscard]] inline auto get_block_number(unsigned int species) const
+      -> size_t {
+    return this->blockOf[species];
+  }
+
+  [[nodiscard]] inline auto block_size(size_t blockNo) const -> size_t {
+    return this->end[blockNo] - this->first[blockNo];
+  }
+
+  [[nodiscard]] inline auto block(size_t blockNo) const
+      -> std::span<const unsigned int> {
+    return {this->elements.data() + this->first[blockNo],
+            this->block_size(blockNo)};
+  }
+
+  [[nodiscard]] inline auto marked(size_t blockNo) const
+      -> std::span<const unsigned int> {
+    return {this->elements.data() + this->first[blockNo],
+            this->markedEnd[blockNo] - this->first[blockNo]};
+  }
+
+  [[nodiscard]] inline auto marked_count(size_t blockNo) const -> size_t {
+    return this->markedEnd[blockNo] - this->first[blockNo];
+  }
+
+  [[nodiscard]] inline auto contains_marked(size_t blockNo) const -> bool {
+    return this->markedEnd[blockNo] != this->first[blockNo];
+  }
+
+  [[nodiscard]] inline auto is_marked(unsigned int species) const -> bool {
+    return this->location[species] < this->markedEnd[this->blockOf[species]];
+  }
+
+  [[nodiscard]] inline auto touched_blocks() const
+      -> const std::vector<size_t> & {
+    return this->touched;
+  }
+
+  inline void mark(unsigned int species) {
+    if (this->is_marked(species)) {
+      return;
+    }
+    size_t blockNo = this->blockOf[species];
+    if (!this->contains_marked(blockNo)) {
+      this->touched.push_back(blockNo);
+    }
+    this->swap_to(species, this->markedEnd[blockNo]);
+    this->markedEnd[blockNo]++;
+  }
+
+  inline void unmark_all() {
+    for (const auto &blockNo : this->touched) {
+      this->markedEnd[blockNo] = this->first[blockNo];
+    }
+    this->touched.clear();
+  }
+
+  // Moves each group of species of the given block into a block of its own
+  // and returns the numbers of the new blocks. If the groups cover the whole
+  // block, the first group keeps the block number. Marks of the block are
+  // dropped.
+  auto split(size_t blockNo,
+             const std::vector<std::vector<unsigned int>> &groups)
+      -> std::vector<size_t> {
+    size_t total = 0;
+    for (const auto &group : groups) {
+      total += group.size();
+    }
+    this->markedEnd[blockNo] = this->first[blockNo];
+    std::vector<size_t> newBlocks = {};
+    for (size_t g = total == this->block_size(blockNo) ? 1 : 0;
+         g < groups.size(); g++) {
+      if (groups[g].empty()) {
+        continue;
+      }
+      size_t newBlock = this->first.size();
+      size_t newEnd = this->end[blockNo];
+      for (const auto &species : groups[g]) {
+        this->end[blockNo]--;
+        this->swap_to(species, this->end[blockNo]);
+        this->blockOf[species] = newBlock;
+      }
+      this->first.push_back(this->end[blockNo]);
+      this->end.push_back(newEnd);
+      this->markedEnd.push_back(this->end[blockNo]);
+      newBlocks.push_back(newBlock);
+    }
+    return newBlocks;
+  }
+
+  [[nodiscard]] auto to_vectors() const
+      -> std::vector<std::vector<unsigned int>> {
+    std::vector<std::vector<unsigned int>> result = {};
+    for (size_t i = 0; i < this->size(); i++) {
+      auto range = this->block(i);
+      result.emplace_back(range.begin(), range.end());
+    }
+    return result;
+  }
+
+private:
+  inline void swap_to(unsigned int species, size_t position) {
+    unsigned int other = this->elements[position];
+    size_t from = this->location[species];
+    this->elements[position] = species;
+    this->location[species] = position;
+    this->elements[from] = other;
+    this->location[other] = from;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_REFINABLEPARTITION_H
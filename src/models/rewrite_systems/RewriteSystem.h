@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <set>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
@@ -10,106 +11,162 @@
 #include "../../util/FloatingPointCompare.h"
 #include "../../util/ParseUtils.h"
 #include "../RepresentationInterface.h"
+#include "CanonicalRewriteSystem.h"
+#include "SpeciesDictionary.h"
+#include "Stoichiometry.h"
 
 class RewriteSystem : public RepresentationInterface {
 public:
   class Rule;
 
 private:
-  std::vector<std::string> mapping;
-  std::vector<std::vector<unsigned int>> speciesList;
-  std::vector<std::shared_ptr<Rule>> rules;
+  SpeciesDictionary dictionary;
+  // rule i consumes row i of lhs and produces row i of rhs at rates[i]
+  std::vector<double> rates;
+  Stoichiometry lhs;
+  Stoichiometry rhs;
 
 public:
   RewriteSystem() = default;
-  RewriteSystem(std::vector<std::string> mMapping,
-                std::vector<std::vector<unsigned int>> mSpeciesList,
-                std::vector<std::shared_ptr<Rule>> mRules)
-      : mapping(std::move(mMapping)), speciesList(std::move(mSpeciesList)),
-        rules(std::move(mRules)) {}
+  RewriteSystem(const std::vector<std::string> &mMapping,
+                const std::vector<std::vector<unsigned int>> &mSpeciesList,
+                const std::vector<std::shared_ptr<Rule>> &mRules)
+      : RewriteSystem(SpeciesDictionary(mMapping, mSpeciesList), mRules) {}
+
+  RewriteSystem(SpeciesDictionary mDictionary,
+                const std::vector<std::shared_ptr<Rule>> &mRules)
+      : dictionary(std::move(mDictionary)), rates({}), lhs(), rhs() {
+    size_t lhsTerms = 0;
+    size_t rhsTerms = 0;
+    for (const auto &rule : mRules) {
+      lhsTerms += rule->get_lhs().size();
+      rhsTerms += rule->get_rhs().size();
+    }
+    this->rates.reserve(mRules.size());
+    this->lhs.reserve(mRules.size(), lhsTerms);
+    this->rhs.reserve(mRules.size(), rhsTerms);
+    for (const auto &rule : mRules) {
+      this->rates.push_back(rule->get_rate());
+      this->lhs.append(rule->get_lhs());
+      this->rhs.append(rule->get_rhs());
+    }
+  }
+
+  RewriteSystem(const std::vector<std::string> &mMapping,
+                const std::vector<std::vector<unsigned int>> &mSpeciesList,
+                std::vector<double> mRates, Stoichiometry mLhs,
+                Stoichiometry mRhs)
+      : RewriteSystem(SpeciesDictionary(mMapping, mSpeciesList),
+                      std::move(mRates), std::move(mLhs), std::move(mRhs)) {}
+
+  RewriteSystem(SpeciesDictionary mDictionary, std::vector<double> mRates,
+                Stoichiometry mLhs, Stoichiometry mRhs)
+      : dictionary(std::move(mDictionary)), rates(std::move(mRates)),
+        lhs(std::move(mLhs)), rhs(std::move(mRhs)) {
+    if (this->lhs.rules() != this->rates.size() ||
+        this->rhs.rules() != this->rates.size()) {
+      throw std::invalid_argument(
+          "The stoichiometry matrices need one row per rate!");
+    }
+  }
 
   ~RewriteSystem() override;
 
   [[nodiscard]] auto get_mapping() const noexcept
       -> const std::vector<std::string> & {
-    return this->mapping;
+    return this->dictionary.get_atoms();
   }
 
   [[nodiscard]] auto get_species_list() const noexcept
       -> const std::vector<std::vector<unsigned int>> & {
-    return this->speciesList;
+    return this->dictionary.get_species();
   }
 
-  [[nodiscard]] auto get_rules() const noexcept
-      -> const std::vector<std::shared_ptr<Rule>> & {
-    return this->rules;
+  [[nodiscard]] auto get_species_dictionary() const noexcept
+      -> const SpeciesDictionary & {
+    return this->dictionary;
   }
 
-  [[nodiscard]] auto get_name_for_species(const std::vector< unsigned int> &vec) const -> std::string {
-    std::string res;
-    for (size_t i = 0; i < vec.size(); i++) {
-      if (vec[i] > 0) {
-        res += this->mapping[i];
-        if (vec[i] > 1) {
-          res += std::to_string(vec[i]);
-        }
-      }
+  [[nodiscard]] auto get_number_of_rules() const noexcept -> size_t {
+    return this->rates.size();
+  }
+
+  [[nodiscard]] auto get_rates() const noexcept -> const std::vector<double> & {
+    return this->rates;
+  }
+
+  [[nodiscard]] auto get_lhs_matrix() const noexcept -> const Stoichiometry & {
+    return this->lhs;
+  }
+
+  [[nodiscard]] auto get_rhs_matrix() const noexcept -> const Stoichiometry & {
+    return this->rhs;
+  }
+
+  // Copy of the i-th rule
+  [[nodiscard]] auto get_rule(size_t i) const -> std::shared_ptr<Rule> {
+    return std::make_shared<Rule>(this->rates[i], this->lhs.terms(i),
+                                  this->rhs.terms(i));
+  }
+
+  // Copies of all rules, prefer the matrices for traversals
+  [[nodiscard]] auto get_rules() const -> std::vector<std::shared_ptr<Rule>> {
+    std::vector<std::shared_ptr<Rule>> result = {};
+    result.reserve(this->rates.size());
+    for (size_t i = 0; i < this->rates.size(); i++) {
+      result.push_back(get_rule(i));
     }
-    return res;
+    return result;
+  }
+
+  [[nodiscard]] auto get_name_for_species(size_t species) const
+      -> const std::string & {
+    return this->dictionary.name(species);
+  }
+
+  [[nodiscard]] auto
+  get_name_for_species(const std::vector<unsigned int> &vec) const
+      -> std::string {
+    long id = this->dictionary.find_species(vec);
+    if (id < 0) {
+      return SpeciesDictionary::name_of(this->get_mapping(), vec);
+    }
+    return this->dictionary.name(static_cast<size_t>(id));
   }
 
   [[nodiscard]] auto pretty_print() const -> std::string override {
     std::stringstream stringstream;
     stringstream << "Alphabet:\n";
-    for (const auto &elem : mapping) {
+    for (const auto &elem : this->get_mapping()) {
       stringstream << "\t " << elem << std::endl;
     }
-    size_t i = 0;
     stringstream << "\n Species:\n";
-    for (const auto &elem : this->speciesList) {
-      stringstream << "\t ";
-      for (const auto &digit : elem) {
-        if (digit > 0) {
-          stringstream << mapping[i];
-          if (digit > 1) {
-            stringstream << digit;
-          }
-        }
-        i++;
-      }
-      i = 0;
-      stringstream << std::endl;
+    for (size_t i = 0; i < this->dictionary.size(); i++) {
+      stringstream << "\t " << this->dictionary.name(i) << std::endl;
     }
     stringstream << "\n Rules:\n";
-    for (const auto &rule : this->rules) {
+    for (const auto &rule : this->get_rules()) {
       stringstream << "\t" << rule->pretty_print();
     }
     return stringstream.str();
   }
 
-  // FIXME Dummy: Only checks if they are exactly the same, not in terms of
-  // dynamic semantics
+  // Normal form independent of the order of atoms, species, rules and terms
+  [[nodiscard]] auto canonical_form() const -> CanonicalRewriteSystem {
+    return {this->dictionary, this->rates, this->lhs, this->rhs};
+  }
+
+  // Syntactic equivalence: equal canonical forms, i.e. the same rules up to
+  // reordering, with duplicate rules merged. Not in terms of dynamic
+  // semantics.
   [[nodiscard]] auto
   equivalent(const std::shared_ptr<RepresentationInterface> &other) const
       -> bool override {
     auto oRewriteSystem = static_pointer_cast<RewriteSystem>(other);
-    if (this->mapping.size() != oRewriteSystem->get_mapping().size() ||
-        this->rules.size() != oRewriteSystem->get_rules().size()) {
+    if (oRewriteSystem == nullptr) {
       return false;
     }
-    bool found;
-    for (const auto &rule : this->rules) {
-      found = false;
-      for (const auto &oRule : oRewriteSystem->get_rules()) {
-        if (rule->equivalent(oRule)) {
-          found = true;
-        }
-      }
-      if (!found) {
-        return false;
-      }
-    }
-    return true;
+    return this->canonical_form().equals(oRewriteSystem->canonical_form());
   }
 
   class Rule : public RepresentationInterface {
@@ -159,9 +216,8 @@ public:
       return stringstream.str();
     }
 
-    // FIXME
-    //  Dummy: Only checks if they are exactly the same, not in terms of
-    //  dynamic semantics
+    // Same rate and the same terms up to order and splitting of a species
+    // into several terms. Not in terms of dynamic semantics.
     [[nodiscard]] auto
     equivalent(const std::shared_ptr<RepresentationInterface> &other) const
         -> bool override {
@@ -169,35 +225,11 @@ public:
       if (oRule == nullptr) {
         return false;
       }
-      if (!floating_point_compare(this->rate - oRule->get_rate(), 0.0) ||
-          this->lhs.size() != oRule->get_lhs().size() ||
-          this->rhs.size() != oRule->get_rhs().size()) {
-        return false;
-      }
-      bool found;
-      for (const auto &term : this->lhs) {
-        found = false;
-        for (const auto &oTerm : oRule->get_lhs()) {
-          if (term[0] == oTerm[0] && term[1] == oTerm[1]) {
-            found = true;
-          }
-        }
-        if (!found) {
-          return false;
-        }
-      }
-      for (const auto &term : this->rhs) {
-        found = false;
-        for (const auto &oTerm : oRule->get_rhs()) {
-          if (term[0] == oTerm[0] && term[1] == oTerm[1]) {
-            found = true;
-          }
-        }
-        if (!found) {
-          return false;
-        }
-      }
-      return true;
+      return floating_point_compare(this->rate, oRule->get_rate()) &&
+             CanonicalRewriteSystem::normalize(this->lhs) ==
+                 CanonicalRewriteSystem::normalize(oRule->get_lhs()) &&
+             CanonicalRewriteSystem::normalize(this->rhs) ==
+                 CanonicalRewriteSystem::normalize(oRule->get_rhs());
     }
   };
 };
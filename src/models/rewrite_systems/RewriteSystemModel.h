@@ -1,10 +1,14 @@
 #ifndef STOCHASTIC_SYSTEM_MINIMIZATION_REWRITESYSTEMMODEL_H
 #define STOCHASTIC_SYSTEM_MINIMIZATION_REWRITESYSTEMMODEL_H
 
+#include <cstring>
+#include <string_view>
+
 #include "../../util/ParseUtils.h"
 #include "../ModelInterface.h"
 #include "MaximalAggregation.h"
 #include "RewriteSystem.h"
+#include "SpeciesDictionary.h"
 
 class RewriteSystemModel : public ModelInterface {
 private:
@@ -13,7 +17,8 @@ private:
 
 public:
   RewriteSystemModel()
-      : reductionMethods({std::make_shared<MaximalAggregation>()}),
+      : reductionMethods({std::make_shared<MaximalAggregation>(),
+                          std::make_shared<MaximalAggregation>(THREADS)}),
         conversionMethods({}) {}
   ~RewriteSystemModel() override;
 
@@ -22,13 +27,14 @@ public:
   }
 
   static inline auto
-  convert_species_string_vector(const std::vector<std::string> &pMapping,
-                                std::string &input) {
+  convert_species_string_vector(const SpeciesDictionary &dictionary,
+                                std::string_view input) {
     bool seenPrevEntity = false;
-    std::string prevEntityStr;
+    std::string_view prevEntityStr;
     unsigned int prevEntityInt = 0;
     unsigned char next = 0;
-    std::vector<unsigned int> word = std::vector(pMapping.size(), 0u);
+    std::vector<unsigned int> word =
+        std::vector(dictionary.get_atoms().size(), 0u);
 
     while (!input.empty()) {
       next = static_cast<unsigned char>(input[0]);
@@ -38,12 +44,17 @@ public:
         }
         seenPrevEntity = true;
         prevEntityStr = extract_atomic_name(input);
-        prevEntityInt = static_cast<unsigned int>(std::distance(
-            pMapping.begin(),
-            std::find(pMapping.begin(), pMapping.end(), prevEntityStr)));
+        long atom = dictionary.find_atom(prevEntityStr);
+        if (atom < 0) {
+          throw std::invalid_argument("Unknown atom " +
+                                      std::string(prevEntityStr) + "!");
+        }
+        prevEntityInt = static_cast<unsigned int>(atom);
       } else if ((std::isdigit(next) != 0) && seenPrevEntity) {
         seenPrevEntity = false;
         word[prevEntityInt] = extract_number<unsigned int>(input);
+      } else {
+        input.remove_prefix(1);
       }
       if (seenPrevEntity && input.empty()) {
         seenPrevEntity = false;
@@ -63,46 +74,45 @@ public:
     return word;
   }
 
-  static inline auto
-  extract_term(const std::vector<std::string> &pMapping,
-               const std::vector<std::vector<unsigned int>> &pSpeciesList,
-               std::string &input) -> std::array<unsigned int, 2> {
+  // Species are looked up by their spelling first and only converted to
+  // their composition if the spelling is unknown
+  static inline auto extract_term(const SpeciesDictionary &dictionary,
+                                  std::string_view input)
+      -> std::array<unsigned int, 2> {
 
     unsigned int factor = 1;
-    std::vector<unsigned int> word = std::vector(pMapping.size(), 0u);
+    long theSpecies = -1;
+    std::vector<unsigned int> word = {};
+    input = trim(input);
     while (!input.empty()) {
       unsigned char next = static_cast<unsigned char>(input[0]);
       if ((std::isdigit(next) != 0)) {
         factor = extract_number<unsigned int>(input);
+        input = trim(input);
       } else if ((std::isupper(next) != 0)) {
-        word = convert_species_string_vector(pMapping, input);
+        theSpecies = dictionary.find_species(input);
+        if (theSpecies < 0) {
+          word = convert_species_string_vector(dictionary, input);
+          theSpecies = dictionary.find_species(word);
+        }
+        input = {};
+      } else {
+        input.remove_prefix(1);
       }
     }
-    unsigned int theSpecies = 0;
-    auto it = std::find(std::begin(pSpeciesList), std::end(pSpeciesList), word);
-    if (it != std::end(pSpeciesList)) {
-      theSpecies = static_cast<unsigned int>(
-          std::distance(std::begin(pSpeciesList), it));
-    } else {
+    if (theSpecies < 0) {
       throw std::invalid_argument("Could not find species in species list!");
     }
-    return {factor, theSpecies};
+    return {factor, static_cast<unsigned int>(theSpecies)};
   }
 
-  static inline auto
-  extract_terms(const std::vector<std::string> &pMapping,
-                const std::vector<std::vector<unsigned int>> &pSpeciesList,
-                std::string &input)
+  static inline auto extract_terms(const SpeciesDictionary &dictionary,
+                                   std::string_view input)
       -> std::vector<std::array<unsigned int, 2>> {
     std::vector<std::array<unsigned int, 2>> result = {};
-    std::string term;
-    size_t pos = 0;
-    size_t prev = 0;
-    while (pos != std::string::npos) {
-      pos = input.find('+', prev);
-      term = input.substr(prev, pos - prev);
-      result.emplace_back(extract_term(pMapping, pSpeciesList, term));
-      prev = pos + strlen("+");
+    ParseCursor terms(input);
+    while (!terms.at_end()) {
+      result.emplace_back(extract_term(dictionary, terms.next('+')));
     }
     return result;
   }
@@ -110,40 +120,38 @@ public:
   auto parse(std::string &string)
       -> std::shared_ptr<RepresentationInterface> override {
     // Step 1: Enumerate all distinct "Elements"
-    std::vector<std::string> pMapping = {};
-    std::istringstream f(string);
-    std::string line;
-    std::string name;
-
-    while (std::getline(f, line)) {
-      if (line.find("->") != std::string::npos) {
+    SpeciesDictionary dictionary;
+    std::string_view line;
+    std::string_view name;
+
+    ParseCursor lines(string);
+    while (!lines.at_end()) {
+      line = lines.next('\n');
+      if (line.find("->") != std::string_view::npos) {
         name = extract_atomic_name(line);
         while (!name.empty()) {
-          if (std::find(pMapping.begin(), pMapping.end(), name) ==
-              pMapping.end()) {
-            pMapping.emplace_back(name);
-          }
+          dictionary.intern_atom(name);
           name = extract_atomic_name(line);
         }
       }
     }
 
-    // FIXME cont here
     // Step 2: extract Species
-    f = std::istringstream(string);
-    std::vector<std::vector<unsigned int>> pSpeciesList = {};
+    lines = ParseCursor(string);
     std::vector<unsigned int> pSpecies;
-    while (std::getline(f, line)) {
-      if (line.find("->") != std::string::npos) {
+    while (!lines.at_end()) {
+      line = lines.next('\n');
+      if (line.find("->") != std::string_view::npos) {
         name = extract_species_name(line);
-        pSpecies = convert_species_string_vector(pMapping, name);
-        while (!pSpecies.empty()) {
-          if (std::find(pSpeciesList.begin(), pSpeciesList.end(), pSpecies) ==
-              pSpeciesList.end()) {
-            pSpeciesList.emplace_back(pSpecies);
+        while (!name.empty()) {
+          if (dictionary.find_species(name) < 0) {
+            pSpecies = convert_species_string_vector(dictionary, name);
+            if (pSpecies.empty()) {
+              break;
+            }
+            dictionary.add_name(name, dictionary.intern_species(pSpecies));
           }
           name = extract_species_name(line);
-          pSpecies = convert_species_string_vector(pMapping, name);
         }
       }
     }
@@ -152,32 +160,35 @@ public:
     std::vector<std::shared_ptr<RewriteSystem::Rule>> pRules = {};
     std::vector<std::array<unsigned int, 2>> lhs = {};
     std::vector<std::array<unsigned int, 2>> rhs;
-    std::string lhsInput;
-    std::string rhsInput;
-    std::string rateInput;
+    std::string_view lhsInput;
+    std::string_view rhsInput;
+    std::string_view rateInput;
     size_t middle = 0;
     size_t end = 0;
     double rate = 0;
-    line = get_next_line(string, "\n", TrimType::TrimWhiteSpace);
-    while (!line.empty()) {
-      if (line.starts_with("begin") || line.starts_with("end")) {
-        line = get_next_line(string, "\n", TrimType::TrimWhiteSpace);
+    lines = ParseCursor(string);
+    while (!lines.at_end()) {
+      line = lines.next('\n');
+      if (line.empty() || line.starts_with("begin") ||
+          line.starts_with("end")) {
         continue;
       }
       middle = line.find("->");
       end = line.find(',');
+      if (middle == std::string_view::npos || end == std::string_view::npos ||
+          end < middle) {
+        throw std::invalid_argument("Rules have the form lhs -> rhs, rate!");
+      }
 
-      lhsInput = line.substr(0, middle - 0);
-      rhsInput =
-          line.substr(middle + strlen("->"), end - (middle + strlen("->")));
-      rateInput = line.substr(end + strlen(","), line.size());
-      // - (end + strlen(","))
+      lhsInput = trim(line.substr(0, middle));
+      rhsInput = trim(line.substr(middle + strlen("->"),
+                                  end - (middle + strlen("->"))));
+      rateInput = trim(line.substr(end + strlen(",")));
 
-      if (!lhsInput.empty()) {
-        lhs = extract_terms(pMapping, pSpeciesList, lhsInput);
-      }
+      lhs = lhsInput.empty() ? std::vector<std::array<unsigned int, 2>>{}
+                             : extract_terms(dictionary, lhsInput);
       if (!rhsInput.empty()) {
-        rhs = extract_terms(pMapping, pSpeciesList, rhsInput);
+        rhs = extract_terms(dictionary, rhsInput);
       } else {
         throw std::invalid_argument("Rhs of a rule may not be empty!");
       }
@@ -188,9 +199,8 @@ public:
       }
       pRules.emplace_back(
           std::make_shared<RewriteSystem::Rule>(rate, lhs, rhs));
-      line = get_next_line(string, "\n", TrimType::TrimWhiteSpace);
     }
-    return std::make_shared<RewriteSystem>(pMapping, pSpeciesList, pRules);
+    return std::make_shared<RewriteSystem>(std::move(dictionary), pRules);
   }
 
   [[nodiscard]] auto get_reduction_methods() const
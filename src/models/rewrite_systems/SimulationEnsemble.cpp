@@ -0,0 +1,3 @@
+#include "SimulationEnsemble.h"
+
+SimulationEnsemble::~SimulationEnsemble() = default;
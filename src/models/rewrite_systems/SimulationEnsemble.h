@@ -0,0 +1,171 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_SIMULATIONENSEMBLE_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_SIMULATIONENSEMBLE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "../../util/Deadline.h"
+#include "EnsembleStatistics.h"
+#include "StochasticSimulation.h"
+
+// Independent SSA trajectories of one system from one initial state, run in
+// parallel. Trajectory i draws from its own stream seeded by a hash of the
+// ensemble seed and i, and the observed counts are summed up exactly in
+// atomic integer accumulators, so the statistics for a given seed do not
+// depend on the number of threads or the schedule. The sums of squares are
+// 64 bit, i.e. the squared counts of an observable at a time point must sum
+// up to less than 2^63 over all trajectories, e.g. 3 * 10^6 molecules over
+// 10^6 trajectories. run throws std::overflow_error otherwise.
+class SimulationEnsemble {
+private:
+  std::shared_ptr<const MassActionKinetics> kinetics;
+  std::vector<long> initialState;
+  std::vector<double> timePoints;
+  std::vector<unsigned int> observables;
+  uint64_t seed;
+  // number of the next trajectory to start
+  uint64_t started;
+  std::atomic<uint64_t> trajectories;
+  // entry t * observables + o belongs to time point t and observable o
+  std::vector<std::atomic<int64_t>> sums;
+  std::vector<std::atomic<int64_t>> sumsOfSquares;
+  // set once a sum overflowed, the statistics are invalid from then on
+  std::atomic<bool> overflow;
+
+  // Adds the value unless the sum would overflow, returns whether it did
+  static auto checked_add(std::atomic<int64_t> &acc, int64_t value) -> bool {
+    int64_t current = acc.load(std::memory_order_relaxed);
+    int64_t next = 0;
+    do {
+      if (__builtin_add_overflow(current, value, &next)) {
+        return false;
+      }
+    } while (!acc.compare_exchange_weak(current, next,
+                                        std::memory_order_relaxed));
+    return true;
+  }
+
+public:
+  // Observes all species if no observables are given
+  SimulationEnsemble(std::shared_ptr<const MassActionKinetics> mKinetics,
+                     std::vector<long> mInitialState,
+                     std::vector<double> mTimePoints,
+                     std::vector<unsigned int> mObservables = {},
+                     uint64_t mSeed = 0)
+      : kinetics(std::move(mKinetics)),
+        initialState(std::move(mInitialState)),
+        timePoints(std::move(mTimePoints)),
+        observables(std::move(mObservables)), seed(mSeed), started(0),
+        trajectories(0), sums(), sumsOfSquares(), overflow(false) {
+    if (this->initialState.size() != this->kinetics->species()) {
+      throw std::invalid_argument(
+          "The initial state needs one count per species!");
+    }
+    if (!std::is_sorted(this->timePoints.begin(), this->timePoints.end()) ||
+        (!this->timePoints.empty() && this->timePoints.front() < 0.0)) {
+      throw std::invalid_argument(
+          "The time points have to be non-negative and ascending!");
+    }
+    if (this->observables.empty()) {
+      for (unsigned int s = 0; s < this->kinetics->species(); s++) {
+        this->observables.push_back(s);
+      }
+    }
+    for (const auto &o : this->observables) {
+      if (o >= this->kinetics->species()) {
+        throw std::invalid_argument("Observable is not a species!");
+      }
+    }
+    size_t entries = this->timePoints.size() * this->observables.size();
+    this->sums = std::vector<std::atomic<int64_t>>(entries);
+    this->sumsOfSquares = std::vector<std::atomic<int64_t>>(entries);
+  }
+
+  ~SimulationEnsemble();
+
+  // SplitMix64 of the ensemble seed and the trajectory number
+  [[nodiscard]] static auto stream_seed(uint64_t ensembleSeed,
+                                        uint64_t trajectory) -> uint64_t {
+    uint64_t z = ensembleSeed + (trajectory + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27U)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31U);
+  }
+
+  // Adds count trajectories, numbered consecutively over all runs.
+  // Trajectories cut short by the deadline are not recorded.
+  void run(uint64_t count, const Deadline &deadline = Deadline()) {
+    uint64_t first = this->started;
+    auto n = static_cast<long>(count);
+    this->started += count;
+#pragma omp parallel default(none) num_threads(THREADS) if (!TEST)             \
+    shared(first, n, deadline)
+    {
+      StochasticSimulation ssa(this->kinetics, this->initialState);
+#pragma omp for schedule(dynamic)
+      for (long i = 0; i < n; i++) {
+        if (deadline.expired()) {
+          continue;
+        }
+        ssa.seed(stream_seed(this->seed, first + static_cast<uint64_t>(i)));
+        ssa.reset(this->initialState);
+        this->simulate(ssa, deadline);
+      }
+    }
+    this->check_overflow();
+  }
+
+  [[nodiscard]] auto get_statistics() const -> EnsembleStatistics {
+    this->check_overflow();
+    std::vector<int64_t> s(this->sums.size());
+    std::vector<int64_t> sq(this->sums.size());
+    for (size_t i = 0; i < s.size(); i++) {
+      s[i] = this->sums[i].load();
+      sq[i] = this->sumsOfSquares[i].load();
+    }
+    return {this->timePoints, this->observables, this->trajectories.load(),
+            std::move(s), std::move(sq)};
+  }
+
+  [[nodiscard]] inline auto get_trajectories() const -> uint64_t {
+    return this->trajectories.load();
+  }
+
+private:
+  void check_overflow() const {
+    if (this->overflow.load()) {
+      throw std::overflow_error(
+          "The sums of the ensemble exceed 64 bits, run fewer trajectories!");
+    }
+  }
+
+  void simulate(StochasticSimulation &ssa, const Deadline &deadline) {
+    std::vector<long> samples(this->sums.size());
+    size_t idx = 0;
+    for (const auto &t : this->timePoints) {
+      ssa.run(t, deadline);
+      if (deadline.expired()) {
+        return;
+      }
+      for (const auto &o : this->observables) {
+        samples[idx++] = ssa.get_state()[o];
+      }
+    }
+    int64_t square = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+      if (__builtin_mul_overflow(samples[i], samples[i], &square) ||
+          !checked_add(this->sums[i], samples[i]) ||
+          !checked_add(this->sumsOfSquares[i], square)) {
+        // exceptions must not leave the parallel region, run throws
+        this->overflow.store(true);
+      }
+    }
+    this->trajectories.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_SIMULATIONENSEMBLE_H
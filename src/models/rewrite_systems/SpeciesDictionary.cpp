@@ -0,0 +1,3 @@
+#include "SpeciesDictionary.h"
+
+SpeciesDictionary::~SpeciesDictionary() = default;
@@ -0,0 +1,175 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_SPECIESDICTIONARY_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_SPECIESDICTIONARY_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../util/Hashing.h"
+
+// Interned atoms and species of a rewrite system. A species is a multiset of
+// atoms, stored as the vector of its atom counts. Atom names, composition
+// vectors and species names are hashed to their ids, so lookups take
+// constant time instead of a scan over all species.
+class SpeciesDictionary {
+private:
+  // lets the maps below be searched by string views without a copy
+  struct NameHash {
+    using is_transparent = void;
+    auto operator()(std::string_view name) const noexcept -> size_t {
+      return std::hash<std::string_view>{}(name);
+    }
+  };
+  using NameMap =
+      std::unordered_map<std::string, unsigned int, NameHash, std::equal_to<>>;
+
+  std::vector<std::string> atoms;
+  NameMap atomIds;
+  std::vector<std::vector<unsigned int>> species;
+  // canonical names, atoms in order of their ids followed by their counts
+  std::vector<std::string> names;
+  // ids of the species by hash of their composition
+  std::unordered_map<uint64_t, std::vector<unsigned int>> compositionIds;
+  // canonical names and any other spelling registered by add_name
+  NameMap nameIds;
+
+  static auto hash(const std::vector<unsigned int> &composition) -> uint64_t {
+    uint64_t h = HASH_SEED;
+    for (size_t i = 0; i < composition.size(); i++) {
+      if (composition[i] != 0) {
+        hash_combine(h, (static_cast<uint64_t>(i) << 32U) | composition[i]);
+      }
+    }
+    return h;
+  }
+
+  [[nodiscard]] auto lookup(const std::vector<unsigned int> &composition,
+                            uint64_t h) const -> long {
+    auto it = this->compositionIds.find(h);
+    if (it == this->compositionIds.end()) {
+      return -1;
+    }
+    for (const auto &id : it->second) {
+      if (this->species[id] == composition) {
+        return id;
+      }
+    }
+    return -1;
+  }
+
+public:
+  SpeciesDictionary()
+      : atoms({}), atomIds({}), species({}), names({}), compositionIds({}),
+        nameIds({}) {}
+
+  // Keeps the given ids, hence atoms and species have to be distinct
+  SpeciesDictionary(const std::vector<std::string> &mAtoms,
+                    const std::vector<std::vector<unsigned int>> &mSpecies)
+      : SpeciesDictionary() {
+    // an item is a duplicate iff interning it does not add an id
+    for (const auto &atom : mAtoms) {
+      size_t before = this->atoms.size();
+      if (this->intern_atom(atom) != before) {
+        throw std::invalid_argument("Duplicate atom " + atom + "!");
+      }
+    }
+    for (const auto &composition : mSpecies) {
+      size_t before = this->species.size();
+      if (this->intern_species(composition) != before) {
+        throw std::invalid_argument("Duplicate species " +
+                                    name_of(this->atoms, composition) + "!");
+      }
+    }
+  }
+
+  ~SpeciesDictionary();
+
+  // Id of the atom, adding it if it is new
+  auto intern_atom(std::string_view atom) -> unsigned int {
+    auto it = this->atomIds.find(atom);
+    if (it != this->atomIds.end()) {
+      return it->second;
+    }
+    auto id = static_cast<unsigned int>(this->atoms.size());
+    this->atoms.emplace_back(atom);
+    this->atomIds.emplace(this->atoms.back(), id);
+    return id;
+  }
+
+  [[nodiscard]] auto find_atom(std::string_view atom) const -> long {
+    auto it = this->atomIds.find(atom);
+    return it == this->atomIds.end() ? -1 : static_cast<long>(it->second);
+  }
+
+  // Id of the species, adding it if it is new
+  auto intern_species(const std::vector<unsigned int> &composition)
+      -> unsigned int {
+    uint64_t h = hash(composition);
+    long id = lookup(composition, h);
+    if (id < 0) {
+      id = static_cast<long>(this->species.size());
+      this->species.push_back(composition);
+      this->names.push_back(name_of(this->atoms, composition));
+      this->nameIds.try_emplace(this->names.back(),
+                                static_cast<unsigned int>(id));
+      this->compositionIds[h].push_back(static_cast<unsigned int>(id));
+    }
+    return static_cast<unsigned int>(id);
+  }
+
+  // Registers another spelling of a species, e.g. with permuted atoms
+  void add_name(std::string_view name, unsigned int id) {
+    if (this->nameIds.find(name) == this->nameIds.end()) {
+      this->nameIds.emplace(name, id);
+    }
+  }
+
+  [[nodiscard]] auto
+  find_species(const std::vector<unsigned int> &composition) const -> long {
+    return lookup(composition, hash(composition));
+  }
+
+  [[nodiscard]] auto find_species(std::string_view name) const -> long {
+    auto it = this->nameIds.find(name);
+    return it == this->nameIds.end() ? -1 : static_cast<long>(it->second);
+  }
+
+  [[nodiscard]] auto get_atoms() const noexcept
+      -> const std::vector<std::string> & {
+    return this->atoms;
+  }
+
+  [[nodiscard]] auto get_species() const noexcept
+      -> const std::vector<std::vector<unsigned int>> & {
+    return this->species;
+  }
+
+  [[nodiscard]] auto name(size_t id) const -> const std::string & {
+    return this->names[id];
+  }
+
+  [[nodiscard]] auto size() const noexcept -> size_t {
+    return this->species.size();
+  }
+
+  static auto name_of(const std::vector<std::string> &mAtoms,
+                      const std::vector<unsigned int> &composition)
+      -> std::string {
+    std::string res;
+    for (size_t i = 0; i < composition.size(); i++) {
+      if (composition[i] > 0) {
+        res += mAtoms[i];
+        if (composition[i] > 1) {
+          res += std::to_string(composition[i]);
+        }
+      }
+    }
+    return res;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_SPECIESDICTIONARY_H
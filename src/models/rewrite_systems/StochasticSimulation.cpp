@@ -0,0 +1,3 @@
+#include "StochasticSimulation.h"
+
+StochasticSimulation::~StochasticSimulation() = default;
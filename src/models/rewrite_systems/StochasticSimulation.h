@@ -0,0 +1,128 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_STOCHASTICSIMULATION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_STOCHASTICSIMULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "../../util/Deadline.h"
+#include "../../util/SumTree.h"
+#include "MassActionKinetics.h"
+
+// Gillespie's direct method over the mass-action kinetics of a rewrite
+// system. The propensities are kept in a sum tree, so drawing the next rule
+// takes O(log R), and after a firing only the propensities of the rules in
+// its dependency graph are recomputed.
+class StochasticSimulation {
+private:
+  std::shared_ptr<const MassActionKinetics> kinetics;
+  std::vector<long> state;
+  double time;
+  unsigned long steps;
+  SumTree propensities;
+  std::mt19937_64 rng;
+
+public:
+  StochasticSimulation(std::shared_ptr<const MassActionKinetics> mKinetics,
+                       std::vector<long> initialState, unsigned long mSeed = 0)
+      : kinetics(std::move(mKinetics)), state({}), time(0.0), steps(0),
+        propensities(this->kinetics->rules()), rng(mSeed) {
+    this->reset(std::move(initialState));
+  }
+
+  ~StochasticSimulation();
+
+  // Restarts at time 0 from the given state, the random stream continues
+  void reset(std::vector<long> initialState) {
+    if (initialState.size() != this->kinetics->species()) {
+      throw std::invalid_argument(
+          "The initial state needs one count per species!");
+    }
+    for (const auto &count : initialState) {
+      if (count < 0) {
+        throw std::invalid_argument("Species counts may not be negative!");
+      }
+    }
+    this->state = std::move(initialState);
+    this->time = 0.0;
+    this->steps = 0;
+    std::vector<double> weights(this->kinetics->rules());
+    for (size_t i = 0; i < weights.size(); i++) {
+      weights[i] = this->kinetics->propensity(i, this->state);
+    }
+    this->propensities.assign(weights);
+  }
+
+  void seed(unsigned long mSeed) { this->rng.seed(mSeed); }
+
+  [[nodiscard]] inline auto get_state() const -> const std::vector<long> & {
+    return this->state;
+  }
+
+  [[nodiscard]] inline auto get_time() const -> double { return this->time; }
+
+  [[nodiscard]] inline auto get_steps() const -> unsigned long {
+    return this->steps;
+  }
+
+  [[nodiscard]] inline auto get_kinetics() const
+      -> const std::shared_ptr<const MassActionKinetics> & {
+    return this->kinetics;
+  }
+
+  // Time of the next firing and the rule to fire, or infinity and -1 if no
+  // rule can fire. Does not change the state.
+  auto next_event() -> std::pair<double, long> {
+    double total = this->propensities.total();
+    if (total <= 0.0) {
+      return {std::numeric_limits<double>::infinity(), -1};
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double tau = -std::log(1.0 - uniform(this->rng)) / total;
+    size_t rule = this->propensities.find(uniform(this->rng) * total);
+    return {this->time + tau, static_cast<long>(rule)};
+  }
+
+  // Fires the rule at the given time and updates the dependent propensities
+  void fire(size_t rule, double at) {
+    this->kinetics->fire(rule, this->state);
+    for (const auto &dependent : this->kinetics->dependents_of(rule)) {
+      this->propensities.set(dependent,
+                             this->kinetics->propensity(dependent, this->state));
+    }
+    this->time = at;
+    this->steps++;
+  }
+
+  // Advances by one firing, returns the fired rule or -1 if no rule can fire
+  auto step() -> long {
+    auto [at, rule] = this->next_event();
+    if (rule >= 0) {
+      this->fire(static_cast<size_t>(rule), at);
+    }
+    return rule;
+  }
+
+  // Simulates until the given time, the state is the one at that time. Stops
+  // early if the deadline expires.
+  void run(double until, const Deadline &deadline = Deadline()) {
+    const unsigned long checkInterval = 4096;
+    while (true) {
+      auto [at, rule] = this->next_event();
+      if (rule < 0 || at > until) {
+        this->time = std::max(this->time, until);
+        return;
+      }
+      this->fire(static_cast<size_t>(rule), at);
+      if (this->steps % checkInterval == 0 && deadline.expired()) {
+        return;
+      }
+    }
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_STOCHASTICSIMULATION_H
@@ -0,0 +1,3 @@
+#include "Stoichiometry.h"
+
+Stoichiometry::~Stoichiometry() = default;
@@ -0,0 +1,96 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_STOICHIOMETRY_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_STOICHIOMETRY_H
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <vector>
+
+#include "../../util/DefsConstants.h"
+
+// Rules x species stoichiometry matrix in compressed row storage. The terms
+// of rule i are the entries offsets[i] ... offsets[i + 1] - 1 of the species
+// and factor arrays, in the order they were appended.
+class Stoichiometry {
+private:
+  std::vector<size_t> offsets;
+  std::vector<unsigned int> species;
+  std::vector<unsigned int> factors;
+
+public:
+  Stoichiometry() : offsets({0}), species({}), factors({}) {}
+
+  ~Stoichiometry();
+
+  void reserve(size_t rules, size_t terms) {
+    this->offsets.reserve(rules + 1);
+    this->species.reserve(terms);
+    this->factors.reserve(terms);
+  }
+
+  // Adds a row of {factor, species} terms
+  void append(std::span<const std::array<unsigned int, 2>> terms) {
+    for (const auto &term : terms) {
+      this->factors.push_back(term[0]);
+      this->species.push_back(term[1]);
+    }
+    this->offsets.push_back(this->species.size());
+  }
+
+  [[nodiscard]] inline auto rules() const -> size_t {
+    return this->offsets.size() - 1;
+  }
+
+  [[nodiscard]] inline auto size(size_t rule) const -> size_t {
+    return this->offsets[rule + 1] - this->offsets[rule];
+  }
+
+  [[nodiscard]] inline auto species_of(size_t rule) const
+      -> std::span<const unsigned int> {
+    return {this->species.data() + this->offsets[rule], size(rule)};
+  }
+
+  [[nodiscard]] inline auto factors_of(size_t rule) const
+      -> std::span<const unsigned int> {
+    return {this->factors.data() + this->offsets[rule], size(rule)};
+  }
+
+  // Factor of the first term of the species in the rule, 0 if there is none
+  [[nodiscard]] inline auto factor(size_t rule, unsigned int s) const
+      -> unsigned int {
+    for (size_t k = this->offsets[rule]; k < this->offsets[rule + 1]; k++) {
+      if (this->species[k] == s) {
+        return this->factors[k];
+      }
+    }
+    return 0;
+  }
+
+  // (sum of the factors)! / (product of the factors!) of the row, i.e. the
+  // number of orderings of its terms, 0 if the sum exceeds 20
+  [[nodiscard]] inline auto multinomial(size_t rule) const -> unsigned long {
+    unsigned int upper = 0;
+    unsigned long long int lower = 1;
+    for (const auto &factor : this->factors_of(rule)) {
+      upper += factor;
+      lower *= FACTORIALS[std::min(factor, 20u)];
+    }
+    if (upper > 20) {
+      return 0;
+    }
+    return FACTORIALS[upper] / lower;
+  }
+
+  // The row as {factor, species} terms
+  [[nodiscard]] auto terms(size_t rule) const
+      -> std::vector<std::array<unsigned int, 2>> {
+    std::vector<std::array<unsigned int, 2>> result(size(rule));
+    for (size_t k = 0; k < result.size(); k++) {
+      result[k] = {this->factors[this->offsets[rule] + k],
+                   this->species[this->offsets[rule] + k]};
+    }
+    return result;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_STOICHIOMETRY_H
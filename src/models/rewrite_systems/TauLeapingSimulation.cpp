@@ -0,0 +1,3 @@
+#include "TauLeapingSimulation.h"
+
+TauLeapingSimulation::~TauLeapingSimulation() = default;
@@ -0,0 +1,329 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_TAULEAPINGSIMULATION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_TAULEAPINGSIMULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "../../util/Deadline.h"
+#include "../../util/SumTree.h"
+#include "MassActionKinetics.h"
+
+// Adaptive explicit tau-leaping (Cao, Gillespie, Petzold 2006). In each leap
+// every non-critical rule fires a Poisson distributed number of times with
+// mean propensity * tau, where tau bounds the expected relative change of
+// every reagent count by epsilon. Rules that could exhaust one of their
+// reagents within criticalThreshold firings are critical and fire at most
+// once per leap, as in the direct method. If the selected tau is too small
+// to pay off, a burst of exact direct-method steps is taken instead.
+class TauLeapingSimulation {
+private:
+  // leaps below EXACT_FACTOR / a0 are replaced by EXACT_STEPS exact steps
+  static constexpr double EXACT_FACTOR = 10.0;
+  static constexpr unsigned int EXACT_STEPS = 100;
+
+  std::shared_ptr<const MassActionKinetics> kinetics;
+  double epsilon;
+  long criticalThreshold;
+  std::vector<long> state;
+  double time;
+  unsigned long steps;
+  SumTree propensities;
+  std::mt19937_64 rng;
+
+  // highest order of the rules a species is a reagent of, and its highest
+  // stoichiometry among those rules, 0 if it is no reagent
+  std::vector<unsigned int> highestOrder;
+  std::vector<unsigned int> highestFactor;
+  // per step buffers
+  std::vector<bool> critical;
+  std::vector<long> fires;
+  std::vector<double> mu;
+  std::vector<double> sigma;
+  std::vector<long> tentative;
+
+  void init_orders() {
+    const Stoichiometry &lhs = this->kinetics->get_reagents();
+    this->highestOrder = std::vector(this->kinetics->species(), 0u);
+    this->highestFactor = std::vector(this->kinetics->species(), 0u);
+    for (size_t j = 0; j < lhs.rules(); j++) {
+      unsigned int order = 0;
+      for (const auto &factor : lhs.factors_of(j)) {
+        order += factor;
+      }
+      auto reagents = lhs.species_of(j);
+      auto factors = lhs.factors_of(j);
+      for (size_t k = 0; k < reagents.size(); k++) {
+        unsigned int s = reagents[k];
+        if (order > this->highestOrder[s]) {
+          this->highestOrder[s] = order;
+          this->highestFactor[s] = factors[k];
+        } else if (order == this->highestOrder[s]) {
+          this->highestFactor[s] = std::max(this->highestFactor[s], factors[k]);
+        }
+      }
+    }
+  }
+
+  // g_i of Cao et al., such that a relative change of x_i by epsilon / g_i
+  // changes the propensities by at most epsilon
+  [[nodiscard]] auto g(size_t s) const -> double {
+    auto x = static_cast<double>(this->state[s]);
+    unsigned int order = this->highestOrder[s];
+    unsigned int factor = this->highestFactor[s];
+    if (factor <= 1 || x <= static_cast<double>(factor)) {
+      return static_cast<double>(order);
+    }
+    if (order == 2) {
+      return 2.0 + 1.0 / (x - 1.0);
+    }
+    if (order == 3 && factor == 2) {
+      return 1.5 * (2.0 + 1.0 / (x - 1.0));
+    }
+    if (order == 3) {
+      return 3.0 + 1.0 / (x - 1.0) + 2.0 / (x - 2.0);
+    }
+    // upper bound of the relative change of x^(factor) for higher orders
+    double bound = 0.0;
+    for (unsigned int i = 0; i < factor; i++) {
+      bound += 1.0 / (1.0 - static_cast<double>(i) / x);
+    }
+    return std::max(static_cast<double>(order), bound);
+  }
+
+  // Fewest firings of the rule that exhaust one of its net consumed species
+  [[nodiscard]] auto firings_left(size_t rule) const -> long {
+    long result = std::numeric_limits<long>::max();
+    auto spec = this->kinetics->changed_species(rule);
+    auto delta = this->kinetics->changes_of(rule);
+    for (size_t k = 0; k < spec.size(); k++) {
+      if (delta[k] < 0) {
+        result = std::min(result, this->state[spec[k]] / -delta[k]);
+      }
+    }
+    return result;
+  }
+
+  // Largest leap keeping the expected relative change of every reagent, and
+  // its standard deviation, below epsilon / g_i
+  [[nodiscard]] auto select_tau() -> double {
+    std::fill(this->mu.begin(), this->mu.end(), 0.0);
+    std::fill(this->sigma.begin(), this->sigma.end(), 0.0);
+    for (size_t j = 0; j < this->kinetics->rules(); j++) {
+      double a = this->propensities.get(j);
+      if (this->critical[j] || a <= 0.0) {
+        continue;
+      }
+      auto spec = this->kinetics->changed_species(j);
+      auto delta = this->kinetics->changes_of(j);
+      for (size_t k = 0; k < spec.size(); k++) {
+        auto d = static_cast<double>(delta[k]);
+        this->mu[spec[k]] += d * a;
+        this->sigma[spec[k]] += d * d * a;
+      }
+    }
+    double tau = std::numeric_limits<double>::infinity();
+    for (size_t s = 0; s < this->state.size(); s++) {
+      if (this->highestOrder[s] == 0) {
+        continue;
+      }
+      double bound = std::max(
+          this->epsilon * static_cast<double>(this->state[s]) / g(s), 1.0);
+      if (this->mu[s] != 0.0) {
+        tau = std::min(tau, bound / std::fabs(this->mu[s]));
+      }
+      if (this->sigma[s] > 0.0) {
+        tau = std::min(tau, bound * bound / this->sigma[s]);
+      }
+    }
+    return tau;
+  }
+
+  // Critical rule covering the target in the prefix sums of the critical
+  // propensities
+  [[nodiscard]] auto draw_critical(double target) const -> size_t {
+    size_t last = 0;
+    for (size_t j = 0; j < this->critical.size(); j++) {
+      if (!this->critical[j]) {
+        continue;
+      }
+      last = j;
+      if (target < this->propensities.get(j)) {
+        return j;
+      }
+      target -= this->propensities.get(j);
+    }
+    return last;
+  }
+
+  void update_propensities() {
+    std::vector<double> weights(this->kinetics->rules());
+    for (size_t j = 0; j < weights.size(); j++) {
+      weights[j] = this->kinetics->propensity(j, this->state);
+    }
+    this->propensities.assign(weights);
+  }
+
+  // Direct-method steps up to the given time, false if no rule can fire
+  auto exact_steps(double until) -> bool {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (unsigned int n = 0; n < EXACT_STEPS; n++) {
+      double total = this->propensities.total();
+      if (total <= 0.0) {
+        return false;
+      }
+      double at = this->time - std::log(1.0 - uniform(this->rng)) / total;
+      if (at > until) {
+        this->time = until;
+        return true;
+      }
+      size_t rule = this->propensities.find(uniform(this->rng) * total);
+      this->kinetics->fire(rule, this->state);
+      for (const auto &dependent : this->kinetics->dependents_of(rule)) {
+        this->propensities.set(
+            dependent, this->kinetics->propensity(dependent, this->state));
+      }
+      this->time = at;
+      this->steps++;
+    }
+    return true;
+  }
+
+public:
+  TauLeapingSimulation(std::shared_ptr<const MassActionKinetics> mKinetics,
+                       std::vector<long> initialState, unsigned long mSeed = 0,
+                       double mEpsilon = 0.03, long mCriticalThreshold = 10)
+      : kinetics(std::move(mKinetics)), epsilon(mEpsilon),
+        criticalThreshold(mCriticalThreshold), state({}), time(0.0), steps(0),
+        propensities(this->kinetics->rules()), rng(mSeed), highestOrder({}),
+        highestFactor({}), critical(this->kinetics->rules(), false),
+        fires(this->kinetics->rules(), 0), mu(this->kinetics->species(), 0.0),
+        sigma(this->kinetics->species(), 0.0), tentative({}) {
+    if (this->epsilon <= 0.0 || this->epsilon >= 1.0) {
+      throw std::invalid_argument("Epsilon has to be in (0, 1)!");
+    }
+    this->init_orders();
+    this->reset(std::move(initialState));
+  }
+
+  ~TauLeapingSimulation();
+
+  // Restarts at time 0 from the given state, the random stream continues
+  void reset(std::vector<long> initialState) {
+    if (initialState.size() != this->kinetics->species()) {
+      throw std::invalid_argument(
+          "The initial state needs one count per species!");
+    }
+    for (const auto &count : initialState) {
+      if (count < 0) {
+        throw std::invalid_argument("Species counts may not be negative!");
+      }
+    }
+    this->state = std::move(initialState);
+    this->time = 0.0;
+    this->steps = 0;
+    this->update_propensities();
+  }
+
+  void seed(unsigned long mSeed) { this->rng.seed(mSeed); }
+
+  [[nodiscard]] inline auto get_state() const -> const std::vector<long> & {
+    return this->state;
+  }
+
+  [[nodiscard]] inline auto get_time() const -> double { return this->time; }
+
+  // Number of leaps and exact steps taken
+  [[nodiscard]] inline auto get_steps() const -> unsigned long {
+    return this->steps;
+  }
+
+  // One leap or a burst of exact steps, not beyond the given time. Returns
+  // false if no rule can fire.
+  auto leap(double until) -> bool {
+    double total = this->propensities.total();
+    if (total <= 0.0) {
+      return false;
+    }
+    for (size_t j = 0; j < this->kinetics->rules(); j++) {
+      this->critical[j] = this->propensities.get(j) > 0.0 &&
+                          this->firings_left(j) < this->criticalThreshold;
+    }
+    double tau1 = this->select_tau();
+    if (tau1 < EXACT_FACTOR / total) {
+      bool fired = this->exact_steps(until);
+      this->update_propensities();
+      return fired;
+    }
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double criticalTotal = 0.0;
+    for (size_t j = 0; j < this->kinetics->rules(); j++) {
+      if (this->critical[j]) {
+        criticalTotal += this->propensities.get(j);
+      }
+    }
+    while (true) {
+      double tau2 = criticalTotal > 0.0
+                        ? -std::log(1.0 - uniform(this->rng)) / criticalTotal
+                        : std::numeric_limits<double>::infinity();
+      double tau = std::min({tau1, tau2, until - this->time});
+      bool criticalFires = tau2 <= tau;
+      bool reachesEnd = until - this->time <= std::min(tau1, tau2);
+
+      std::fill(this->fires.begin(), this->fires.end(), 0);
+      for (size_t j = 0; j < this->kinetics->rules(); j++) {
+        double a = this->propensities.get(j);
+        if (!this->critical[j] && a > 0.0) {
+          std::poisson_distribution<long> poisson(a * tau);
+          this->fires[j] = poisson(this->rng);
+        }
+      }
+      if (criticalFires) {
+        this->fires[this->draw_critical(uniform(this->rng) * criticalTotal)] =
+            1;
+      }
+
+      this->tentative = this->state;
+      bool negative = false;
+      for (size_t j = 0; j < this->fires.size(); j++) {
+        if (this->fires[j] > 0) {
+          this->kinetics->fire(j, this->tentative, this->fires[j]);
+        }
+      }
+      for (const auto &count : this->tentative) {
+        negative = negative || count < 0;
+      }
+      if (negative) {
+        tau1 = tau / 2.0;
+        continue;
+      }
+      std::swap(this->state, this->tentative);
+      this->time = reachesEnd ? until : this->time + tau;
+      this->steps++;
+      this->update_propensities();
+      return true;
+    }
+  }
+
+  // Simulates until the given time, the state is the one at that time. Stops
+  // early if the deadline expires.
+  void run(double until, const Deadline &deadline = Deadline()) {
+    const unsigned long checkInterval = 64;
+    for (unsigned long n = 1; this->time < until; n++) {
+      if (!this->leap(until)) {
+        this->time = until;
+        return;
+      }
+      if (n % checkInterval == 0 && deadline.expired()) {
+        return;
+      }
+    }
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_TAULEAPINGSIMULATION_H
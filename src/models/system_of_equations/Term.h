@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <sstream>
+#include <string_view>
 #include <vector>
 
 #include "../../util/DefsConstants.h"
@@ -61,10 +62,11 @@ public:
   }
 
   static inline auto extract_term(const std::vector<std::string> &pMapping,
-                                  std::string &input) -> std::shared_ptr<Term> {
+                                  std::string_view input)
+      -> std::shared_ptr<Term> {
 
     bool seenPrevEntity = false;
-    std::string prevEntityStr;
+    std::string_view prevEntityStr;
     unsigned int prevEntityInt = 0;
     unsigned char next = 0;
     unsigned long int factor = 1;
@@ -90,6 +92,8 @@ public:
       } else if ((std::isdigit(next) != 0) && seenPrevEntity) {
         seenPrevEntity = false;
         word[prevEntityInt] = extract_number<unsigned int>(input);
+      } else {
+        input.remove_prefix(1);
       }
       if (seenPrevEntity && input.empty()) {
         seenPrevEntity = false;
@@ -100,17 +104,12 @@ public:
   }
 
   static inline auto extract_terms(const std::vector<std::string> &pMapping,
-                                   std::string &input)
+                                   std::string_view input)
       -> std::vector<std::shared_ptr<Term>> {
     std::vector<std::shared_ptr<Term>> result = {};
-    std::string term;
-    size_t pos = 0;
-    size_t prev = 0;
-    while (pos != std::string::npos) {
-      pos = input.find('+', prev);
-      term = input.substr(prev, pos - prev);
-      result.emplace_back(extract_term(pMapping, term));
-      prev = pos + strlen("+");
+    ParseCursor terms(input);
+    while (!terms.at_end()) {
+      result.emplace_back(extract_term(pMapping, terms.next('+')));
     }
     return result;
   }
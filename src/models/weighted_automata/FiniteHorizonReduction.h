@@ -0,0 +1,185 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_FINITEHORIZONREDUCTION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_FINITEHORIZONREDUCTION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../ReductionMethodInterface.h"
+#include "KieferSchuetzenbergerReduction.h"
+#include "WeightedAutomaton.h"
+
+// Reduction that only preserves the weights of words up to length k.
+// The forward basis spans V_k = span{alpha * mu_w : |w| <= k}; it is built
+// level by level, multiplying only the vectors added in the previous level,
+// and stops after k levels or as soon as a level adds nothing. Projecting
+// onto an orthonormal basis Q of V_k is exact for every alpha * mu_u with
+// |u| <= k, hence alpha' = alpha Q^T, mu' = Q mu Q^T, eta' = Q eta agrees
+// with the original automaton on all words of length at most k. The
+// backward direction works the same on the columns.
+template <Matrix M>
+class FiniteHorizonReduction : public ReductionMethodInterface {
+private:
+  uint horizon;
+
+public:
+  explicit FiniteHorizonReduction(uint mHorizon);
+
+  ~FiniteHorizonReduction() override;
+
+  [[nodiscard]] inline auto get_name() const -> std::string override {
+    return "Finite Horizon Reduction";
+  }
+
+  [[nodiscard]] inline auto get_horizon() const -> uint {
+    return this->horizon;
+  }
+
+  using ReductionMethodInterface::reduce;
+
+  [[nodiscard]] inline auto
+  reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+         const Deadline &deadline)
+      -> std::shared_ptr<RepresentationInterface> override {
+    return reduce(waInstance, this->horizon, deadline);
+  }
+
+  static auto reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+                     uint k, const Deadline &deadline = Deadline())
+      -> std::shared_ptr<RepresentationInterface> {
+    auto WA = std::static_pointer_cast<WeightedAutomaton<M>>(waInstance);
+    std::shared_ptr<WeightedAutomaton<M>> minWA = forward_reduction(WA, k);
+    if (deadline.expired()) {
+      return minWA;
+    }
+    minWA = backward_reduction(minWA, k);
+    return minWA;
+  }
+
+  static auto forward_reduction(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                                uint k)
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    MatDenD Q = forward_basis(WA, k);
+    MatDenD Qt = Q.transpose();
+
+    std::vector<std::shared_ptr<M>> muArrow(WA->get_mu().size());
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(Q, Qt, muArrow, WA)
+    for (size_t i = 0; i < WA->get_mu().size(); i++) {
+      muArrow[i] = KieferSchuetzenbergerReduction<M>::convert_dense_M(
+          (Q * (*(WA->get_mu()[i]) * Qt).eval()).eval());
+    }
+    return std::make_shared<WeightedAutomaton<M>>(
+        static_cast<uint>(Q.rows()), WA->get_number_input_characters(),
+        KieferSchuetzenbergerReduction<M>::convert_dense_M(
+            (*(WA->get_alpha()) * Qt).eval()),
+        muArrow,
+        KieferSchuetzenbergerReduction<M>::convert_dense_M(
+            (Q * *(WA->get_eta())).eval()));
+  }
+
+  static auto
+  backward_reduction(const std::shared_ptr<WeightedAutomaton<M>> &WA, uint k)
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    MatDenD Q = backward_basis(WA, k);
+    MatDenD Qt = Q.transpose();
+
+    std::vector<std::shared_ptr<M>> muArrow(WA->get_mu().size());
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(Q, Qt, muArrow, WA)
+    for (size_t i = 0; i < WA->get_mu().size(); i++) {
+      muArrow[i] = KieferSchuetzenbergerReduction<M>::convert_dense_M(
+          (Qt * (*(WA->get_mu()[i]) * Q).eval()).eval());
+    }
+    return std::make_shared<WeightedAutomaton<M>>(
+        static_cast<uint>(Q.cols()), WA->get_number_input_characters(),
+        KieferSchuetzenbergerReduction<M>::convert_dense_M(
+            (*(WA->get_alpha()) * Q).eval()),
+        muArrow,
+        KieferSchuetzenbergerReduction<M>::convert_dense_M(
+            (Qt * *(WA->get_eta())).eval()));
+  }
+
+  // Orthonormal rows spanning alpha * mu_w for all |w| <= k
+  static auto forward_basis(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                            uint k) -> MatDenD {
+    std::vector<Eigen::RowVectorXd> basis = {};
+    std::vector<Eigen::RowVectorXd> frontier = {};
+    add_if_independent(MatDenD(*(WA->get_alpha())).row(0), basis, frontier);
+
+    for (uint level = 0; level < k && !frontier.empty(); level++) {
+      std::vector<Eigen::RowVectorXd> previous = frontier;
+      frontier = {};
+      for (const auto &v : previous) {
+        for (const auto &mu : WA->get_mu()) {
+          add_if_independent((v * *mu).eval(), basis, frontier);
+        }
+      }
+    }
+    MatDenD Q(static_cast<long>(basis.size()), WA->get_states());
+    for (size_t i = 0; i < basis.size(); i++) {
+      Q.row(static_cast<long>(i)) = basis[i];
+    }
+    return Q;
+  }
+
+  // Orthonormal columns spanning mu_w * eta for all |w| <= k
+  static auto backward_basis(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                             uint k) -> MatDenD {
+    std::vector<Eigen::RowVectorXd> basis = {};
+    std::vector<Eigen::RowVectorXd> frontier = {};
+    add_if_independent(MatDenD(*(WA->get_eta())).col(0).transpose(), basis,
+                       frontier);
+
+    for (uint level = 0; level < k && !frontier.empty(); level++) {
+      std::vector<Eigen::RowVectorXd> previous = frontier;
+      frontier = {};
+      for (const auto &v : previous) {
+        for (const auto &mu : WA->get_mu()) {
+          add_if_independent((*mu * v.transpose()).eval().transpose(), basis,
+                             frontier);
+        }
+      }
+    }
+    MatDenD Q(WA->get_states(), static_cast<long>(basis.size()));
+    for (size_t i = 0; i < basis.size(); i++) {
+      Q.col(static_cast<long>(i)) = basis[i].transpose();
+    }
+    return Q;
+  }
+
+  // Gram-Schmidt step with re-orthogonalization: appends the normalized
+  // residual of the candidate to the basis and the frontier if it is not
+  // (numerically) contained in the span of the basis
+  static void add_if_independent(const Eigen::RowVectorXd &candidate,
+                                 std::vector<Eigen::RowVectorXd> &basis,
+                                 std::vector<Eigen::RowVectorXd> &frontier) {
+    const double tolerance = 1e-10;
+    double norm = candidate.norm();
+    if (norm == 0.0) {
+      return;
+    }
+    Eigen::RowVectorXd residual = candidate;
+    for (int pass = 0; pass < 2; pass++) {
+      for (const auto &q : basis) {
+        residual -= residual.dot(q) * q;
+      }
+    }
+    double residualNorm = residual.norm();
+    if (residualNorm <= tolerance * norm) {
+      return;
+    }
+    residual /= residualNorm;
+    basis.push_back(residual);
+    frontier.push_back(residual);
+  }
+};
+
+template <Matrix M>
+FiniteHorizonReduction<M>::FiniteHorizonReduction(uint mHorizon)
+    : horizon(mHorizon) {}
+
+template <Matrix M>
+FiniteHorizonReduction<M>::~FiniteHorizonReduction() = default;
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_FINITEHORIZONREDUCTION_H
@@ -8,10 +8,15 @@
 
 #include "../../util/FloatingPointCompare.h"
 #include "../ReductionMethodInterface.h"
+#include "ReductionCertificate.h"
 #include "WeightedAutomaton.h"
 
 template <Matrix M>
 class KieferSchuetzenbergerReduction : public ReductionMethodInterface {
+private:
+  // if set, a certificate of each reduction is written to this file
+  std::string certificatePath;
+
 public:
   KieferSchuetzenbergerReduction();
 
@@ -24,30 +29,100 @@ public:
     return "Random Basis Schützenberger Reduction";
   }
 
+  inline void set_certificate_path(const std::string &path) {
+    this->certificatePath = path;
+  }
+
+  using ReductionMethodInterface::reduce;
+
   [[nodiscard]] inline auto
-  reduce(const std::shared_ptr<RepresentationInterface> &waInstance)
+  reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+         const Deadline &deadline)
       -> std::shared_ptr<RepresentationInterface> override {
-    return reduce(waInstance, DEFAULT_RANDOM_RANGE_FACTOR, false);
+    if (this->certificatePath.empty()) {
+      return reduce(waInstance, DEFAULT_RANDOM_RANGE_FACTOR, false, deadline);
+    }
+    std::shared_ptr<ReductionCertificate<M>> certificate = nullptr;
+    auto result = reduce(waInstance, DEFAULT_RANDOM_RANGE_FACTOR, false,
+                         deadline, &certificate);
+    certificate->write(this->certificatePath);
+    return result;
   }
 
+  // If certificate is given it receives the bases and the intermediate
+  // automaton; stages cut off by the deadline are certified by identities
   static auto reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
-                     uint K, bool seed = false)
-      -> std::shared_ptr<RepresentationInterface> {
+                     uint K, bool seed = false,
+                     const Deadline &deadline = Deadline(),
+                     std::shared_ptr<ReductionCertificate<M>> *certificate =
+                         nullptr) -> std::shared_ptr<RepresentationInterface> {
     auto WA = std::static_pointer_cast<WeightedAutomaton<M>>(waInstance);
-    std::vector<MatSpDPtr> randomVectors = generate_random_vectors(WA, K, seed);
-    std::shared_ptr<WeightedAutomaton<M>> minWA =
-        forward_reduction(WA, randomVectors);
-    randomVectors = generate_random_vectors(minWA, K, seed);
-    minWA = backward_reduction(minWA, randomVectors);
+    std::shared_ptr<WeightedAutomaton<M>> forwardWA = WA;
+    std::shared_ptr<WeightedAutomaton<M>> minWA = WA;
+    MatSpD forwardBasis = identity(WA->get_states());
+    MatSpD backwardBasis = identity(WA->get_states());
+    try {
+      std::vector<MatSpDPtr> randomVectors =
+          generate_random_vectors(WA, K, seed);
+      forwardWA = forward_reduction(WA, randomVectors, deadline, &forwardBasis);
+      minWA = forwardWA;
+      backwardBasis = identity(forwardWA->get_states());
+      randomVectors = generate_random_vectors(forwardWA, K, seed);
+      minWA = backward_reduction(forwardWA, randomVectors, deadline,
+                                 &backwardBasis);
+    } catch (const DeadlineExceededException &) {
+      // keep the last completed stage, the input or its forward reduction are
+      // both equivalent to the input
+    }
+    if (certificate != nullptr) {
+      *certificate = std::make_shared<ReductionCertificate<M>>(
+          forwardBasis, forwardWA, backwardBasis);
+    }
     return std::move(minWA);
   }
 
   static auto
   backward_reduction(const std::shared_ptr<WeightedAutomaton<M>> &WA,
-                     const std::vector<MatSpDPtr> &randomVectors)
+                     const std::vector<MatSpDPtr> &randomVectors,
+                     const Deadline &deadline = Deadline(),
+                     MatSpD *basisOut = nullptr)
       -> std::shared_ptr<WeightedAutomaton<M>> {
-    std::vector<MatSpDPtr> rhoVectors =
-        calculate_rho_backward_vectors(WA, randomVectors);
+    std::vector<MatSpDPtr> rhoVectors = calculate_rho_backward_vectors(
+        WA, generate_words_backwards(WA, WA->get_states(), deadline),
+        randomVectors);
+    deadline.check();
+    MatSpD backwardBasis = backward_basis(WA, rhoVectors);
+    deadline.check();
+
+    std::vector<std::shared_ptr<M>> muArrow(WA->get_mu().size());
+    MatDenD muXArrow;
+    MatDenD b;
+    Eigen::SparseQR<MatSpD, Eigen::COLAMDOrdering<long>> qrX;
+    qrX.compute(backwardBasis);
+
+#pragma omp parallel for default(none)                                         \
+    num_threads(THREADS) if (!TEST) private(muXArrow, b)                       \
+        shared(qrX, muArrow, backwardBasis, WA, deadline)
+    for (size_t i = 0; i < WA->get_mu().size(); i++) {
+      if (deadline.expired()) {
+        continue;
+      }
+      b = (*(WA->get_mu()[i]) * backwardBasis).eval();
+      muXArrow = (qrX.solve(b)).eval();
+      muArrow[i] = convert_dense_M(muXArrow);
+    }
+    deadline.check();
+    if (basisOut != nullptr) {
+      *basisOut = backwardBasis;
+    }
+    return assemble_backward(WA, backwardBasis, muArrow);
+  }
+
+  // Stacks eta and the rho vectors column-wise and truncates to the rank of
+  // the resulting matrix
+  static auto backward_basis(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                             const std::vector<MatSpDPtr> &rhoVectors)
+      -> MatSpD {
     MatSpD backwardBasis(WA->get_states(),
                          1 + static_cast<long>(rhoVectors.size()));
 
@@ -62,40 +137,71 @@ public:
 
     backwardBasis.conservativeResize(backwardBasis.rows(), rank);
     backwardBasis.makeCompressed();
+    return backwardBasis;
+  }
 
+  static auto
+  assemble_backward(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                    const MatSpD &backwardBasis,
+                    const std::vector<std::shared_ptr<M>> &muArrow)
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    long rank = backwardBasis.cols();
     std::shared_ptr<M> alphaArrow =
         std::make_shared<M>((*(WA->get_alpha()) * backwardBasis).eval());
     std::shared_ptr<M> etaArrow = std::make_shared<M>(rank, 1);
     etaArrow->setZero();
     etaArrow->coeffRef(0, 0) = 1;
 
-    std::vector<std::shared_ptr<M>> muArrow = {};
-    std::mutex muArrowMutex = std::mutex();
-    MatDenD muXArrow;
-    MatDenD b;
-    Eigen::SparseQR<MatSpD, Eigen::COLAMDOrdering<long>> qrX;
-    qrX.compute(backwardBasis);
-
-#pragma omp parallel for default(none)                                         \
-    num_threads(THREADS) if (!TEST) private(muXArrow, b)                       \
-        shared(qrX, muArrow, backwardBasis, WA, muArrowMutex)
-    for (size_t i = 0; i < WA->get_mu().size(); i++) {
-      b = (*(WA->get_mu()[i]) * backwardBasis).eval();
-      muXArrow = (qrX.solve(b)).eval();
-
-      std::lock_guard<std::mutex> guard(muArrowMutex);
-      muArrow.push_back(convert_dense_M(muXArrow));
-    }
     return std::make_shared<WeightedAutomaton<M>>(
         static_cast<uint>(rank), WA->get_number_input_characters(), alphaArrow,
         muArrow, etaArrow);
   }
 
   static auto forward_reduction(const std::shared_ptr<WeightedAutomaton<M>> &WA,
-                                const std::vector<MatSpDPtr> &randomVectors)
+                                const std::vector<MatSpDPtr> &randomVectors,
+                                const Deadline &deadline = Deadline(),
+                                MatSpD *basisOut = nullptr)
       -> std::shared_ptr<WeightedAutomaton<M>> {
-    std::vector<MatSpDPtr> rhoVectors =
-        calculate_rho_forward_vectors(WA, randomVectors);
+    std::vector<MatSpDPtr> rhoVectors = calculate_rho_forward_vectors(
+        WA, generate_words_forwards(WA, WA->get_states(), deadline),
+        randomVectors);
+    deadline.check();
+    MatSpD forwardBasis = forward_basis(WA, rhoVectors);
+    deadline.check();
+
+    std::vector<std::shared_ptr<M>> muArrow(WA->get_mu().size());
+    Eigen::SparseQR<MatSpD, Eigen::COLAMDOrdering<long>> qrX;
+    MatDenD b;
+    MatDenD muXArrow;
+    MatSpD A = MatSpD(forwardBasis.transpose());
+    A.makeCompressed();
+    qrX.compute(A);
+
+#pragma omp parallel for default(none)                                         \
+    num_threads(THREADS) if (!TEST) private(b, muXArrow)                       \
+        shared(qrX, muArrow, forwardBasis, WA, deadline)
+    for (size_t i = 0; i < WA->get_mu().size(); i++) {
+      if (deadline.expired()) {
+        continue;
+      }
+      // x*A = b <=> A.transpose() * z = b.transpose(); x = z.transpose()
+      // => x = (housholder(A.transpose()).solve(b.transpose())).transpose()
+      b = (((forwardBasis * *(WA->get_mu()[i])).eval()).transpose()).eval();
+      muXArrow = (((qrX.solve(b)).eval()).transpose()).eval();
+      muArrow[i] = convert_dense_M(muXArrow);
+    }
+    deadline.check();
+    if (basisOut != nullptr) {
+      *basisOut = forwardBasis;
+    }
+    return assemble_forward(WA, forwardBasis, muArrow);
+  }
+
+  // Stacks alpha and the rho vectors row-wise and truncates to the rank of
+  // the resulting matrix
+  static auto forward_basis(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                            const std::vector<MatSpDPtr> &rhoVectors)
+      -> MatSpD {
     MatSpD forwardBasis(1 + static_cast<long>(rhoVectors.size()),
                         WA->get_states());
 
@@ -109,34 +215,21 @@ public:
 
     forwardBasis.conservativeResize(rank, forwardBasis.cols());
     forwardBasis.makeCompressed();
+    return forwardBasis;
+  }
 
+  static auto
+  assemble_forward(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                   const MatSpD &forwardBasis,
+                   const std::vector<std::shared_ptr<M>> &muArrow)
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    long rank = forwardBasis.rows();
     std::shared_ptr<M> etaArrow =
         std::make_shared<M>((forwardBasis * *(WA->get_eta())).eval());
     std::shared_ptr<M> alphaArrow = std::make_shared<M>(1, rank);
     alphaArrow->setZero();
     alphaArrow->coeffRef(0, 0) = 1;
 
-    std::vector<std::shared_ptr<M>> muArrow = {};
-    std::mutex muArrowMutex = std::mutex();
-    Eigen::SparseQR<MatSpD, Eigen::COLAMDOrdering<long>> qrX;
-    MatDenD b;
-    MatDenD muXArrow;
-    MatSpD A = MatSpD(forwardBasis.transpose());
-    A.makeCompressed();
-    qrX.compute(A);
-
-#pragma omp parallel for default(none)                                         \
-    num_threads(THREADS) if (!TEST) private(b, muXArrow)                       \
-        shared(qrX, muArrow, forwardBasis, WA, muArrowMutex)
-    for (size_t i = 0; i < WA->get_mu().size(); i++) {
-      // x*A = b <=> A.transpose() * z = b.transpose(); x = z.transpose()
-      // => x = (housholder(A.transpose()).solve(b.transpose())).transpose()
-      b = (((forwardBasis * *(WA->get_mu()[i])).eval()).transpose()).eval();
-      muXArrow = (((qrX.solve(b)).eval()).transpose()).eval();
-
-      std::lock_guard<std::mutex> guard(muArrowMutex);
-      muArrow.push_back(convert_dense_M(muXArrow));
-    }
     return std::make_shared<WeightedAutomaton<M>>(
         static_cast<uint>(rank), WA->get_number_input_characters(), alphaArrow,
         muArrow, etaArrow);
@@ -145,8 +238,14 @@ public:
   static auto calculate_rho_backward_vectors(
       const std::shared_ptr<WeightedAutomaton<M>> &WA,
       const std::vector<MatSpDPtr> &randomVectors) -> std::vector<MatSpDPtr> {
-    std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> sigmaK =
-        generate_words_backwards(WA, WA->get_states());
+    return calculate_rho_backward_vectors(
+        WA, generate_words_backwards(WA, WA->get_states()), randomVectors);
+  }
+
+  static auto calculate_rho_backward_vectors(
+      const std::shared_ptr<WeightedAutomaton<M>> &WA,
+      const std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> &sigmaK,
+      const std::vector<MatSpDPtr> &randomVectors) -> std::vector<MatSpDPtr> {
     std::vector<MatSpDPtr> result = {};
     std::mutex resultMutex = std::mutex();
     MatSpD vI;
@@ -180,8 +279,14 @@ public:
   calculate_rho_forward_vectors(const std::shared_ptr<WeightedAutomaton<M>> &WA,
                                 const std::vector<MatSpDPtr> &randomVectors)
       -> std::vector<MatSpDPtr> {
-    std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> sigmaK =
-        generate_words_forwards(WA, WA->get_states());
+    return calculate_rho_forward_vectors(
+        WA, generate_words_forwards(WA, WA->get_states()), randomVectors);
+  }
+
+  static auto calculate_rho_forward_vectors(
+      const std::shared_ptr<WeightedAutomaton<M>> &WA,
+      const std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> &sigmaK,
+      const std::vector<MatSpDPtr> &randomVectors) -> std::vector<MatSpDPtr> {
     std::vector<MatSpDPtr> result = {};
     std::mutex resultMutex = std::mutex();
     MatSpD vI;
@@ -213,7 +318,7 @@ public:
 
   static auto
   generate_words_forwards(const std::shared_ptr<WeightedAutomaton<M>> &WA,
-                          uint k)
+                          uint k, const Deadline &deadline = Deadline())
       -> std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> {
     std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> result;
     std::mutex resultMutex = std::mutex();
@@ -233,7 +338,8 @@ public:
         }
       }
     } else {
-      result = generate_words_forwards(WA, k - 1);
+      result = generate_words_forwards(WA, k - 1, deadline);
+      deadline.check();
       std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> iteratorCopy(
           result);
 
@@ -261,7 +367,7 @@ public:
 
   static auto
   generate_words_backwards(const std::shared_ptr<WeightedAutomaton<M>> &WA,
-                           uint k)
+                           uint k, const Deadline &deadline = Deadline())
       -> std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> {
     std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> result;
     std::mutex resultMutex = std::mutex();
@@ -280,7 +386,8 @@ public:
         }
       }
     } else {
-      result = generate_words_backwards(WA, k - 1);
+      result = generate_words_backwards(WA, k - 1, deadline);
+      deadline.check();
       std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> iteratorCopy(
           result);
 #pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
@@ -368,6 +475,12 @@ public:
     return randV;
   }
 
+  static inline auto identity(long n) -> MatSpD {
+    MatSpD result(n, n);
+    result.setIdentity();
+    return result;
+  }
+
   template <typename T>
   static inline void fill_row(long rowSource, long rowTarget,
                               const std::shared_ptr<T> &source,
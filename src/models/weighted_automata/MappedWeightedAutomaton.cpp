@@ -0,0 +1,5 @@
+#include "MappedWeightedAutomaton.h"
+
+MappedWeightedAutomaton::~MappedWeightedAutomaton() {
+  munmap(this->data, this->size);
+}
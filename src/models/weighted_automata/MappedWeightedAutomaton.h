@@ -0,0 +1,352 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_MAPPEDWEIGHTEDAUTOMATON_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_MAPPEDWEIGHTEDAUTOMATON_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "WeightedAutomaton.h"
+
+// Weighted automaton in a versioned binary file that is mapped into memory
+// instead of being read. The file starts with a fixed header and a directory
+// with one entry per letter; alpha and eta are stored densely and each
+// transition matrix in the compressed column storage of MatSpD (outer
+// indices, inner indices, values). Every section starts at a multiple of
+// ALIGNMENT, so the views handed out point straight into the mapping and
+// opening a file costs a few page faults rather than a parse.
+class MappedWeightedAutomaton {
+public:
+  static constexpr std::array<char, 8> MAGIC = {'W', 'A', 'B', 'I',
+                                                'N', 'A', 'R', 'Y'};
+  static constexpr uint32_t VERSION = 1;
+  static constexpr size_t ALIGNMENT = 64;
+
+private:
+  struct Header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    // written as 1, reads differently on a machine of the other byte order
+    uint32_t byteOrder;
+    int64_t states;
+    int64_t characters;
+    int64_t alphaOffset;
+    int64_t etaOffset;
+    int64_t directoryOffset;
+    int64_t fileSize;
+  };
+
+  // offsets of the arrays of one transition matrix
+  struct Section {
+    int64_t nnz;
+    int64_t outerOffset;
+    int64_t innerOffset;
+    int64_t valueOffset;
+  };
+
+  static_assert(sizeof(Header) == ALIGNMENT);
+  static_assert(sizeof(MatSpD::StorageIndex) == sizeof(int64_t));
+
+  std::string path;
+  void *data;
+  size_t size;
+
+  [[nodiscard]] inline auto header() const -> const Header & {
+    return *static_cast<const Header *>(this->data);
+  }
+
+  template <typename T>
+  [[nodiscard]] inline auto at(int64_t offset) const -> const T * {
+    return reinterpret_cast<const T *>(static_cast<const char *>(this->data) +
+                                       offset);
+  }
+
+  [[nodiscard]] inline auto section(size_t letter) const -> const Section & {
+    return this->at<Section>(this->header().directoryOffset)[letter];
+  }
+
+  // Throws unless count elements of the width fit into the file at the
+  // aligned offset
+  void check_section(int64_t offset, int64_t count, size_t width) const {
+    if (offset < 0 || count < 0 || offset % ALIGNMENT != 0 ||
+        static_cast<size_t>(offset) > this->size ||
+        static_cast<size_t>(count) >
+            (this->size - static_cast<size_t>(offset)) / width) {
+      throw std::invalid_argument("Corrupt binary automaton " + this->path +
+                                  "!");
+    }
+  }
+
+  // Checks the header and the bounds of all sections. The index arrays are
+  // only checked at their ends, scanning them would touch every page;
+  // to_automaton checks them in full while copying.
+  void validate() const {
+    if (this->size < sizeof(Header) || this->header().magic != MAGIC) {
+      throw std::invalid_argument(this->path + " is not a binary automaton!");
+    }
+    const Header &h = this->header();
+    if (h.version != VERSION || h.byteOrder != 1) {
+      throw std::invalid_argument(
+          this->path + " was written in an incompatible version or byte order!");
+    }
+    if (h.states <= 0 || h.characters <= 0 ||
+        h.fileSize != static_cast<int64_t>(this->size)) {
+      throw std::invalid_argument("Corrupt binary automaton " + this->path +
+                                  "!");
+    }
+    this->check_section(h.alphaOffset, h.states, sizeof(double));
+    this->check_section(h.etaOffset, h.states, sizeof(double));
+    this->check_section(h.directoryOffset, h.characters, sizeof(Section));
+    for (size_t letter = 0; letter < static_cast<size_t>(h.characters);
+         letter++) {
+      const Section &s = this->section(letter);
+      this->check_section(s.outerOffset, h.states + 1, sizeof(int64_t));
+      this->check_section(s.innerOffset, s.nnz, sizeof(int64_t));
+      this->check_section(s.valueOffset, s.nnz, sizeof(double));
+      const auto *outer = this->at<int64_t>(s.outerOffset);
+      if (outer[0] != 0 || outer[h.states] != s.nnz) {
+        throw std::invalid_argument("Corrupt binary automaton " + this->path +
+                                    "!");
+      }
+    }
+  }
+
+  // Copy of the transition matrix of the letter. The mapped index arrays are
+  // checked before anything reads through them: the outer indices have to
+  // ascend and the inner indices of each column have to be strictly
+  // ascending states. Throws if they do not.
+  [[nodiscard]] auto checked_mu(size_t letter) const -> MatSpD {
+    const Section &s = this->section(letter);
+    long states = this->get_states();
+    const auto *outer = this->at<long>(s.outerOffset);
+    const auto *inner = this->at<long>(s.innerOffset);
+    const auto *values = this->at<double>(s.valueOffset);
+    // with outer[0] == 0 and outer[states] == nnz checked by validate,
+    // ascending outer indices keep every column within the inner array
+    for (long c = 0; c < states; c++) {
+      if (outer[c] > outer[c + 1]) {
+        throw std::invalid_argument("Corrupt binary automaton " + this->path +
+                                    "!");
+      }
+    }
+    for (long c = 0; c < states; c++) {
+      for (long k = outer[c]; k < outer[c + 1]; k++) {
+        if (inner[k] < 0 || inner[k] >= states ||
+            (k > outer[c] && inner[k - 1] >= inner[k])) {
+          throw std::invalid_argument("Corrupt binary automaton " +
+                                      this->path + "!");
+        }
+      }
+    }
+    MatSpD mu(states, states);
+    mu.resizeNonZeros(s.nnz);
+    std::copy(outer, outer + states + 1, mu.outerIndexPtr());
+    std::copy(inner, inner + s.nnz, mu.innerIndexPtr());
+    std::copy(values, values + s.nnz, mu.valuePtr());
+    return mu;
+  }
+
+  static auto aligned(size_t offset) -> size_t {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  }
+
+  // Pads the output with zeros up to the offset
+  static void seek(std::ofstream &out, size_t &written, size_t offset) {
+    static constexpr std::array<char, ALIGNMENT> ZEROS = {};
+    out.write(ZEROS.data(), static_cast<std::streamsize>(offset - written));
+    written = offset;
+  }
+
+  static void write_bytes(std::ofstream &out, size_t &written,
+                          const void *bytes, size_t length) {
+    out.write(static_cast<const char *>(bytes),
+              static_cast<std::streamsize>(length));
+    written += length;
+  }
+
+public:
+  // Maps the file read-only, throws if it cannot be opened or is malformed
+  explicit MappedWeightedAutomaton(const std::string &mPath)
+      : path(mPath), data(MAP_FAILED), size(0) {
+    int fd = open(this->path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + this->path +
+                               " for reading!");
+    }
+    struct stat status = {};
+    if (fstat(fd, &status) != 0 || status.st_size <= 0) {
+      close(fd);
+      throw std::invalid_argument(this->path + " is not a binary automaton!");
+    }
+    this->size = static_cast<size_t>(status.st_size);
+    this->data = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (this->data == MAP_FAILED) {
+      throw std::runtime_error("Cannot map " + this->path + " into memory!");
+    }
+    try {
+      this->validate();
+    } catch (...) {
+      munmap(this->data, this->size);
+      throw;
+    }
+  }
+
+  MappedWeightedAutomaton(const MappedWeightedAutomaton &) = delete;
+  auto operator=(const MappedWeightedAutomaton &)
+      -> MappedWeightedAutomaton & = delete;
+
+  ~MappedWeightedAutomaton();
+
+  // Whether the file starts with the magic of the format
+  static auto is_binary(const std::string &mPath) -> bool {
+    std::ifstream in(mPath, std::ios::binary);
+    std::array<char, 8> magic = {};
+    in.read(magic.data(), magic.size());
+    return in.good() && magic == MAGIC;
+  }
+
+  [[nodiscard]] inline auto get_states() const -> long {
+    return this->header().states;
+  }
+
+  [[nodiscard]] inline auto get_number_input_characters() const -> long {
+    return this->header().characters;
+  }
+
+  // The views below point into the mapping and are valid as long as this
+  // object lives. The index arrays behind get_mu are not checked beyond
+  // their ends, use to_automaton for files that may be corrupt.
+
+  [[nodiscard]] inline auto get_alpha() const
+      -> Eigen::Map<const Eigen::RowVectorXd> {
+    return {this->at<double>(this->header().alphaOffset),
+            this->header().states};
+  }
+
+  [[nodiscard]] inline auto get_eta() const
+      -> Eigen::Map<const Eigen::VectorXd> {
+    return {this->at<double>(this->header().etaOffset),
+            this->header().states};
+  }
+
+  [[nodiscard]] inline auto get_mu(size_t letter) const
+      -> Eigen::Map<const MatSpD> {
+    const Section &s = this->section(letter);
+    return {this->header().states, this->header().states, s.nnz,
+            this->at<long>(s.outerOffset), this->at<long>(s.innerOffset),
+            this->at<double>(s.valueOffset)};
+  }
+
+  // Sparse automaton owning copies of the mapped arrays, for the reductions
+  // that take a WeightedAutomaton. The index arrays are checked in one pass
+  // and then copied array by array, throws if they are corrupt.
+  [[nodiscard]] auto to_automaton() const
+      -> std::shared_ptr<WeightedAutomaton<MatSpD>> {
+    auto states = static_cast<uint>(this->get_states());
+    auto characters = static_cast<uint>(this->get_number_input_characters());
+    auto alpha = std::make_shared<MatSpD>(this->get_alpha().sparseView());
+    auto eta = std::make_shared<MatSpD>(this->get_eta().sparseView());
+    std::vector<std::shared_ptr<MatSpD>> mu = {};
+    mu.reserve(characters);
+    for (size_t letter = 0; letter < characters; letter++) {
+      mu.push_back(std::make_shared<MatSpD>(this->checked_mu(letter)));
+    }
+    return std::make_shared<WeightedAutomaton<MatSpD>>(states, characters,
+                                                       alpha, mu, eta);
+  }
+
+  template <Matrix M>
+  static void write(const WeightedAutomaton<M> &automaton,
+                    const std::string &mPath) {
+    auto states = static_cast<size_t>(automaton.get_states());
+    size_t characters = automaton.get_mu().size();
+    MatDenD alpha = MatDenD(*automaton.get_alpha());
+    MatDenD eta = MatDenD(*automaton.get_eta());
+    if (alpha.size() != static_cast<long>(states) ||
+        eta.size() != static_cast<long>(states)) {
+      throw std::invalid_argument(
+          "alpha and eta need one weight per state to be written!");
+    }
+    std::vector<MatSpD> mu = {};
+    mu.reserve(characters);
+    for (const auto &m : automaton.get_mu()) {
+      if (m->rows() != static_cast<long>(states) ||
+          m->cols() != static_cast<long>(states)) {
+        throw std::invalid_argument(
+            "The transition matrices need to be square in the states to be "
+            "written!");
+      }
+      if constexpr (std::is_same_v<M, MatSpD>) {
+        mu.push_back(*m);
+      } else {
+        mu.emplace_back(m->sparseView());
+      }
+      mu.back().makeCompressed();
+    }
+
+    // layout
+    Header header = {MAGIC, VERSION, 1, static_cast<int64_t>(states),
+                     static_cast<int64_t>(characters), 0, 0, 0, 0};
+    size_t offset = sizeof(Header);
+    header.alphaOffset = static_cast<int64_t>(offset);
+    offset = aligned(offset + states * sizeof(double));
+    header.etaOffset = static_cast<int64_t>(offset);
+    offset = aligned(offset + states * sizeof(double));
+    header.directoryOffset = static_cast<int64_t>(offset);
+    offset = aligned(offset + characters * sizeof(Section));
+    std::vector<Section> directory(characters);
+    for (size_t letter = 0; letter < characters; letter++) {
+      auto nnz = static_cast<size_t>(mu[letter].nonZeros());
+      directory[letter].nnz = static_cast<int64_t>(nnz);
+      directory[letter].outerOffset = static_cast<int64_t>(offset);
+      offset = aligned(offset + (states + 1) * sizeof(int64_t));
+      directory[letter].innerOffset = static_cast<int64_t>(offset);
+      offset = aligned(offset + nnz * sizeof(int64_t));
+      directory[letter].valueOffset = static_cast<int64_t>(offset);
+      offset = aligned(offset + nnz * sizeof(double));
+    }
+    header.fileSize = static_cast<int64_t>(offset);
+
+    std::ofstream out(mPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      throw std::runtime_error("Cannot open " + mPath + " for writing!");
+    }
+    size_t written = 0;
+    write_bytes(out, written, &header, sizeof(Header));
+    write_bytes(out, written, alpha.data(), states * sizeof(double));
+    seek(out, written, static_cast<size_t>(header.etaOffset));
+    write_bytes(out, written, eta.data(), states * sizeof(double));
+    seek(out, written, static_cast<size_t>(header.directoryOffset));
+    write_bytes(out, written, directory.data(),
+                characters * sizeof(Section));
+    for (size_t letter = 0; letter < characters; letter++) {
+      const Section &s = directory[letter];
+      auto nnz = static_cast<size_t>(s.nnz);
+      seek(out, written, static_cast<size_t>(s.outerOffset));
+      write_bytes(out, written, mu[letter].outerIndexPtr(),
+                  (states + 1) * sizeof(int64_t));
+      seek(out, written, static_cast<size_t>(s.innerOffset));
+      write_bytes(out, written, mu[letter].innerIndexPtr(),
+                  nnz * sizeof(int64_t));
+      seek(out, written, static_cast<size_t>(s.valueOffset));
+      write_bytes(out, written, mu[letter].valuePtr(), nnz * sizeof(double));
+    }
+    seek(out, written, static_cast<size_t>(header.fileSize));
+    if (!out.good()) {
+      throw std::runtime_error("Failed to write the automaton to " + mPath +
+                               "!");
+    }
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_MAPPEDWEIGHTEDAUTOMATON_H
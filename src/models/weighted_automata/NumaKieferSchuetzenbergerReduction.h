@@ -0,0 +1,436 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_NUMAKIEFERSCHUETZENBERGERREDUCTION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_NUMAKIEFERSCHUETZENBERGERREDUCTION_H
+
+#include <csignal>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../../util/NumaUtils.h"
+#include "../ReductionMethodInterface.h"
+#include "KieferSchuetzenbergerReduction.h"
+#include "WeightedAutomaton.h"
+
+// Kiefer-Schützenberger reduction that forks one worker process per NUMA
+// node. The letters of the input alphabet are distributed round-robin over
+// the workers; each worker copies the transition matrices of its letters
+// after pinning itself to its node, s.t. they are allocated node-locally.
+// The parent keeps the word enumeration, rho vectors and rank computation
+// and exchanges the per-letter products and muArrow solves with the workers
+// over pipes. The parent checks the deadline between word levels and between
+// the letter solves it receives, and like the shared memory reduction returns
+// the last completed stage on expiry.
+template <Matrix M>
+class NumaKieferSchuetzenbergerReduction : public ReductionMethodInterface {
+private:
+  // number of worker processes, 0 selects one per NUMA node
+  uint workers;
+
+public:
+  explicit NumaKieferSchuetzenbergerReduction(uint mWorkers = 0);
+
+  ~NumaKieferSchuetzenbergerReduction() override;
+
+  [[nodiscard]] inline auto get_name() const -> std::string override {
+    return "NUMA Multi-Process Schützenberger Reduction";
+  }
+
+  using ReductionMethodInterface::reduce;
+
+  [[nodiscard]] inline auto
+  reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+         const Deadline &deadline)
+      -> std::shared_ptr<RepresentationInterface> override {
+    return reduce(waInstance, DEFAULT_RANDOM_RANGE_FACTOR, this->workers,
+                  false, deadline);
+  }
+
+  static auto reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+                     uint K, uint noWorkers, bool seed = false,
+                     const Deadline &deadline = Deadline())
+      -> std::shared_ptr<RepresentationInterface> {
+    auto WA = std::static_pointer_cast<WeightedAutomaton<M>>(waInstance);
+    std::shared_ptr<WeightedAutomaton<M>> minWA = WA;
+    try {
+      std::vector<MatSpDPtr> randomVectors =
+          KieferSchuetzenbergerReduction<M>::generate_random_vectors(WA, K,
+                                                                     seed);
+      {
+        WorkerPool pool(WA, noWorkers);
+        minWA = forward_reduction(WA, randomVectors, pool, deadline);
+      }
+      deadline.check();
+      randomVectors =
+          KieferSchuetzenbergerReduction<M>::generate_random_vectors(minWA, K,
+                                                                     seed);
+      WorkerPool pool(minWA, noWorkers);
+      minWA = backward_reduction(minWA, randomVectors, pool, deadline);
+    } catch (const DeadlineExceededException &) {
+      // keep the last completed stage, the input or its forward reduction are
+      // both equivalent to the input
+    }
+    return minWA;
+  }
+
+  class WorkerPool {
+  private:
+    enum Operation : uint64_t {
+      ForwardProducts = 0,
+      BackwardProducts = 1,
+      ForwardSolve = 2,
+      BackwardSolve = 3,
+      Exit = 4
+    };
+    struct Request {
+      uint64_t op;
+      uint64_t count;
+      uint64_t rows;
+      uint64_t cols;
+    };
+    struct Worker {
+      pid_t pid;
+      int requestFd;
+      int replyFd;
+      std::vector<uint> letters;
+    };
+    std::vector<Worker> pool;
+    long states;
+    size_t characters;
+    // SIGPIPE is ignored while the pool runs, s.t. writing to an exited
+    // worker fails with EPIPE instead of killing the process
+    struct sigaction previousSigpipe;
+
+    static void close_channel(const int (&channel)[2]) {
+      for (const auto &fd : channel) {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+    }
+
+    // Asks the workers to exit, closes their channels and reaps them. An
+    // aborted exchange leaves the workers busy, they are killed instead.
+    void shutdown(bool abort) noexcept {
+      Request exit = {Exit, 0, 0, 0};
+      for (const auto &worker : this->pool) {
+        if (abort) {
+          kill(worker.pid, SIGKILL);
+        }
+        try {
+          write_all(worker.requestFd, &exit, sizeof(Request));
+        } catch (const std::runtime_error &) {
+          // worker is already gone, reap it below
+        }
+        ::close(worker.requestFd);
+        ::close(worker.replyFd);
+        waitpid(worker.pid, nullptr, 0);
+      }
+      this->pool.clear();
+      sigaction(SIGPIPE, &this->previousSigpipe, nullptr);
+    }
+
+    // Forks n workers, distributing the letters round-robin
+    void start(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+               const std::vector<int> &nodes, size_t n) {
+      for (size_t w = 0; w < n; w++) {
+        Worker worker = {-1, -1, -1, {}};
+        for (size_t i = w; i < this->characters; i += n) {
+          worker.letters.push_back(static_cast<uint>(i));
+        }
+        int request[2] = {-1, -1};
+        int reply[2] = {-1, -1};
+        if (pipe(request) != 0 || pipe(reply) != 0) {
+          close_channel(request);
+          close_channel(reply);
+          throw std::runtime_error("Could not create worker channels!");
+        }
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+          close_channel(request);
+          close_channel(reply);
+          throw std::runtime_error("Could not fork NUMA worker!");
+        }
+        if (pid == 0) {
+          ::close(request[1]);
+          ::close(reply[0]);
+          for (const auto &other : this->pool) {
+            ::close(other.requestFd);
+            ::close(other.replyFd);
+          }
+          int status = 0;
+          try {
+            serve(nodes[w % nodes.size()], WA, worker.letters, request[0],
+                  reply[1]);
+          } catch (...) {
+            status = 1;
+          }
+          _exit(status);
+        }
+        ::close(request[0]);
+        ::close(reply[1]);
+        worker.pid = pid;
+        worker.requestFd = request[1];
+        worker.replyFd = reply[0];
+        this->pool.push_back(worker);
+      }
+    }
+
+  public:
+    WorkerPool(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+               uint noWorkers)
+        : pool({}), states(WA->get_states()),
+          characters(WA->get_mu().size()), previousSigpipe() {
+      std::vector<int> nodes = numa_nodes();
+      size_t n = noWorkers == 0 ? nodes.size() : noWorkers;
+      n = std::max<size_t>(1, std::min(n, this->characters));
+
+      struct sigaction ignore = {};
+      ignore.sa_handler = SIG_IGN;
+      sigemptyset(&ignore.sa_mask);
+      sigaction(SIGPIPE, &ignore, &this->previousSigpipe);
+      try {
+        this->start(WA, nodes, n);
+      } catch (...) {
+        // reap the workers that were already forked
+        this->shutdown(true);
+        throw;
+      }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    auto operator=(const WorkerPool &) -> WorkerPool & = delete;
+
+    // unwinding, e.g. from an expired deadline, aborts pending requests
+    ~WorkerPool() { this->shutdown(std::uncaught_exceptions() > 0); }
+
+    // Computes v * mu[i] (forward) or mu[i] * v (backward) for all vectors of
+    // the frontier and all letters; result[j][i] belongs to frontier[j]
+    auto products(const std::vector<Eigen::VectorXd> &frontier, bool forward)
+        -> std::vector<std::vector<Eigen::VectorXd>> {
+      Request request = {forward ? ForwardProducts : BackwardProducts,
+                         frontier.size(), static_cast<uint64_t>(this->states),
+                         1};
+      for (const auto &worker : this->pool) {
+        write_all(worker.requestFd, &request, sizeof(Request));
+        for (const auto &v : frontier) {
+          write_all(worker.requestFd, v.data(),
+                    sizeof(double) * static_cast<size_t>(this->states));
+        }
+      }
+      std::vector<std::vector<Eigen::VectorXd>> result(
+          frontier.size(), std::vector<Eigen::VectorXd>(this->characters));
+      for (const auto &worker : this->pool) {
+        for (size_t j = 0; j < frontier.size(); j++) {
+          for (const auto &letter : worker.letters) {
+            result[j][letter] = Eigen::VectorXd(this->states);
+            read_all(worker.replyFd, result[j][letter].data(),
+                     sizeof(double) * static_cast<size_t>(this->states));
+          }
+        }
+      }
+      return result;
+    }
+
+    // Solves x * basis = basis * mu[i] (forward) or basis * x = mu[i] * basis
+    // (backward) for every letter, checking the deadline after each solve
+    auto solve(const MatSpD &basis, bool forward,
+               const Deadline &deadline = Deadline())
+        -> std::vector<std::shared_ptr<M>> {
+      MatDenD dense = MatDenD(basis);
+      long rank = forward ? dense.rows() : dense.cols();
+      Request request = {forward ? ForwardSolve : BackwardSolve, 1,
+                         static_cast<uint64_t>(dense.rows()),
+                         static_cast<uint64_t>(dense.cols())};
+      for (const auto &worker : this->pool) {
+        write_all(worker.requestFd, &request, sizeof(Request));
+        write_all(worker.requestFd, dense.data(),
+                  sizeof(double) * static_cast<size_t>(dense.size()));
+      }
+      std::vector<std::shared_ptr<M>> muArrow(this->characters);
+      MatDenD muXArrow(rank, rank);
+      for (const auto &worker : this->pool) {
+        for (const auto &letter : worker.letters) {
+          read_all(worker.replyFd, muXArrow.data(),
+                   sizeof(double) * static_cast<size_t>(muXArrow.size()));
+          muArrow[letter] =
+              KieferSchuetzenbergerReduction<M>::convert_dense_M(muXArrow);
+          deadline.check();
+        }
+      }
+      return muArrow;
+    }
+
+  private:
+    static void serve(int node,
+                      const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                      const std::vector<uint> &letters, int requestFd,
+                      int replyFd) {
+      bind_to_numa_node(node);
+      // OpenMP is not fork safe, the workers are single threaded
+      Eigen::setNbThreads(1);
+      // first touch: node-local copies of the transition matrices
+      std::vector<M> mu = {};
+      mu.reserve(letters.size());
+      for (const auto &letter : letters) {
+        mu.emplace_back(*(WA->get_mu()[letter]));
+      }
+      const long states = WA->get_states();
+
+      Request request = {Exit, 0, 0, 0};
+      while (true) {
+        read_all(requestFd, &request, sizeof(Request));
+        switch (request.op) {
+        case ForwardProducts:
+        case BackwardProducts: {
+          std::vector<Eigen::VectorXd> frontier(request.count,
+                                                Eigen::VectorXd(states));
+          for (auto &v : frontier) {
+            read_all(requestFd, v.data(),
+                     sizeof(double) * static_cast<size_t>(states));
+          }
+          Eigen::VectorXd result;
+          for (const auto &v : frontier) {
+            for (const auto &muX : mu) {
+              if (request.op == ForwardProducts) {
+                result = (v.transpose() * muX).transpose();
+              } else {
+                result = muX * v;
+              }
+              write_all(replyFd, result.data(),
+                        sizeof(double) * static_cast<size_t>(states));
+            }
+          }
+          break;
+        }
+        case ForwardSolve:
+        case BackwardSolve: {
+          MatDenD dense(request.rows, request.cols);
+          read_all(requestFd, dense.data(),
+                   sizeof(double) * static_cast<size_t>(dense.size()));
+          MatSpD basis = dense.sparseView();
+          MatSpD A = request.op == ForwardSolve ? MatSpD(basis.transpose())
+                                                : basis;
+          A.makeCompressed();
+          Eigen::SparseQR<MatSpD, Eigen::COLAMDOrdering<long>> qrX;
+          qrX.compute(A);
+          MatDenD b;
+          MatDenD muXArrow;
+          for (const auto &muX : mu) {
+            if (request.op == ForwardSolve) {
+              b = (((basis * muX).eval()).transpose()).eval();
+              muXArrow = (((qrX.solve(b)).eval()).transpose()).eval();
+            } else {
+              b = (muX * basis).eval();
+              muXArrow = (qrX.solve(b)).eval();
+            }
+            write_all(replyFd, muXArrow.data(),
+                      sizeof(double) * static_cast<size_t>(muXArrow.size()));
+          }
+          break;
+        }
+        default:
+          ::close(requestFd);
+          ::close(replyFd);
+          return;
+        }
+      }
+    }
+  };
+
+  static auto forward_reduction(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                                const std::vector<MatSpDPtr> &randomVectors,
+                                WorkerPool &pool,
+                                const Deadline &deadline = Deadline())
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    std::vector<MatSpDPtr> rhoVectors =
+        KieferSchuetzenbergerReduction<M>::calculate_rho_forward_vectors(
+            WA, generate_words(WA, WA->get_states(), true, pool, deadline),
+            randomVectors);
+    deadline.check();
+    MatSpD forwardBasis =
+        KieferSchuetzenbergerReduction<M>::forward_basis(WA, rhoVectors);
+    deadline.check();
+    return KieferSchuetzenbergerReduction<M>::assemble_forward(
+        WA, forwardBasis, pool.solve(forwardBasis, true, deadline));
+  }
+
+  static auto
+  backward_reduction(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                     const std::vector<MatSpDPtr> &randomVectors,
+                     WorkerPool &pool, const Deadline &deadline = Deadline())
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    std::vector<MatSpDPtr> rhoVectors =
+        KieferSchuetzenbergerReduction<M>::calculate_rho_backward_vectors(
+            WA, generate_words(WA, WA->get_states(), false, pool, deadline),
+            randomVectors);
+    deadline.check();
+    MatSpD backwardBasis =
+        KieferSchuetzenbergerReduction<M>::backward_basis(WA, rhoVectors);
+    deadline.check();
+    return KieferSchuetzenbergerReduction<M>::assemble_backward(
+        WA, backwardBasis, pool.solve(backwardBasis, false, deadline));
+  }
+
+  // Level-wise version of generate_words_forwards/backwards: the products of
+  // each level are computed by the workers, yielding the same words in the
+  // same order. The deadline is checked before each level.
+  static auto generate_words(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                             uint k, bool forward, WorkerPool &pool,
+                             const Deadline &deadline = Deadline())
+      -> std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> {
+    std::vector<std::tuple<MatSpDPtr, std::vector<uint>>> result = {};
+    std::vector<Eigen::VectorXd> frontier = {};
+    std::vector<std::vector<uint>> frontierWords = {{}};
+    if (forward) {
+      frontier.emplace_back(MatDenD(*(WA->get_alpha())).transpose());
+    } else {
+      frontier.emplace_back(MatDenD(*(WA->get_eta())));
+    }
+
+    for (uint level = 0; level < k && !frontier.empty(); level++) {
+      deadline.check();
+      std::vector<std::vector<Eigen::VectorXd>> products =
+          pool.products(frontier, forward);
+      std::vector<Eigen::VectorXd> nextFrontier = {};
+      std::vector<std::vector<uint>> nextWords = {};
+      for (size_t j = 0; j < frontier.size(); j++) {
+        for (size_t i = 0; i < products[j].size(); i++) {
+          if (floating_point_compare(products[j][i].sum(), 0.0)) {
+            continue;
+          }
+          std::vector<uint> word = frontierWords[j];
+          if (forward) {
+            word.push_back(static_cast<uint>(i));
+            result.emplace_back(std::make_shared<MatSpD>(
+                                    products[j][i].transpose().sparseView()),
+                                word);
+          } else {
+            word.insert(word.begin(), static_cast<uint>(i));
+            result.emplace_back(
+                std::make_shared<MatSpD>(products[j][i].sparseView()), word);
+          }
+          nextFrontier.push_back(products[j][i]);
+          nextWords.push_back(word);
+        }
+      }
+      frontier = nextFrontier;
+      frontierWords = nextWords;
+    }
+    return result;
+  }
+};
+
+template <Matrix M>
+NumaKieferSchuetzenbergerReduction<M>::NumaKieferSchuetzenbergerReduction(
+    uint mWorkers)
+    : workers(mWorkers) {}
+
+template <Matrix M>
+NumaKieferSchuetzenbergerReduction<M>::~NumaKieferSchuetzenbergerReduction() =
+    default;
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_NUMAKIEFERSCHUETZENBERGERREDUCTION_H
@@ -0,0 +1,257 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_REDUCTIONCERTIFICATE_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_REDUCTIONCERTIFICATE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "WeightedAutomaton.h"
+
+// Witness that a two-stage (forward, then backward) reduction A -> A1 -> A2
+// preserves the series. With the forward basis F and the backward basis B
+//   alpha1 F = alpha,  mu1 F = F mu,  eta1 = F eta,
+//   alpha2 = alpha1 B, mu1 B = B mu2, B eta2 = eta1
+// imply alpha2 mu2_w eta2 = alpha1 mu1_w eta1 = alpha mu_w eta for all words
+// w. Checking these identities takes one sparse product per letter and basis
+// instead of an equivalence search.
+template <Matrix M> class ReductionCertificate {
+private:
+  // rows span the reachable space of the original automaton
+  MatSpD forwardBasis;
+  // intermediate, forward reduced automaton A1
+  MatSpD alphaForward;
+  std::vector<MatSpD> muForward;
+  MatSpD etaForward;
+  // columns span the co-reachable space of A1
+  MatSpD backwardBasis;
+
+  static constexpr std::array<char, 8> MAGIC = {'W', 'A', 'C', 'E',
+                                                'R', 'T', '0', '1'};
+
+public:
+  ReductionCertificate(MatSpD mForwardBasis,
+                       const std::shared_ptr<WeightedAutomaton<M>> &forwardWA,
+                       MatSpD mBackwardBasis)
+      : forwardBasis(std::move(mForwardBasis)),
+        alphaForward(to_sparse(*(forwardWA->get_alpha()))), muForward({}),
+        etaForward(to_sparse(*(forwardWA->get_eta()))),
+        backwardBasis(std::move(mBackwardBasis)) {
+    for (const auto &mu : forwardWA->get_mu()) {
+      this->muForward.push_back(to_sparse(*mu));
+    }
+  }
+
+  ReductionCertificate(MatSpD mForwardBasis, MatSpD mAlphaForward,
+                       std::vector<MatSpD> mMuForward, MatSpD mEtaForward,
+                       MatSpD mBackwardBasis)
+      : forwardBasis(std::move(mForwardBasis)),
+        alphaForward(std::move(mAlphaForward)),
+        muForward(std::move(mMuForward)), etaForward(std::move(mEtaForward)),
+        backwardBasis(std::move(mBackwardBasis)) {}
+
+  ~ReductionCertificate() = default;
+
+  [[nodiscard]] inline auto get_forward_basis() const -> const MatSpD & {
+    return this->forwardBasis;
+  }
+
+  [[nodiscard]] inline auto get_backward_basis() const -> const MatSpD & {
+    return this->backwardBasis;
+  }
+
+  // Checks the identities above up to a residual of tolerance relative to
+  // the magnitude of the compared products
+  [[nodiscard]] auto verify(const std::shared_ptr<WeightedAutomaton<M>> &original,
+                            const std::shared_ptr<WeightedAutomaton<M>> &reduced,
+                            double tolerance = 1e-9) const -> bool {
+    const MatSpD &F = this->forwardBasis;
+    const MatSpD &B = this->backwardBasis;
+    size_t letters = original->get_mu().size();
+    if (F.cols() != original->get_states() || F.rows() != B.rows() ||
+        B.cols() != reduced->get_states() ||
+        this->muForward.size() != letters ||
+        reduced->get_mu().size() != letters ||
+        this->alphaForward.cols() != F.rows() ||
+        this->etaForward.rows() != F.rows()) {
+      return false;
+    }
+    MatSpD alpha = to_sparse(*(original->get_alpha()));
+    MatSpD eta = to_sparse(*(original->get_eta()));
+    MatSpD alpha2 = to_sparse(*(reduced->get_alpha()));
+    MatSpD eta2 = to_sparse(*(reduced->get_eta()));
+
+    if (!close(this->alphaForward * F, alpha, tolerance) ||
+        !close(this->etaForward, F * eta, tolerance) ||
+        !close(this->alphaForward * B, alpha2, tolerance) ||
+        !close(B * eta2, this->etaForward, tolerance)) {
+      return false;
+    }
+    for (size_t i = 0; i < letters; i++) {
+      MatSpD mu = to_sparse(*(original->get_mu()[i]));
+      MatSpD mu2 = to_sparse(*(reduced->get_mu()[i]));
+      if (!close(this->muForward[i] * F, F * mu, tolerance) ||
+          !close(this->muForward[i] * B, B * mu2, tolerance)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Layout: magic, number of letters, then F, alpha1, mu1 per letter, eta1
+  // and B, each in compressed column storage (rows, cols, nnz, outer
+  // indices, inner indices, values)
+  void write(const std::string &path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      throw std::runtime_error("Cannot open " + path + " for writing!");
+    }
+    out.write(MAGIC.data(), MAGIC.size());
+    write_value(out, static_cast<int64_t>(this->muForward.size()));
+    write_matrix(out, this->forwardBasis);
+    write_matrix(out, this->alphaForward);
+    for (const auto &mu : this->muForward) {
+      write_matrix(out, mu);
+    }
+    write_matrix(out, this->etaForward);
+    write_matrix(out, this->backwardBasis);
+    if (!out.good()) {
+      throw std::runtime_error("Failed to write the certificate to " + path +
+                               "!");
+    }
+  }
+
+  static auto read(const std::string &path)
+      -> std::shared_ptr<ReductionCertificate<M>> {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+      throw std::runtime_error("Cannot open " + path + " for reading!");
+    }
+    std::array<char, 8> magic = {};
+    in.read(magic.data(), magic.size());
+    if (!in.good() || magic != MAGIC) {
+      throw std::invalid_argument(path + " is not a reduction certificate!");
+    }
+    auto letters = read_value<int64_t>(in);
+    if (letters < 0) {
+      throw std::invalid_argument("Corrupt reduction certificate!");
+    }
+    MatSpD F = read_matrix(in);
+    MatSpD alpha = read_matrix(in);
+    std::vector<MatSpD> mu = {};
+    for (int64_t i = 0; i < letters; i++) {
+      mu.push_back(read_matrix(in));
+    }
+    MatSpD eta = read_matrix(in);
+    MatSpD B = read_matrix(in);
+    return std::make_shared<ReductionCertificate<M>>(
+        std::move(F), std::move(alpha), std::move(mu), std::move(eta),
+        std::move(B));
+  }
+
+  template <typename T> static auto to_sparse(const T &mat) -> MatSpD {
+    if constexpr (std::is_same_v<T, MatSpD>) {
+      return mat;
+    } else {
+      return MatSpD(mat.sparseView());
+    }
+  }
+
+private:
+  static auto close(const MatSpD &lhs, const MatSpD &rhs, double tolerance)
+      -> bool {
+    if (lhs.rows() != rhs.rows() || lhs.cols() != rhs.cols()) {
+      return false;
+    }
+    double scale = std::max({1.0, lhs.norm(), rhs.norm()});
+    return (lhs - rhs).norm() <= tolerance * scale;
+  }
+
+  template <typename T> static void write_value(std::ofstream &out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  template <typename T> static auto read_value(std::ifstream &in) -> T {
+    T value;
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (!in.good()) {
+      throw std::invalid_argument("Truncated reduction certificate!");
+    }
+    return value;
+  }
+
+  static void write_matrix(std::ofstream &out, const MatSpD &mat) {
+    MatSpD compressed = mat;
+    compressed.makeCompressed();
+    write_value(out, static_cast<int64_t>(compressed.rows()));
+    write_value(out, static_cast<int64_t>(compressed.cols()));
+    write_value(out, static_cast<int64_t>(compressed.nonZeros()));
+    out.write(reinterpret_cast<const char *>(compressed.outerIndexPtr()),
+              static_cast<std::streamsize>(sizeof(long) *
+                                           (compressed.cols() + 1)));
+    out.write(reinterpret_cast<const char *>(compressed.innerIndexPtr()),
+              static_cast<std::streamsize>(sizeof(long) *
+                                           compressed.nonZeros()));
+    out.write(reinterpret_cast<const char *>(compressed.valuePtr()),
+              static_cast<std::streamsize>(sizeof(double) *
+                                           compressed.nonZeros()));
+  }
+
+  // Bytes between the read position and the end of the file
+  static auto remaining(std::ifstream &in) -> int64_t {
+    auto pos = in.tellg();
+    in.seekg(0, std::ios::end);
+    auto end = in.tellg();
+    in.seekg(pos);
+    return static_cast<int64_t>(end - pos);
+  }
+
+  static auto read_matrix(std::ifstream &in) -> MatSpD {
+    auto rows = read_value<int64_t>(in);
+    auto cols = read_value<int64_t>(in);
+    auto nnz = read_value<int64_t>(in);
+    // the arrays have to fit into the rest of the file, which bounds the
+    // allocations below, and nnz <= rows * cols without overflow
+    int64_t bytes = remaining(in);
+    if (rows < 0 || cols < 0 || nnz < 0 ||
+        cols >= bytes / static_cast<int64_t>(sizeof(long)) ||
+        nnz > (bytes - static_cast<int64_t>(sizeof(long)) * (cols + 1)) /
+                  static_cast<int64_t>(sizeof(long) + sizeof(double)) ||
+        (nnz > 0 && (rows == 0 || (nnz - 1) / rows >= cols))) {
+      throw std::invalid_argument("Corrupt reduction certificate!");
+    }
+    std::vector<long> outer(static_cast<size_t>(cols + 1));
+    std::vector<long> inner(static_cast<size_t>(nnz));
+    std::vector<double> values(static_cast<size_t>(nnz));
+    in.read(reinterpret_cast<char *>(outer.data()),
+            static_cast<std::streamsize>(sizeof(long) * outer.size()));
+    in.read(reinterpret_cast<char *>(inner.data()),
+            static_cast<std::streamsize>(sizeof(long) * inner.size()));
+    in.read(reinterpret_cast<char *>(values.data()),
+            static_cast<std::streamsize>(sizeof(double) * values.size()));
+    if (!in.good() || outer.front() != 0 || outer.back() != nnz ||
+        !std::is_sorted(outer.begin(), outer.end()) ||
+        std::any_of(inner.begin(), inner.end(),
+                    [rows](long i) { return i < 0 || i >= rows; })) {
+      throw std::invalid_argument("Corrupt reduction certificate!");
+    }
+    // the inner indices of a column have to be strictly ascending
+    for (size_t c = 0; c < static_cast<size_t>(cols); c++) {
+      for (long k = outer[c] + 1; k < outer[c + 1]; k++) {
+        if (inner[static_cast<size_t>(k - 1)] >=
+            inner[static_cast<size_t>(k)]) {
+          throw std::invalid_argument("Corrupt reduction certificate!");
+        }
+      }
+    }
+    return MatSpD(Eigen::Map<const MatSpD>(rows, cols, nnz, outer.data(),
+                                           inner.data(), values.data()));
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_REDUCTIONCERTIFICATE_H
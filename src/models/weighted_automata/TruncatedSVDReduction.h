@@ -0,0 +1,237 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_TRUNCATEDSVDREDUCTION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_TRUNCATEDSVDREDUCTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../ReductionMethodInterface.h"
+#include "KieferSchuetzenbergerReduction.h"
+#include "WeightedAutomaton.h"
+
+// Approximate minimization via a truncated SVD of the Hankel-like matrix
+// H = P * S, where the rows of P are alpha and the forward rho vectors and
+// the columns of S are eta and the backward rho vectors. With
+// H ~ U_k * Sigma_k * V_k^T the reduced automaton is
+//   alpha' = alpha * S * V_k,
+//   mu'    = Sigma_k^-1 * U_k^T * P * mu * S * V_k,
+//   eta'   = Sigma_k^-1 * U_k^T * P * eta.
+// If k is the rank of H the result is the minimal automaton, otherwise the
+// discarded singular values bound how much of the series is lost.
+template <Matrix M> class TruncatedSVDReduction : public ReductionMethodInterface {
+private:
+  // fixed rank of the result, 0 selects the rank by the tolerance
+  uint targetRank;
+  // relative Frobenius norm of the discarded part of H
+  double tolerance;
+  // relative Frobenius error ||H - U_k Sigma_k V_k^T|| / ||H|| of the last run
+  double estimatedError;
+
+public:
+  explicit TruncatedSVDReduction(uint mTargetRank = 0,
+                                 double mTolerance = DEFAULT_SVD_TOLERANCE);
+
+  ~TruncatedSVDReduction() override;
+
+  [[nodiscard]] inline auto get_name() const -> std::string override {
+    return "Truncated SVD Approximate Reduction";
+  }
+
+  [[nodiscard]] inline auto get_target_rank() const -> uint {
+    return this->targetRank;
+  }
+
+  [[nodiscard]] inline auto get_tolerance() const -> double {
+    return this->tolerance;
+  }
+
+  [[nodiscard]] inline auto get_estimated_error() const -> double {
+    return this->estimatedError;
+  }
+
+  using ReductionMethodInterface::reduce;
+
+  // The approximation has no valid intermediate result, hence the deadline is
+  // only honoured before starting
+  [[nodiscard]] inline auto
+  reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+         const Deadline &deadline)
+      -> std::shared_ptr<RepresentationInterface> override {
+    if (deadline.expired()) {
+      return waInstance;
+    }
+    return reduce(waInstance, this->targetRank, this->tolerance,
+                  &(this->estimatedError));
+  }
+
+  static auto reduce(const std::shared_ptr<RepresentationInterface> &waInstance,
+                     uint rank, double tol, double *error,
+                     uint K = DEFAULT_RANDOM_RANGE_FACTOR, bool seed = false)
+      -> std::shared_ptr<RepresentationInterface> {
+    auto WA = std::static_pointer_cast<WeightedAutomaton<M>>(waInstance);
+    std::vector<MatSpDPtr> randomVectors =
+        KieferSchuetzenbergerReduction<M>::generate_random_vectors(WA, K, seed);
+    MatDenD P = stack_rows(
+        *(WA->get_alpha()),
+        KieferSchuetzenbergerReduction<M>::calculate_rho_forward_vectors(
+            WA, randomVectors));
+    MatDenD S = stack_rows(
+        MatDenD(*(WA->get_eta())).transpose(),
+        transpose_all(
+            KieferSchuetzenbergerReduction<M>::calculate_rho_backward_vectors(
+                WA, randomVectors)))
+                    .transpose();
+    return truncate(WA, P, S, rank, tol, error, seed);
+  }
+
+  static auto truncate(const std::shared_ptr<WeightedAutomaton<M>> &WA,
+                       const MatDenD &P, const MatDenD &S, uint rank,
+                       double tol, double *error, bool seed = false)
+      -> std::shared_ptr<WeightedAutomaton<M>> {
+    MatDenD H = (P * S).eval();
+    MatDenD U;
+    MatDenD V;
+    Eigen::VectorXd sigma;
+    randomized_svd(H, rank, tol, seed, &U, &sigma, &V);
+
+    long k = select_rank(sigma, rank, tol);
+    double hNorm = H.norm();
+    MatDenD approx = U.leftCols(k) * sigma.head(k).asDiagonal() *
+                     V.leftCols(k).transpose();
+    if (error != nullptr) {
+      *error = hNorm > 0.0 ? (H - approx).norm() / hNorm : 0.0;
+    }
+    if (k == 0) {
+      // the series is (numerically) zero, a single dead state represents it
+      std::shared_ptr<M> zero =
+          KieferSchuetzenbergerReduction<M>::convert_dense_M(
+              MatDenD::Zero(1, 1));
+      return std::make_shared<WeightedAutomaton<M>>(
+          1, WA->get_number_input_characters(), zero,
+          std::vector<std::shared_ptr<M>>(WA->get_mu().size(), zero), zero);
+    }
+
+    // left and right projections onto the k dominant singular directions
+    MatDenD right = (S * V.leftCols(k)).eval();
+    MatDenD left = (sigma.head(k).cwiseInverse().asDiagonal() *
+                    U.leftCols(k).transpose() * P)
+                       .eval();
+
+    std::vector<std::shared_ptr<M>> muArrow(WA->get_mu().size());
+    for (size_t i = 0; i < WA->get_mu().size(); i++) {
+      muArrow[i] = KieferSchuetzenbergerReduction<M>::convert_dense_M(
+          (left * (*(WA->get_mu()[i]) * right).eval()).eval());
+    }
+    return std::make_shared<WeightedAutomaton<M>>(
+        static_cast<uint>(k), WA->get_number_input_characters(),
+        KieferSchuetzenbergerReduction<M>::convert_dense_M(
+            (*(WA->get_alpha()) * right).eval()),
+        muArrow,
+        KieferSchuetzenbergerReduction<M>::convert_dense_M(
+            (left * *(WA->get_eta())).eval()));
+  }
+
+  // Randomized range finder with power iterations (Halko, Martinsson, Tropp).
+  // When no rank is given the sketch is enlarged until the smallest computed
+  // singular value drops below the tolerance or the sketch covers H.
+  static void randomized_svd(const MatDenD &H, uint rank, double tol,
+                             bool seed, MatDenD *U, Eigen::VectorXd *sigma,
+                             MatDenD *V) {
+    const long oversampling = 10;
+    const int powerIterations = 2;
+    long full = std::min(H.rows(), H.cols());
+    long sketch =
+        rank > 0 ? std::min<long>(full, static_cast<long>(rank) + oversampling)
+                 : std::min<long>(full, 2 * oversampling);
+
+    auto rng = std::mt19937(0);
+    if (!seed) {
+      std::random_device rd;
+      rng = std::mt19937(rd());
+    }
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    while (true) {
+      MatDenD omega(H.cols(), sketch);
+      for (long i = 0; i < omega.size(); i++) {
+        omega.data()[i] = normal(rng);
+      }
+      MatDenD Q = orthonormal_basis(H * omega);
+      for (int q = 0; q < powerIterations; q++) {
+        Q = orthonormal_basis(H.transpose() * Q);
+        Q = orthonormal_basis(H * Q);
+      }
+      MatDenD B = (Q.transpose() * H).eval();
+      Eigen::JacobiSVD<MatDenD> svd(B, Eigen::ComputeThinU |
+                                           Eigen::ComputeThinV);
+      *U = Q * svd.matrixU();
+      *sigma = svd.singularValues();
+      *V = svd.matrixV();
+
+      bool captured = sigma->size() == 0 || (*sigma)(0) == 0.0 ||
+                      (*sigma)(sigma->size() - 1) <= tol * (*sigma)(0);
+      if (rank > 0 || sketch >= full || captured) {
+        return;
+      }
+      sketch = std::min(full, 2 * sketch);
+    }
+  }
+
+  // Smallest k s.t. the discarded singular values hold at most tol of the
+  // Frobenius norm of the sketch, or the requested rank. The sketch only
+  // approximates ||H||_F, whatever it missed is not counted here but shows in
+  // the error truncate reports. Subtracting from ||H||_F^2 instead would drown
+  // small tolerances in cancellation.
+  static auto select_rank(const Eigen::VectorXd &sigma, uint rank, double tol)
+      -> long {
+    if (rank > 0) {
+      return std::min<long>(static_cast<long>(rank), sigma.size());
+    }
+    double total = sigma.squaredNorm();
+    double tail = total;
+    long k = 0;
+    while (k < sigma.size() && tail > tol * tol * total) {
+      tail -= sigma(k) * sigma(k);
+      k++;
+    }
+    return k;
+  }
+
+  static auto orthonormal_basis(const MatDenD &Y) -> MatDenD {
+    Eigen::HouseholderQR<MatDenD> qr(Y);
+    return qr.householderQ() * MatDenD::Identity(Y.rows(), Y.cols());
+  }
+
+  template <typename T>
+  static auto stack_rows(const T &first, const std::vector<MatSpDPtr> &rows)
+      -> MatDenD {
+    MatDenD result(1 + static_cast<long>(rows.size()), first.cols());
+    result.row(0) = MatDenD(first).row(0);
+    for (size_t i = 0; i < rows.size(); i++) {
+      result.row(static_cast<long>(i + 1)) = MatDenD(*rows[i]).row(0);
+    }
+    return result;
+  }
+
+  static auto transpose_all(const std::vector<MatSpDPtr> &vectors)
+      -> std::vector<MatSpDPtr> {
+    std::vector<MatSpDPtr> result = {};
+    for (const auto &vect : vectors) {
+      result.push_back(std::make_shared<MatSpD>(vect->transpose()));
+    }
+    return result;
+  }
+};
+
+template <Matrix M>
+TruncatedSVDReduction<M>::TruncatedSVDReduction(uint mTargetRank,
+                                                double mTolerance)
+    : targetRank(mTargetRank), tolerance(mTolerance), estimatedError(0.0) {}
+
+template <Matrix M>
+TruncatedSVDReduction<M>::~TruncatedSVDReduction() = default;
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_TRUNCATEDSVDREDUCTION_H
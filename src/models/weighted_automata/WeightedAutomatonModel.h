@@ -1,23 +1,52 @@
 #ifndef STOCHASTIC_SYSTEM_MINIMIZATION_WEIGHTEDAUTOMATONMODEL_H
 #define STOCHASTIC_SYSTEM_MINIMIZATION_WEIGHTEDAUTOMATONMODEL_H
 
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <optional>
+#include <string_view>
 #include <utility>
 
 #include "../../util/ParseUtils.h"
 #include "../ModelInterface.h"
+#include "FiniteHorizonReduction.h"
 #include "KieferSchuetzenbergerReduction.h"
+#include "MappedWeightedAutomaton.h"
+#include "NumaKieferSchuetzenbergerReduction.h"
+#include "TruncatedSVDReduction.h"
 #include "WeightedAutomaton.h"
 #include "WeightedAutomatonBenchmarks.h"
 
 class WeightedAutomatonModel : public ModelInterface {
 private:
+  // sparse transition sections are parsed in chunks of at least this size
+  static constexpr size_t MIN_CHUNK_BYTES = size_t{1} << 20U;
+
+  // parameters of the approximate reductions, kept here since the methods
+  // are recreated when parsing switches to sparse matrices
+  uint svdRank = 0;
+  double svdTolerance = DEFAULT_SVD_TOLERANCE;
+  uint finiteHorizon = DEFAULT_FINITE_HORIZON;
+  // declared after the parameters, which the methods are constructed from
   std::vector<std::shared_ptr<ReductionMethodInterface>> reductionMethods;
   std::vector<std::shared_ptr<ConversionMethodInterface>> conversionMethods;
 
+  // Whether the current methods work on sparse matrices
+  [[nodiscard]] auto is_sparse() const -> bool {
+    return std::dynamic_pointer_cast<KieferSchuetzenbergerReduction<MatSpD>>(
+               this->reductionMethods[0]) != nullptr;
+  }
+
+  void rebuild_reduction_methods() {
+    this->reductionMethods = this->is_sparse()
+                                 ? this->reduction_methods_for<MatSpD>()
+                                 : this->reduction_methods_for<MatDenD>();
+  }
+
 public:
   WeightedAutomatonModel()
-      : reductionMethods(
-            {std::make_shared<KieferSchuetzenbergerReduction<MatDenD>>()}),
+      : reductionMethods(reduction_methods_for<MatDenD>()),
         conversionMethods({}) {}
 
   ~WeightedAutomatonModel() override;
@@ -26,75 +55,210 @@ public:
     return "Weighted Automaton Model";
   }
 
+  // The same methods in the same order for both representations, s.t. a
+  // selected index stays valid after parsing switched to sparse matrices
+  template <Matrix M>
+  [[nodiscard]] auto reduction_methods_for() const
+      -> std::vector<std::shared_ptr<ReductionMethodInterface>> {
+    return {std::make_shared<KieferSchuetzenbergerReduction<M>>(),
+            std::make_shared<NumaKieferSchuetzenbergerReduction<M>>(),
+            std::make_shared<TruncatedSVDReduction<M>>(this->svdRank,
+                                                       this->svdTolerance),
+            std::make_shared<FiniteHorizonReduction<M>>(this->finiteHorizon)};
+  }
+
+  // Rank of the truncated SVD result, 0 selects the rank s.t. the discarded
+  // part of the Hankel matrix holds at most tolerance of its Frobenius norm
+  void set_svd_parameters(uint rank, double tolerance) {
+    if (!std::isfinite(tolerance) || tolerance < 0.0) {
+      throw std::invalid_argument(
+          "The SVD tolerance must be a finite non-negative number!");
+    }
+    this->svdRank = rank;
+    this->svdTolerance = tolerance;
+    this->rebuild_reduction_methods();
+  }
+
+  // Length up to which the finite horizon reduction preserves all words
+  void set_finite_horizon(uint horizon) {
+    this->finiteHorizon = horizon;
+    this->rebuild_reduction_methods();
+  }
+
+  // Whether the method only approximates the series, s.t. its result is not
+  // expected to be equivalent to the input
+  static auto
+  is_approximate(const std::shared_ptr<ReductionMethodInterface> &method)
+      -> bool {
+    return std::dynamic_pointer_cast<TruncatedSVDReduction<MatSpD>>(method) !=
+               nullptr ||
+           std::dynamic_pointer_cast<TruncatedSVDReduction<MatDenD>>(method) !=
+               nullptr ||
+           std::dynamic_pointer_cast<FiniteHorizonReduction<MatSpD>>(method) !=
+               nullptr ||
+           std::dynamic_pointer_cast<FiniteHorizonReduction<MatDenD>>(
+               method) != nullptr;
+  }
+
+  // Whether the method can write a certificate of its result
+  static auto
+  emits_certificate(const std::shared_ptr<ReductionMethodInterface> &method)
+      -> bool {
+    return std::dynamic_pointer_cast<KieferSchuetzenbergerReduction<MatSpD>>(
+               method) != nullptr ||
+           std::dynamic_pointer_cast<KieferSchuetzenbergerReduction<MatDenD>>(
+               method) != nullptr;
+  }
+
+  // Makes the Schützenberger reduction write a certificate of its result
+  static void
+  request_certificate(const std::shared_ptr<ReductionMethodInterface> &method,
+                      const std::string &path) {
+    if (auto sparse = std::dynamic_pointer_cast<
+            KieferSchuetzenbergerReduction<MatSpD>>(method)) {
+      sparse->set_certificate_path(path);
+    } else if (auto dense = std::dynamic_pointer_cast<
+                   KieferSchuetzenbergerReduction<MatDenD>>(method)) {
+      dense->set_certificate_path(path);
+    } else {
+      throw std::invalid_argument(
+          "Only the Schützenberger reduction emits certificates!");
+    }
+  }
+
+  // Relative error estimate of the last run of an approximate reduction,
+  // empty for the exact ones
+  static auto
+  estimated_error(const std::shared_ptr<ReductionMethodInterface> &method)
+      -> std::optional<double> {
+    if (auto sparse =
+            std::dynamic_pointer_cast<TruncatedSVDReduction<MatSpD>>(method)) {
+      return sparse->get_estimated_error();
+    }
+    if (auto dense = std::dynamic_pointer_cast<TruncatedSVDReduction<MatDenD>>(
+            method)) {
+      return dense->get_estimated_error();
+    }
+    return std::nullopt;
+  }
+
+  static auto
+  verify_certificate(const std::shared_ptr<RepresentationInterface> &original,
+                     const std::shared_ptr<RepresentationInterface> &reduced,
+                     const std::string &path) -> bool {
+    if (auto sparse =
+            std::dynamic_pointer_cast<WeightedAutomaton<MatSpD>>(original)) {
+      return ReductionCertificate<MatSpD>::read(path)->verify(
+          sparse, std::static_pointer_cast<WeightedAutomaton<MatSpD>>(reduced));
+    }
+    return ReductionCertificate<MatDenD>::read(path)->verify(
+        std::static_pointer_cast<WeightedAutomaton<MatDenD>>(original),
+        std::static_pointer_cast<WeightedAutomaton<MatDenD>>(reduced));
+  }
+
+  // Whether the file is in the binary format of MappedWeightedAutomaton
+  static auto is_binary(const std::string &path) -> bool {
+    return MappedWeightedAutomaton::is_binary(path);
+  }
+
+  // Maps a binary automaton instead of reading and parsing text. It is
+  // stored sparsely, so the sparse reductions are selected as for sparse
+  // text input.
+  auto load_binary(const std::string &path)
+      -> std::shared_ptr<RepresentationInterface> {
+    MappedWeightedAutomaton mapped(path);
+    this->reductionMethods = reduction_methods_for<MatSpD>();
+    auto automaton = mapped.to_automaton();
+    std::cout << "Loaded binary automaton successfully" << std::endl;
+    return automaton;
+  }
+
+  static void
+  write_binary(const std::shared_ptr<RepresentationInterface> &representation,
+               const std::string &path) {
+    if (auto sparse = std::dynamic_pointer_cast<WeightedAutomaton<MatSpD>>(
+            representation)) {
+      MappedWeightedAutomaton::write(*sparse, path);
+    } else {
+      MappedWeightedAutomaton::write(
+          *std::static_pointer_cast<WeightedAutomaton<MatDenD>>(
+              representation),
+          path);
+    }
+  }
+
   auto parse(std::string &str)
       -> std::shared_ptr<RepresentationInterface> override {
-    auto line = get_next_line(str, ";", TrimWhiteSpace);
-    if (!line.starts_with("input=dense")) {
-      if (line.starts_with("input=sparse")) {
-        this->reductionMethods = {
-            std::make_shared<KieferSchuetzenbergerReduction<MatSpD>>()};
-        return validate_model_instance_sparse(str);
+    ParseCursor cursor(str);
+    auto line = cursor.next(';');
+    if (!starts_with_ignoring_space(line, "input=dense")) {
+      if (starts_with_ignoring_space(line, "input=sparse")) {
+        this->reductionMethods = reduction_methods_for<MatSpD>();
+        return validate_model_instance_sparse(cursor.rest());
       }
       throw std::invalid_argument(
           "The input specification must be either using sparse or dense "
           "format and declare "
           "this in the first line as 'sparse' or 'dense'!");
     }
-    return validate_model_instance_dense(str);
+    return validate_model_instance_dense(cursor.rest());
   }
 
-  static auto validate_model_instance_dense(std::string &str)
+  static auto validate_model_instance_dense(std::string_view str)
       -> std::shared_ptr<RepresentationInterface> {
-    auto line = get_next_line(str, ";", TrimWhiteSpace);
+    ParseCursor cursor(str);
+    auto line = cursor.next(';');
 
     // states
-    if (!line.starts_with("states")) {
+    if (!starts_with_ignoring_space(line, "states")) {
       throw std::invalid_argument("The states must be specified first!");
     }
-    int states = std::stoi(line.substr(line.find('=') + 1, line.size()));
+    line.remove_prefix(line.find('=') + 1);
+    int states = extract_number<int>(line);
     if (states <= 0) {
       throw std::invalid_argument(
           "The number of states must be grater than zero!");
     }
 
     // fetch next line
-    line = get_next_line(str, ";", TrimWhiteSpace);
+    line = cursor.next(';');
 
     // characters
-    if (!line.starts_with("characters")) {
+    if (!starts_with_ignoring_space(line, "characters")) {
       throw std::invalid_argument(
           "The number of characters must be specified second!");
     }
-    int characters = std::stoi(line.substr(line.find('=') + 1, line.size()));
+    line.remove_prefix(line.find('=') + 1);
+    int characters = extract_number<int>(line);
     if (characters <= 0) {
       throw std::invalid_argument(
           "The number of states must be grater than zero!");
     }
 
     // fetch next line
-    line = get_next_line(str, ";", TrimWhiteSpace);
+    line = cursor.next(';');
 
     // alpha
-    if (!line.starts_with("alpha")) {
+    if (!starts_with_ignoring_space(line, "alpha")) {
       throw std::invalid_argument(
           "The initial vector needs to be specified as 3rd!");
     }
     MatDenDPtr alpha = std::make_shared<MatDenD>(1, states);
-    line = line.substr(line.find('=') + 1, line.size());
+    line.remove_prefix(line.find('=') + 1);
     for (int i = 0; i < states; i++) {
       alpha->coeffRef(0, i) = extract_number<double>(line);
     }
 
     // fetch next line
-    line = get_next_line(str, ";", TrimWhiteSpace);
+    line = cursor.next(';');
 
     // mu
     std::vector<MatDenDPtr> mu = {};
-    if (!line.starts_with("mu=(")) {
+    if (!starts_with_ignoring_space(line, "mu=(")) {
       throw std::invalid_argument(
           "Specify the transition matrices 4th, one for each character!");
     }
-    line = line.substr(line.find('=') + 1, line.size());
+    line.remove_prefix(line.find('=') + 1);
 
     MatDenDPtr muX;
     do {
@@ -106,21 +270,21 @@ public:
       }
       mu.push_back(muX);
 
-      if (!line.starts_with("))")) {
+      if (!starts_with_ignoring_space(line, "))")) {
         std::cout << line << std::endl;
         throw std::invalid_argument("A transition matrix should end here but "
                                     "read something different than ')),(('!");
       }
-    } while (!line.starts_with(")));") && !line.empty());
+    } while (!starts_with_ignoring_space(line, ")))") && !trim(line).empty());
 
     // fetch next line
-    line = get_next_line(str, ";", TrimWhiteSpace);
+    line = cursor.next(';');
 
-    if (!line.starts_with("eta")) {
+    if (!starts_with_ignoring_space(line, "eta")) {
       throw std::invalid_argument("Please specify the final state vector last");
     }
     MatDenDPtr eta = std::make_shared<MatDenD>(states, 1);
-    line = line.substr(line.find('=') + 1, line.size());
+    line.remove_prefix(line.find('=') + 1);
     for (int i = 0; i < states; i++) {
       eta->coeffRef(i, 0) = extract_number<double>(line);
     }
@@ -129,84 +293,184 @@ public:
                                                         alpha, mu, eta);
   }
 
-  static auto validate_model_instance_sparse(std::string &str)
+  // Appends the "letter row column value" entry of a sparse transition
+  // matrix to the triplets of its letter
+  static void
+  read_entry(std::string_view line, int characters, long states,
+             std::vector<std::vector<Eigen::Triplet<double, long>>> &entries) {
+    long letter = 0;
+    long row = 0;
+    long col = 0;
+    double value = 0.0;
+    if (!parse_number(line, letter) || !parse_number(line, row) ||
+        !parse_number(line, col) || !parse_number(line, value)) {
+      throw std::invalid_argument(
+          "A transition needs a letter, two states and a weight!");
+    }
+    if (letter < 0 || letter >= characters || row < 0 || row >= states ||
+        col < 0 || col >= states) {
+      throw std::invalid_argument("Transition out of range: " +
+                                  std::to_string(letter) + " " +
+                                  std::to_string(row) + " " +
+                                  std::to_string(col) + "!");
+    }
+    entries[static_cast<size_t>(letter)].emplace_back(row, col, value);
+  }
+
+  // Reads the ';' terminated entries of the transition matrices. Large
+  // sections are split at entry boundaries into chunks, which are parsed in
+  // parallel into triplets per letter. The triplets of a letter are joined in
+  // input order, so a later entry for a position still overwrites an earlier
+  // one, and each matrix is built by one setFromTriplets.
+  static auto read_transitions(std::string_view section, int characters,
+                               long states)
+      -> std::vector<std::shared_ptr<MatSpD>> {
+    using Triplets = std::vector<Eigen::Triplet<double, long>>;
+    auto letters = static_cast<size_t>(characters);
+    // THREADS is 0 on single core builds, the bounds must not cross
+    size_t chunks = std::clamp(section.size() / MIN_CHUNK_BYTES, size_t{1},
+                               std::max<size_t>(1, 4 * (THREADS)));
+    std::vector<size_t> bounds = {0};
+    for (size_t i = 1; i < chunks; i++) {
+      size_t pos = section.find(
+          ';', std::max(bounds.back(), i * (section.size() / chunks)));
+      if (pos == std::string_view::npos) {
+        break;
+      }
+      bounds.push_back(pos + 1);
+    }
+    bounds.push_back(section.size());
+
+    auto noChunks = static_cast<long>(bounds.size() - 1);
+    std::vector<std::vector<Triplets>> entries(
+        bounds.size() - 1, std::vector<Triplets>(letters));
+    std::vector<std::exception_ptr> errors(bounds.size() - 1);
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(section, bounds, entries, errors, noChunks, characters, states,     \
+           letters)
+    for (long i = 0; i < noChunks; i++) {
+      auto chunk = static_cast<size_t>(i);
+      try {
+        ParseCursor cursor(
+            section.substr(bounds[chunk], bounds[chunk + 1] - bounds[chunk]));
+        // every entry ends with a ';', which bounds the number of entries
+        size_t expected = count_char(cursor.rest(), ';') / letters + 1;
+        for (auto &letter : entries[chunk]) {
+          letter.reserve(expected);
+        }
+        while (!cursor.at_end()) {
+          auto line = cursor.next(';');
+          if (!line.empty()) {
+            read_entry(line, characters, states, entries[chunk]);
+          }
+        }
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+    }
+    for (const auto &error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+
+    std::vector<std::shared_ptr<MatSpD>> mu(letters);
+    auto noLetters = static_cast<long>(letters);
+#pragma omp parallel for default(none) num_threads(THREADS) if (!TEST)         \
+    shared(entries, mu, noLetters, states)
+    for (long l = 0; l < noLetters; l++) {
+      auto letter = static_cast<size_t>(l);
+      Triplets joined = std::move(entries[0][letter]);
+      for (size_t chunk = 1; chunk < entries.size(); chunk++) {
+        joined.insert(joined.end(), entries[chunk][letter].begin(),
+                      entries[chunk][letter].end());
+        Triplets().swap(entries[chunk][letter]);
+      }
+      mu[letter] = std::make_shared<MatSpD>(states, states);
+      mu[letter]->setFromTriplets(
+          joined.begin(), joined.end(),
+          [](const double &, const double &later) { return later; });
+    }
+    return mu;
+  }
+
+  static auto validate_model_instance_sparse(std::string_view str)
       -> std::shared_ptr<RepresentationInterface> {
-    size_t a = 0;
     long b = 0;
-    long c = 0;
     double d = 0.0;
-    auto line = get_next_line(str, ";", TrimNewLines);
+    ParseCursor cursor(str);
+    auto line = cursor.next(';');
 
     // states
-    if (!line.starts_with("states")) {
+    if (!starts_with_ignoring_space(line, "states")) {
       throw std::invalid_argument("The states must be specified first!");
     }
-    int states = std::stoi(line.substr(line.find('=') + 1, line.size()));
+    line.remove_prefix(line.find('=') + 1);
+    int states = extract_number<int>(line);
     if (states <= 0) {
       throw std::invalid_argument(
           "The number of states must be grater than zero!");
     }
 
     // fetch next line
-    line = get_next_line(str, ";", TrimNewLines);
+    line = cursor.next(';');
 
     // characters
-    if (!line.starts_with("characters")) {
+    if (!starts_with_ignoring_space(line, "characters")) {
       throw std::invalid_argument(
           "The number of characters must be specified second!");
     }
-    int characters = std::stoi(line.substr(line.find('=') + 1, line.size()));
+    line.remove_prefix(line.find('=') + 1);
+    int characters = extract_number<int>(line);
     if (characters <= 0) {
       throw std::invalid_argument(
           "The number of states must be grater than zero!");
     }
 
     // fetch next line
-    line = get_next_line(str, ";", TrimNewLines);
+    line = cursor.next(';');
 
     // alpha
-    if (!line.starts_with("alpha")) {
+    if (!starts_with_ignoring_space(line, "alpha")) {
       throw std::invalid_argument(
           "The initial vector needs to be specified as 3rd!");
     }
     auto alpha = std::make_shared<MatSpD>(1, states);
-    line = line.substr(line.find(':') + 1, line.size());
+    line.remove_prefix(line.find(':') + 1);
     b = extract_number<uint>(line);
     d = extract_number<double>(line);
+    if (b >= states) {
+      throw std::invalid_argument("Initial state out of range: " +
+                                  std::to_string(b) + "!");
+    }
     alpha->coeffRef(0, b) = d;
 
-    // fetch next line
-    line = get_next_line(str, ";", TrimNewLines);
-
-    // mu
-    std::vector<std::shared_ptr<MatSpD>> mu = {};
-    if (!line.starts_with("mu")) {
+    // mu, up to the keyword of the final vector
+    std::string_view rest = cursor.rest();
+    if (!starts_with_ignoring_space(rest, "mu")) {
       throw std::invalid_argument(
           "Specify the transition matrices 4th, one for each character!");
     }
-    line = line.substr(line.find(':') + 1, line.size());
-    for (int i = 0; i < characters; i++) {
-      mu.emplace_back(std::make_shared<MatSpD>(states, states));
-    }
-
-    do {
-      a = extract_number<size_t>(line);
-      b = extract_number<long>(line);
-      c = extract_number<long>(line);
-      d = extract_number<double>(line);
-      mu[a]->coeffRef(b, c) = d;
-
-      // fetch next line
-      line = get_next_line(str, ";", TrimNewLines);
-    } while (!line.starts_with("eta") && !line.empty());
-
-    if (!line.starts_with("eta")) {
-      throw std::logic_error("Unreachable;");
+    size_t etaPos = rest.find("eta");
+    if (etaPos == std::string_view::npos) {
+      throw std::invalid_argument("Please specify the final state vector last");
     }
+    std::string_view section = rest.substr(0, etaPos);
+    section.remove_prefix(section.find(':') + 1);
+    std::vector<std::shared_ptr<MatSpD>> mu =
+        read_transitions(section, characters, states);
+
+    // eta
+    cursor = ParseCursor(rest.substr(etaPos));
+    line = cursor.next(';');
     auto eta = std::make_shared<MatSpD>(states, 1);
-    line = line.substr(line.find(':') + 1, line.size());
+    line.remove_prefix(line.find(':') + 1);
     b = extract_number<uint>(line);
     d = extract_number<double>(line);
+    if (b >= states) {
+      throw std::invalid_argument("Final state out of range: " +
+                                  std::to_string(b) + "!");
+    }
     eta->coeffRef(b, 0) = d;
     std::cout << "Parsed Automaton successfully" << std::endl;
 
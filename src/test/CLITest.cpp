@@ -146,6 +146,32 @@ SCENARIO("The program can be called from the command line", "[CLI]") {
                                  "write the results to!\n"));
       }
     }
+    WHEN("A certificate is requested from a method that emits none") {
+      std::vector<std::string> args = {
+          "./ssm", "-t", "Reduction",
+          "-m",    "WA", "-r",
+          "SVD",   "-i", "../src/test/test_input_sparse.txt",
+          "-o",    "out.txt", "-C",
+          "certificate.bin"};
+      std::string output = execute("./ssm", args, "");
+      THEN("An error message is displayed") {
+        REQUIRE(output.ends_with(
+            "Only the Schützenberger reduction emits certificates!\n"));
+      }
+    }
+    WHEN("An approximate reduction is given its horizon") {
+      std::vector<std::string> args = {
+          "./ssm", "-t", "Reduction",
+          "-m",    "WA", "-r",
+          "Finite", "-k", "2",
+          "-i",    "../src/test/test_input_sparse.txt",
+          "-o",    "out.txt"};
+      std::string output = execute("./ssm", args, "");
+      THEN("The exact equivalence check is skipped") {
+        REQUIRE(output.ends_with(
+            "Skipped Equivalence check: the reduction is approximate\n"));
+      }
+    }
   }
 }
 
@@ -192,6 +218,40 @@ SCENARIO("Equivalence") {
                            [](auto a, auto b) { return a == b; }));
       }
     }
+    WHEN("Storing the input in the binary format") {
+      args = {"./ssm",
+              "-t",
+              "Equivalence",
+              "-m",
+              "WA",
+              "-i",
+              "../src/test/test_input_sparse.txt",
+              "-c",
+              "../src/test/test_input_sparse.txt",
+              "-o",
+              "equi_test/out_binary.txt",
+              "-b",
+              "equi_test/input.wab"};
+      std::string output = execute("./ssm", args, "");
+      THEN("The mapped file is equivalent to the text input") {
+        REQUIRE(output.find("Wrote binary automaton") != std::string::npos);
+        args = {"./ssm",
+                "-t",
+                "Equivalence",
+                "-m",
+                "WA",
+                "-i",
+                "equi_test/input.wab",
+                "-c",
+                "../src/test/test_input_sparse.txt",
+                "-o",
+                "equi_test/out_binary.txt"};
+        output = execute("./ssm", args, "");
+        REQUIRE(output.find("Loaded binary automaton") != std::string::npos);
+        REQUIRE(UserInterface::read_file("equi_test/out_binary.txt") ==
+                "equivalent");
+      }
+    }
   }
 }
 
@@ -1,8 +1,12 @@
 #include <catch2/catch.hpp>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <vector>
 
+#include "../models/weighted_automata/FiniteHorizonReduction.h"
+#include "../models/weighted_automata/NumaKieferSchuetzenbergerReduction.h"
+#include "../models/weighted_automata/TruncatedSVDReduction.h"
 #include "../models/weighted_automata/WeightedAutomatonModel.h"
 #include "../util/FloatingPointCompare.h"
 #include "TestUtils.h"
@@ -307,5 +311,252 @@ SCENARIO("The reduced automaton accepts the same words with the same weights") {
         }
       }
     }
+    WHEN("Reducing it with a cancelled deadline") {
+      Deadline deadline;
+      deadline.cancel();
+      auto reducedRI = KieferSchuetzenbergerReduction<MatSpD>().reduce(
+          wa, deadline);
+      auto reducedWA =
+          static_pointer_cast<WeightedAutomaton<MatSpD>>(reducedRI);
+      std::vector<std::vector<unsigned int>> words;
+      generate_words(wa->get_states(), wa->get_number_input_characters(),
+                     words);
+      THEN("The last completed stage is returned") {
+        REQUIRE(reducedWA->get_states() == wa->get_states());
+        for (const auto &word : words) {
+          REQUIRE(floating_point_compare(
+              wa->process_word(word) - reducedWA->process_word(word), 0.0));
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("The NUMA multi-process reduction yields the same result as the "
+         "shared memory one") {
+  GIVEN("An automaton A and fixed random vectors R") {
+    auto wa = gen_wa_dense();
+    auto randV = gen_fixed_rand_v();
+    WHEN("calculating the forward reduction with two worker processes") {
+      auto expected =
+          KieferSchuetzenbergerReduction<MatDenD>::forward_reduction(wa, randV);
+      NumaKieferSchuetzenbergerReduction<MatDenD>::WorkerPool pool(wa, 2);
+      auto minWA = NumaKieferSchuetzenbergerReduction<
+          MatDenD>::forward_reduction(wa, randV, pool);
+      THEN("the reduced automata are the same") {
+        REQUIRE(minWA->get_states() == expected->get_states());
+        REQUIRE((minWA->get_alpha())->isApprox(*(expected->get_alpha())));
+        REQUIRE((minWA->get_eta())->isApprox(*(expected->get_eta())));
+        for (size_t i = 0; i < 2; i++) {
+          REQUIRE((minWA->get_mu()[i])->isApprox(*(expected->get_mu()[i])));
+        }
+      }
+    }
+  }
+  GIVEN("The running example in sparse representation") {
+    auto wa = gen_wa_sparse();
+    WHEN("Reducing it using one worker per letter") {
+      auto reducedRI =
+          NumaKieferSchuetzenbergerReduction<MatSpD>::reduce(wa, 100, 2);
+      auto reducedWA =
+          static_pointer_cast<WeightedAutomaton<MatSpD>>(reducedRI);
+      std::vector<std::vector<unsigned int>> words;
+      generate_words(wa->get_states(), wa->get_number_input_characters(),
+                     words);
+      THEN("Evaluating different words yields the same result") {
+        REQUIRE(reducedWA->get_states() == 3);
+        for (const auto &word : words) {
+          REQUIRE(floating_point_compare(
+              wa->process_word(word) - reducedWA->process_word(word), 0.0));
+        }
+      }
+    }
+    WHEN("Reducing it with a cancelled deadline") {
+      Deadline deadline;
+      deadline.cancel();
+      auto reducedWA = static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          NumaKieferSchuetzenbergerReduction<MatSpD>::reduce(wa, 100, 2, false,
+                                                             deadline));
+      THEN("The input is returned as the last completed stage") {
+        REQUIRE(reducedWA == wa);
+      }
+    }
+  }
+}
+
+SCENARIO("The truncated SVD reduction approximates the series") {
+  GIVEN("The running example in sparse representation") {
+    auto wa = gen_wa_sparse();
+    std::vector<std::vector<unsigned int>> words;
+    generate_words(wa->get_states(), wa->get_number_input_characters(), words);
+    double error = -1.0;
+    WHEN("Truncating only numerically zero singular values") {
+      auto reducedRI = TruncatedSVDReduction<MatSpD>::reduce(wa, 0, 1e-9,
+                                                             &error, 100, true);
+      auto reducedWA =
+          static_pointer_cast<WeightedAutomaton<MatSpD>>(reducedRI);
+      THEN("The minimal automaton is computed exactly") {
+        REQUIRE(reducedWA->get_states() == 3);
+        REQUIRE(error < 1e-9);
+        for (const auto &word : words) {
+          REQUIRE(floating_point_compare(
+              wa->process_word(word) - reducedWA->process_word(word), 0.0));
+        }
+      }
+    }
+    WHEN("Requesting a rank below the minimal one") {
+      auto reducedRI =
+          TruncatedSVDReduction<MatSpD>::reduce(wa, 2, 0.0, &error, 100, true);
+      auto reducedWA =
+          static_pointer_cast<WeightedAutomaton<MatSpD>>(reducedRI);
+      THEN("The automaton is smaller and the error is reported") {
+        REQUIRE(reducedWA->get_states() == 2);
+        REQUIRE(error > 0.0);
+        REQUIRE(error < 1.0);
+      }
+    }
+  }
+  GIVEN("A weighted automaton model with a fixed SVD rank") {
+    WeightedAutomatonModel model;
+    model.set_svd_parameters(2, 0.0);
+    WHEN("Parsing switches the methods to sparse matrices") {
+      std::ifstream file("../src/test/test_input_sparse.txt");
+      std::stringstream buffer;
+      buffer << file.rdbuf();
+      std::string input = buffer.str();
+      auto wa = model.parse(input);
+      auto svd = std::dynamic_pointer_cast<TruncatedSVDReduction<MatSpD>>(
+          model.get_reduction_methods()[2]);
+      THEN("The sparse method keeps the parameters") {
+        REQUIRE(svd != nullptr);
+        REQUIRE(svd->get_target_rank() == 2);
+        REQUIRE(svd->get_tolerance() == 0.0);
+        auto reducedWA = std::static_pointer_cast<WeightedAutomaton<MatSpD>>(
+            svd->reduce(wa));
+        REQUIRE(reducedWA->get_states() == 2);
+      }
+    }
+    WHEN("Setting a negative tolerance") {
+      THEN("The parameters are rejected") {
+        REQUIRE_THROWS_AS(model.set_svd_parameters(0, -1.0),
+                          std::invalid_argument);
+      }
+    }
+  }
+}
+
+SCENARIO("The finite horizon reduction preserves all words up to length k") {
+  GIVEN("A chain of six states accepting a^j for j < 6") {
+    uint states = 6;
+    MatSpDPtr alpha = std::make_shared<MatSpD>(1, states);
+    alpha->coeffRef(0, 0) = 1.0;
+    MatSpDPtr eta = std::make_shared<MatSpD>(states, 1);
+    MatSpDPtr mu = std::make_shared<MatSpD>(states, states);
+    for (uint i = 0; i < states; i++) {
+      eta->coeffRef(i, 0) = 1.0;
+      if (i + 1 < states) {
+        mu->coeffRef(i, i + 1) = 1.0;
+      }
+    }
+    std::vector<MatSpDPtr> mus = {mu};
+    auto wa =
+        std::make_shared<WeightedAutomaton<MatSpD>>(states, 1, alpha, mus, eta);
+    WHEN("Reducing it with horizon 2") {
+      auto reducedWA = static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          FiniteHorizonReduction<MatSpD>::reduce(wa, 2));
+      THEN("The result is smaller than the minimal automaton and agrees on "
+           "all words up to length 2") {
+        REQUIRE(reducedWA->get_states() == 3);
+        REQUIRE(floating_point_compare(reducedWA->process_word({}), 1.0));
+        REQUIRE(floating_point_compare(reducedWA->process_word({0}), 1.0));
+        REQUIRE(floating_point_compare(reducedWA->process_word({0, 0}), 1.0));
+      }
+    }
+  }
+  GIVEN("The running example in dense representation") {
+    auto wa = gen_wa_dense();
+    std::vector<std::vector<unsigned int>> words;
+    generate_words(2, wa->get_number_input_characters(), words);
+    WHEN("Reducing it with a horizon covering all accepted words") {
+      auto reducedWA = static_pointer_cast<WeightedAutomaton<MatDenD>>(
+          FiniteHorizonReduction<MatDenD>(2).reduce(wa));
+      THEN("The minimal automaton is obtained") {
+        REQUIRE(reducedWA->get_states() == 3);
+        for (const auto &word : words) {
+          REQUIRE(floating_point_compare(
+              wa->process_word(word) - reducedWA->process_word(word), 0.0));
+        }
+      }
+    }
+  }
+  GIVEN("A weighted automaton model with horizon 3") {
+    WeightedAutomatonModel model;
+    model.set_finite_horizon(3);
+    WHEN("Parsing switches the methods to sparse matrices") {
+      std::ifstream file("../src/test/test_input_sparse.txt");
+      std::stringstream buffer;
+      buffer << file.rdbuf();
+      std::string input = buffer.str();
+      auto wa = model.parse(input);
+      auto methods = model.get_reduction_methods();
+      auto finite =
+          std::dynamic_pointer_cast<FiniteHorizonReduction<MatSpD>>(methods[3]);
+      THEN("The sparse method keeps the horizon and counts as approximate") {
+        REQUIRE(finite != nullptr);
+        REQUIRE(finite->get_horizon() == 3);
+        REQUIRE(WeightedAutomatonModel::is_approximate(methods[3]));
+        REQUIRE(WeightedAutomatonModel::is_approximate(methods[2]));
+        REQUIRE_FALSE(WeightedAutomatonModel::is_approximate(methods[0]));
+      }
+    }
+  }
+}
+
+SCENARIO("A reduction certificate proves the reduction correct") {
+  GIVEN("The running example in sparse representation") {
+    auto wa = gen_wa_sparse();
+    std::shared_ptr<ReductionCertificate<MatSpD>> certificate = nullptr;
+    WHEN("Reducing it and storing the certificate") {
+      auto reducedWA = static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          KieferSchuetzenbergerReduction<MatSpD>::reduce(
+              wa, 100, false, Deadline(), &certificate));
+      certificate->write("certificate.bin");
+      auto loaded = ReductionCertificate<MatSpD>::read("certificate.bin");
+      THEN("The loaded certificate verifies the result") {
+        REQUIRE(loaded->get_forward_basis().isApprox(
+            certificate->get_forward_basis()));
+        REQUIRE(loaded->verify(wa, reducedWA));
+      }
+      THEN("It rejects a different automaton") {
+        auto eta = std::make_shared<MatSpD>(*(reducedWA->get_eta()) * 2.0);
+        auto wrongWA = std::make_shared<WeightedAutomaton<MatSpD>>(
+            reducedWA->get_states(), reducedWA->get_number_input_characters(),
+            reducedWA->get_alpha(), reducedWA->get_mu(), eta);
+        REQUIRE_FALSE(loaded->verify(wa, wrongWA));
+      }
+      THEN("A certificate claiming more columns than it holds is rejected") {
+        std::fstream file("certificate.bin",
+                          std::ios::binary | std::ios::in | std::ios::out);
+        // the columns of the forward basis follow the magic, the number of
+        // letters and its rows
+        const int64_t cols = int64_t{1} << 62U;
+        file.seekp(24);
+        file.write(reinterpret_cast<const char *>(&cols), sizeof(cols));
+        file.close();
+        REQUIRE_THROWS_AS(ReductionCertificate<MatSpD>::read("certificate.bin"),
+                          std::invalid_argument);
+      }
+    }
+    WHEN("The deadline expires before the reduction finishes") {
+      Deadline deadline;
+      deadline.cancel();
+      auto reducedWA = static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          KieferSchuetzenbergerReduction<MatSpD>::reduce(wa, 100, false,
+                                                         deadline,
+                                                         &certificate));
+      THEN("The certificate still verifies the returned automaton") {
+        REQUIRE(certificate->verify(wa, reducedWA));
+      }
+    }
   }
 }
@@ -3,6 +3,7 @@
 #include "../models/rewrite_systems/RewriteSystemModel.h"
 #include "../ui/UserInterface.h"
 #include "../util/ParseUtils.h"
+#include "../util/RateGrouping.h"
 
 SCENARIO("Parsing rules with many multiplicities works") {
   GIVEN("A rule with lots of multiplicities in the species") {
@@ -39,6 +40,86 @@ SCENARIO("Parsing rules with many multiplicities works") {
   }
 }
 
+SCENARIO("Species are interned by composition and spelling") {
+  GIVEN("Rules spelling the same species with permuted atoms") {
+    std::string input = "Au + B -> AuB , 1.0\n"
+                        "BAu -> Au + B , 2.0";
+    auto model = std::make_shared<RewriteSystemModel>();
+    WHEN("Parsing the rules") {
+      auto rs = std::static_pointer_cast<RewriteSystem>(model->parse(input));
+      const SpeciesDictionary &dictionary = rs->get_species_dictionary();
+      THEN("both spellings map to one species") {
+        REQUIRE(rs->get_species_list().size() == 3);
+        REQUIRE(dictionary.find_species(std::string("AuB")) == 2);
+        REQUIRE(dictionary.find_species(std::string("BAu")) == 2);
+        REQUIRE(dictionary.find_species(std::vector<unsigned int>{1, 1}) == 2);
+        REQUIRE(rs->get_name_for_species(2) == "AuB");
+        REQUIRE(rs->get_rules()[1]->get_lhs()[0][1] == 2);
+      }
+    }
+    WHEN("Constructing a dictionary with a duplicate species") {
+      THEN("it is rejected") {
+        REQUIRE_THROWS_AS(
+            SpeciesDictionary({"A", "B"}, {{1, 0}, {0, 1}, {1, 0}}),
+            std::invalid_argument);
+      }
+    }
+    WHEN("Constructing a dictionary with adjacent duplicates") {
+      THEN("it is rejected") {
+        REQUIRE_THROWS_AS(SpeciesDictionary({"A", "A"}, {}),
+                          std::invalid_argument);
+        REQUIRE_THROWS_AS(SpeciesDictionary({"A", "B"}, {{1, 0}, {1, 0}}),
+                          std::invalid_argument);
+        REQUIRE_THROWS_AS(
+            SpeciesDictionary({"A", "B"}, {{0, 1}, {1, 0}, {1, 0}}),
+            std::invalid_argument);
+      }
+    }
+  }
+}
+
+SCENARIO("Rewrite systems are compared by their canonical form") {
+  GIVEN("One network written with permuted atoms, rules and terms") {
+    std::string input = "Au + B -> AuB , 1.0\n"
+                        "B -> 2C , 2.0";
+    std::string permutedInput = "B -> C + C , 1.5\n"
+                                "B + Au -> BAu , 1.0\n"
+                                "B -> 2C , 0.5";
+    std::string otherInput = "Au + B -> AuB , 1.0\n"
+                             "B -> 2C , 2.5";
+    auto model = std::make_shared<RewriteSystemModel>();
+    auto rs = std::static_pointer_cast<RewriteSystem>(model->parse(input));
+    auto permuted =
+        std::static_pointer_cast<RewriteSystem>(model->parse(permutedInput));
+    auto other =
+        std::static_pointer_cast<RewriteSystem>(model->parse(otherInput));
+    WHEN("normalizing both") {
+      CanonicalRewriteSystem form = rs->canonical_form();
+      CanonicalRewriteSystem permutedForm = permuted->canonical_form();
+      THEN("duplicate rules are merged and the forms agree") {
+        REQUIRE(permutedForm.get_rates().size() == 2);
+        REQUIRE(form.get_hash() == permutedForm.get_hash());
+        REQUIRE(form.equals(permutedForm));
+        REQUIRE(rs->equivalent(permuted));
+        REQUIRE(permuted->equivalent(rs));
+      }
+      THEN("a different rate breaks the equivalence but not the hash") {
+        REQUIRE(form.get_hash() == other->canonical_form().get_hash());
+        REQUIRE(!rs->equivalent(other));
+      }
+    }
+    WHEN("comparing rules with split terms") {
+      auto rule = std::make_shared<RewriteSystem::Rule>(
+          2.0, std::vector<std::array<unsigned int, 2>>{{1, 1}, {1, 1}},
+          std::vector<std::array<unsigned int, 2>>{{1, 2}});
+      auto merged = std::make_shared<RewriteSystem::Rule>(
+          2.0, std::vector<std::array<unsigned int, 2>>{{2, 1}},
+          std::vector<std::array<unsigned int, 2>>{{1, 2}});
+      THEN("they are equivalent") { REQUIRE(rule->equivalent(merged)); }
+    }
+  }
+}
+
 SCENARIO("Parsing an example file yields the correctly initialized data "
          "structures") {
   GIVEN("The example form the PNAS paper, Figure 1 as a file in erode "
@@ -106,6 +187,32 @@ SCENARIO("Parsing an example file yields the correctly initialized data "
   }
 }
 
+SCENARIO("Rules are stored as stoichiometry matrices") {
+  GIVEN("The parsed example") {
+    std::string input =
+        UserInterface::read_file("../src/test/stoichometric_input.txt");
+    auto model = std::make_shared<RewriteSystemModel>();
+    auto rs = std::static_pointer_cast<RewriteSystem>(model->parse(input));
+    WHEN("reading the fifth rule Apu + B -> ApuB, 3.0") {
+      const Stoichiometry &lhs = rs->get_lhs_matrix();
+      const Stoichiometry &rhs = rs->get_rhs_matrix();
+      THEN("the rows and the rule view agree") {
+        REQUIRE(rs->get_number_of_rules() == 8);
+        REQUIRE(lhs.rules() == 8);
+        REQUIRE(std::vector<unsigned int>(lhs.species_of(4).begin(),
+                                          lhs.species_of(4).end()) ==
+                std::vector<unsigned int>{1, 3});
+        REQUIRE(lhs.factor(4, 3) == 1);
+        REQUIRE(lhs.factor(4, 4) == 0);
+        REQUIRE(rhs.size(4) == 1);
+        REQUIRE(rs->get_rates()[4] == 3.0);
+        REQUIRE(rs->get_rule(4)->equivalent(std::make_shared<RewriteSystem::Rule>(
+            3.0, lhs.terms(4), std::vector<std::array<unsigned int, 2>>{{1, 4}})));
+      }
+    }
+  }
+}
+
 SCENARIO("Initializations of the necessary data structures for reduction works "
          "as intended") {
   GIVEN("Parsed input") {
@@ -142,14 +249,14 @@ SCENARIO("Initializations of the necessary data structures for reduction works "
 
         std::vector<unsigned long> trueMcoeffs = {1, 1, 1, 1, 2, 1, 2, 1};
 
-        const std::set<std::vector<std::array<unsigned int, 2>>> actualLabels =
-            reduction.get_reactant_labels();
+        const ReactantLabelTable &actualLabels = reduction.get_reactant_labels();
         REQUIRE(truePossibleReagents.size() == actualLabels.size());
-        size_t k = 0;
-        for (const auto &elem : actualLabels) {
-          REQUIRE(MaximalAggregation::equal_reagents(elem,
-                                                     truePossibleReagents[k]));
-          k++;
+        for (size_t k = 0; k < actualLabels.size(); k++) {
+          auto label = actualLabels.label(static_cast<long>(k));
+          REQUIRE(MaximalAggregation::equal_reagents(
+              std::vector(label.begin(), label.end()), truePossibleReagents[k]));
+          REQUIRE(actualLabels.find(truePossibleReagents[k]) ==
+                  static_cast<long>(k));
         }
 
         std::vector<std::vector<long>> labelPos = reduction.get_label_pos();
@@ -208,9 +315,10 @@ SCENARIO("Test Parsing Helpers") {
     WHEN("extracting the atomic names (i.e. of all Strings that start with a "
          "capital letter followed by one or more lower letters") {
       THEN("it parses then successfully") {
-        std::string name;
+        std::string_view view = input;
+        std::string_view name;
         for (size_t i = 0; i < result.size(); i++) {
-          name = extract_atomic_name(input);
+          name = extract_atomic_name(view);
           REQUIRE(result[i] == name);
         }
       }
@@ -218,6 +326,41 @@ SCENARIO("Test Parsing Helpers") {
   }
 }
 
+SCENARIO("The parse cursor splits without copying") {
+  GIVEN("Rules separated by blank lines, one of them without reagents") {
+    std::string input = "begin reactions\n"
+                        "  2 Au + B -> AuB , 1.5\n"
+                        "\n"
+                        "  -> Au , 2.0\n"
+                        "end reactions\n";
+    WHEN("splitting it into lines") {
+      ParseCursor cursor(input);
+      std::vector<std::string_view> lines = {};
+      while (!cursor.at_end()) {
+        lines.push_back(cursor.next('\n'));
+      }
+      THEN("the lines are trimmed views into the input") {
+        REQUIRE(lines.size() == 5);
+        REQUIRE(lines[1] == "2 Au + B -> AuB , 1.5");
+        REQUIRE(lines[2].empty());
+        REQUIRE(lines[1].data() == input.data() + input.find('2'));
+      }
+    }
+    WHEN("parsing it") {
+      auto model = std::make_shared<RewriteSystemModel>();
+      auto rs = std::static_pointer_cast<RewriteSystem>(model->parse(input));
+      THEN("both rules are read and the input is left intact") {
+        REQUIRE(rs->get_number_of_rules() == 2);
+        REQUIRE(rs->get_lhs_matrix().terms(0) ==
+                std::vector<std::array<unsigned int, 2>>{{2, 0}, {1, 1}});
+        REQUIRE(rs->get_lhs_matrix().size(1) == 0);
+        REQUIRE(rs->get_rates()[1] == 2.0);
+        REQUIRE(input.starts_with("begin reactions"));
+      }
+    }
+  }
+}
+
 SCENARIO("Test the split predicate") {
   GIVEN(
       "The example from the PNAS paper, parsed and the reduction initialized") {
@@ -237,9 +380,8 @@ SCENARIO("Test the split predicate") {
     reduction.set_system(rs);
     reduction.init();
     WHEN("computing the forward rate") {
-      std::set<unsigned int> nZRS = std::set<unsigned int>();
       for (size_t i = 0; i < initBlock.size(); i++) {
-        reduction.compute_forward_rate(initBlock[i], nZRS);
+        reduction.compute_forward_rate(initBlock[i]);
         std::cout << *(reduction.get_m()) << std::endl;
       }
       THEN("the correct values are computed") {
@@ -281,9 +423,251 @@ SCENARIO(
     reduction.set_system(rs);
     reduction.init();
     WHEN("computing the forward reduction") {
-      reduction.largest_equivalent_parition(true);
-      reduction.apply_reduction();
-      THEN("the correct reductions are computed") {}
+      auto partition = reduction.largest_equivalent_parition(true);
+      auto reduced = reduction.apply_reduction();
+      THEN("the correct reductions are computed") {
+        std::vector<std::vector<unsigned int>> truePartition = {
+            {0}, {1, 2}, {3}, {4, 5}};
+        for (auto &block : partition) {
+          std::sort(block.begin(), block.end());
+        }
+        std::sort(partition.begin(), partition.end());
+        REQUIRE(partition == truePartition);
+      }
+      THEN("the quotient lumps the blocks and merges the rules") {
+        REQUIRE(reduced->get_species_list().size() == 4);
+        REQUIRE(reduced->get_mapping().size() ==
+                rs->get_mapping().size() + 2);
+        std::vector<std::shared_ptr<RewriteSystem::Rule>> trueRules = {
+            std::make_shared<RewriteSystem::Rule>(
+                2.0, std::vector<std::array<unsigned int, 2>>{{1, 0}},
+                std::vector<std::array<unsigned int, 2>>{{1, 1}}),
+            std::make_shared<RewriteSystem::Rule>(
+                2.0, std::vector<std::array<unsigned int, 2>>{{1, 1}},
+                std::vector<std::array<unsigned int, 2>>{{1, 0}}),
+            std::make_shared<RewriteSystem::Rule>(
+                3.0, std::vector<std::array<unsigned int, 2>>{{1, 1}, {1, 2}},
+                std::vector<std::array<unsigned int, 2>>{{1, 3}}),
+            std::make_shared<RewriteSystem::Rule>(
+                4.0, std::vector<std::array<unsigned int, 2>>{{1, 3}},
+                std::vector<std::array<unsigned int, 2>>{{1, 1}, {1, 2}})};
+        REQUIRE(reduced->get_rules().size() == trueRules.size());
+        for (size_t i = 0; i < trueRules.size(); i++) {
+          REQUIRE(reduced->get_rules()[i]->equivalent(trueRules[i]));
+        }
+      }
+    }
+    WHEN("computing the forward reduction with batches of splitters") {
+      MaximalAggregation parallel(3);
+      parallel.set_part(initPart);
+      parallel.set_system(rs);
+      auto partition = parallel.largest_equivalent_parition(true);
+      THEN("the partition equals the sequential one") {
+        std::vector<std::vector<unsigned int>> truePartition = {
+            {0}, {1, 2}, {3}, {4, 5}};
+        for (auto &block : partition) {
+          std::sort(block.begin(), block.end());
+        }
+        std::sort(partition.begin(), partition.end());
+        REQUIRE(partition == truePartition);
+      }
+    }
+    WHEN("computing the backward partition with a batch size above one") {
+      MaximalAggregation sequential;
+      sequential.set_part(initPart);
+      sequential.set_system(rs);
+      auto expected = sequential.largest_equivalent_parition(false);
+      MaximalAggregation parallel(3);
+      parallel.set_part(initPart);
+      parallel.set_system(rs);
+      auto partition = parallel.largest_equivalent_parition(false);
+      THEN("the splitters are processed one by one as sequentially") {
+        for (auto *blocks : {&expected, &partition}) {
+          for (auto &block : *blocks) {
+            std::sort(block.begin(), block.end());
+          }
+          std::sort(blocks->begin(), blocks->end());
+        }
+        REQUIRE(partition == expected);
+      }
+    }
+  }
+}
+
+SCENARIO("Updating the forward partition after adding a rule") {
+  GIVEN("The example from the PNAS paper and its forward partition") {
+    std::string input =
+        UserInterface::read_file("../src/test/stoichometric_input.txt");
+    auto model = std::make_shared<RewriteSystemModel>();
+    auto rs = std::static_pointer_cast<RewriteSystem>(model->parse(input));
+    std::vector<std::vector<unsigned int>> previous = {
+        {0}, {1, 2}, {3}, {4, 5}};
+    WHEN("adding a rule that consumes only one of two equivalent species") {
+      auto rule = std::make_shared<RewriteSystem::Rule>(
+          1.0, std::vector<std::array<unsigned int, 2>>{{1, 1}},
+          std::vector<std::array<unsigned int, 2>>{{1, 3}});
+      std::vector<std::shared_ptr<RewriteSystem::Rule>> rules =
+          rs->get_rules();
+      rules.push_back(rule);
+      auto changed = std::make_shared<RewriteSystem>(
+          rs->get_mapping(), rs->get_species_list(), rules);
+
+      MaximalAggregation aggregation;
+      auto updated = aggregation.update_partition(changed, previous, {rule});
+      MaximalAggregation scratch;
+      scratch.set_system(changed);
+      scratch.set_part({{0, 1, 2, 3, 4, 5}});
+      auto expected = scratch.largest_equivalent_parition(true);
+      THEN("the partition equals the one computed from scratch") {
+        for (auto *partition : {&updated, &expected}) {
+          for (auto &block : *partition) {
+            std::sort(block.begin(), block.end());
+          }
+          std::sort(partition->begin(), partition->end());
+        }
+        REQUIRE(updated == expected);
+        REQUIRE(updated.size() > previous.size());
+      }
+    }
+    WHEN("the delta refers to an unknown species") {
+      auto rule = std::make_shared<RewriteSystem::Rule>(
+          1.0, std::vector<std::array<unsigned int, 2>>{{1, 7}},
+          std::vector<std::array<unsigned int, 2>>{{1, 3}});
+      MaximalAggregation aggregation;
+      THEN("it is rejected") {
+        REQUIRE_THROWS_AS(aggregation.update_partition(rs, previous, {rule}),
+                          std::invalid_argument);
+      }
+    }
+  }
+}
+
+SCENARIO("The refinable partition keeps the species to block map") {
+  GIVEN("A partition of six species into two blocks") {
+    RefinablePartition partition({{0, 1, 2, 3}, {4, 5}});
+    WHEN("marking species and splitting a block into groups") {
+      partition.mark(1);
+      partition.mark(3);
+      REQUIRE(partition.contains_marked(0));
+      REQUIRE_FALSE(partition.contains_marked(1));
+      REQUIRE(partition.marked_count(0) == 2);
+      auto newBlocks = partition.split(0, {{1}, {3}});
+      partition.unmark_all();
+      THEN("each group forms a block of its own") {
+        REQUIRE(newBlocks.size() == 2);
+        REQUIRE(partition.size() == 4);
+        REQUIRE(partition.get_block_number(0) == 0);
+        REQUIRE(partition.get_block_number(2) == 0);
+        REQUIRE(partition.block_size(0) == 2);
+        REQUIRE(partition.get_block_number(1) != partition.get_block_number(3));
+        REQUIRE(partition.block_size(partition.get_block_number(1)) == 1);
+        REQUIRE(partition.get_block_number(5) == 1);
+        REQUIRE_FALSE(partition.contains_marked(0));
+      }
+    }
+    WHEN("splitting a block into groups covering it") {
+      auto newBlocks = partition.split(1, {{5}, {4}});
+      THEN("the first group keeps the block number") {
+        REQUIRE(newBlocks.size() == 1);
+        REQUIRE(partition.get_block_number(5) == 1);
+        REQUIRE(partition.get_block_number(4) == newBlocks[0]);
+      }
+    }
+    WHEN("a species is contained twice") {
+      THEN("construction fails") {
+        REQUIRE_THROWS_AS(RefinablePartition({{0, 1}, {1}}),
+                          std::invalid_argument);
+      }
+    }
+  }
+}
+
+SCENARIO("The splitter queue holds each block at most once") {
+  GIVEN("An empty queue") {
+    MaximalAggregation::SplitterQueue splitters;
+    WHEN("pushing a block twice") {
+      splitters.push(3);
+      splitters.push(1);
+      splitters.push(3);
+      THEN("it is popped once") {
+        REQUIRE(splitters.contains(3));
+        REQUIRE_FALSE(splitters.contains(0));
+        REQUIRE(splitters.pop() == 1);
+        REQUIRE(splitters.pop() == 3);
+        REQUIRE(splitters.empty());
+        REQUIRE_FALSE(splitters.contains(3));
+      }
+    }
+  }
+}
+
+SCENARIO("Rates are grouped by the comparison tolerance") {
+  GIVEN("An empty grouping") {
+    RateGrouping grouping;
+    WHEN("inserting values that are close to their neighbours") {
+      size_t zero = grouping.insert(0.0);
+      size_t near = grouping.insert(0.9e-6);
+      size_t far = grouping.insert(1.8e-6);
+      THEN("they do not chain into one group") {
+        REQUIRE(zero == 0);
+        REQUIRE(near == zero);
+        REQUIRE(far == 1);
+      }
+    }
+    WHEN("inserting values on both sides of a bucket edge") {
+      // 16e-6 is an edge of the buckets of magnitudes below 1
+      size_t below = grouping.insert(16e-6 - 0.4e-6);
+      size_t above = grouping.insert(16e-6 + 0.4e-6);
+      THEN("they are found in the neighbouring bucket") {
+        REQUIRE(below == above);
+      }
+    }
+    WHEN("inserting vectors with many rates near a bucket edge") {
+      std::vector<double> below(10, 16e-6 - 0.4e-6);
+      std::vector<double> above(10, 16e-6 + 0.4e-6);
+      std::vector<long long> keys(10, 1);
+      size_t first = grouping.insert(keys, below);
+      THEN("equal vectors still share a group") {
+        REQUIRE(grouping.insert(keys, above) == first);
+        above[9] = 17e-6 + 0.4e-6;
+        REQUIRE(grouping.insert(keys, above) != first);
+      }
+    }
+    WHEN("inserting large values") {
+      size_t large = grouping.insert(1e6);
+      THEN("the tolerance is relative") {
+        REQUIRE(grouping.insert(1e6 + 0.5) == large);
+        REQUIRE(grouping.insert(1e6 + 100.0) != large);
+        REQUIRE(grouping.insert(-1e6) != large);
+      }
+    }
+    WHEN("inserting vectors with keys") {
+      std::vector<long long> keys = {0, 3};
+      std::vector<long long> otherKeys = {0, 4};
+      std::vector<double> rates = {1.0 / 3.0, 2.0};
+      std::vector<double> close = {1.0 - 2.0 / 3.0, 2.0 + 1e-9};
+      size_t first = grouping.insert(keys, rates);
+      THEN("equal keys and rates share a group") {
+        REQUIRE(grouping.insert(keys, close) == first);
+        REQUIRE(grouping.insert(otherKeys, rates) != first);
+        REQUIRE(grouping.size() == 2);
+      }
+    }
+  }
+}
+
+SCENARIO("An expired deadline stops the refinement") {
+  GIVEN("Input") {
+    std::string input =
+        UserInterface::read_file("../src/test/stoichometric_input.txt");
+    auto model = std::make_shared<RewriteSystemModel>();
+    WHEN("reducing it with a cancelled deadline") {
+      auto repr = model->parse(input);
+      auto reduction = model->get_reduction_methods()[0];
+      Deadline deadline;
+      deadline.cancel();
+      auto reduced = reduction->reduce(repr, deadline);
+      THEN("the input system is returned") { REQUIRE(reduced == repr); }
     }
   }
 }
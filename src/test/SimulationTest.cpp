@@ -0,0 +1,293 @@
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+
+#include "../models/rewrite_systems/OdeIntegrator.h"
+#include "../models/rewrite_systems/RewriteSystemModel.h"
+#include "../models/rewrite_systems/SimulationEnsemble.h"
+#include "../models/rewrite_systems/StochasticSimulation.h"
+#include "../models/rewrite_systems/TauLeapingSimulation.h"
+#include "../util/FloatingPointCompare.h"
+#include "../util/SumTree.h"
+
+static auto parse_rs(std::string input) -> std::shared_ptr<RewriteSystem> {
+  auto model = std::make_shared<RewriteSystemModel>();
+  return std::static_pointer_cast<RewriteSystem>(model->parse(input));
+}
+
+SCENARIO("Drawing from a sum tree") {
+  GIVEN("Five weights, one of them zero") {
+    SumTree tree(5);
+    tree.assign({1.0, 2.0, 0.0, 3.0, 4.0});
+    WHEN("searching prefix sums") {
+      THEN("the index covering the target is found") {
+        REQUIRE(floating_point_compare(tree.total(), 10.0));
+        REQUIRE(tree.find(0.0) == 0);
+        REQUIRE(tree.find(0.99) == 0);
+        REQUIRE(tree.find(1.0) == 1);
+        REQUIRE(tree.find(3.0) == 3);
+        REQUIRE(tree.find(9.99) == 4);
+      }
+    }
+    WHEN("updating a weight") {
+      tree.set(4, 0.0);
+      THEN("the sums follow and empty leaves are never drawn") {
+        REQUIRE(floating_point_compare(tree.total(), 6.0));
+        REQUIRE(tree.find(6.0) == 3);
+        REQUIRE(tree.find(7.0) == 3);
+      }
+    }
+  }
+}
+
+SCENARIO("Mass-action propensities and dependencies") {
+  GIVEN("A dimerization and a binding rule") {
+    auto rs = parse_rs("2A -> B , 3.0\n"
+                       "A + C -> D , 2.0\n"
+                       "D -> D + E , 1.0");
+    MassActionKinetics kinetics(rs);
+    // species in order of appearance: A, B, C, D, E
+    std::vector<long> state = {4, 0, 5, 1, 0};
+    WHEN("evaluating the propensities") {
+      THEN("they count the distinct reagent combinations") {
+        REQUIRE(floating_point_compare(kinetics.propensity(0, state), 18.0));
+        REQUIRE(floating_point_compare(kinetics.propensity(1, state), 40.0));
+        REQUIRE(floating_point_compare(kinetics.propensity(2, state), 1.0));
+      }
+    }
+    WHEN("firing the dimerization") {
+      kinetics.fire(0, state);
+      THEN("only the rules consuming A depend on it") {
+        REQUIRE(state == std::vector<long>{2, 1, 5, 1, 0});
+        std::vector<size_t> dependents(kinetics.dependents_of(0).begin(),
+                                       kinetics.dependents_of(0).end());
+        REQUIRE(dependents == std::vector<size_t>{0, 1});
+        REQUIRE(kinetics.dependents_of(2).empty());
+      }
+    }
+  }
+  GIVEN("The same dimerization written as A + A and as 2A") {
+    MassActionKinetics repeated(parse_rs("A + A -> B , 3.0"));
+    MassActionKinetics merged(parse_rs("2A -> B , 3.0"));
+    std::vector<long> state = {4, 0};
+    THEN("both fire with the same propensity and the same change") {
+      REQUIRE(floating_point_compare(repeated.propensity(0, state), 18.0));
+      REQUIRE(floating_point_compare(merged.propensity(0, state), 18.0));
+      REQUIRE(repeated.get_reagents().size(0) == 1);
+      repeated.fire(0, state);
+      REQUIRE(state == std::vector<long>{2, 1});
+    }
+  }
+}
+
+SCENARIO("Simulating a rewrite system with the direct method") {
+  GIVEN("The conversion A -> B from 1000 copies of A") {
+    auto kinetics =
+        std::make_shared<const MassActionKinetics>(parse_rs("A -> B , 1.0"));
+    StochasticSimulation ssa(kinetics, {1000, 0}, 42);
+    WHEN("simulating until time 1") {
+      ssa.run(1.0);
+      THEN("the molecules are conserved and about 1 - 1/e are converted") {
+        REQUIRE(ssa.get_state()[0] + ssa.get_state()[1] == 1000);
+        REQUIRE(static_cast<unsigned long>(ssa.get_state()[1]) ==
+                ssa.get_steps());
+        REQUIRE(floating_point_compare(ssa.get_time(), 1.0));
+        // 5 standard deviations of the binomial distribution
+        REQUIRE(std::abs(ssa.get_state()[1] - 632) < 77);
+      }
+    }
+    WHEN("simulating until no rule can fire") {
+      ssa.run(1e9);
+      THEN("every A is converted") {
+        REQUIRE(ssa.get_state() == std::vector<long>{0, 1000});
+        REQUIRE(ssa.step() == -1);
+      }
+    }
+    WHEN("restarting with the same seed") {
+      ssa.run(0.5);
+      std::vector<long> first = ssa.get_state();
+      ssa.seed(42);
+      ssa.reset({1000, 0});
+      ssa.run(0.5);
+      THEN("the trajectory is reproduced") {
+        REQUIRE(ssa.get_state() == first);
+      }
+    }
+  }
+}
+
+SCENARIO("Running an ensemble of trajectories") {
+  GIVEN("The conversion A -> B from 100 copies of A observed at 3 times") {
+    auto kinetics =
+        std::make_shared<const MassActionKinetics>(parse_rs("A -> B , 1.0"));
+    std::vector<double> times = {0.0, 1.0, 100.0};
+    SimulationEnsemble ensemble(kinetics, {100, 0}, times, {1}, 7);
+    WHEN("running 400 trajectories") {
+      ensemble.run(400);
+      EnsembleStatistics stats = ensemble.get_statistics();
+      THEN("the statistics match the binomial distribution of B") {
+        REQUIRE(stats.get_trajectories() == 400);
+        REQUIRE(stats.sum(0, 0) == 0);
+        REQUIRE(std::abs(stats.mean(1, 0) - 63.2) < 1.5);
+        REQUIRE(std::abs(stats.variance(1, 0) - 23.25) < 7.0);
+        REQUIRE(floating_point_compare(stats.mean(2, 0), 100.0));
+        REQUIRE(floating_point_compare(stats.variance(2, 0), 0.0));
+      }
+      THEN("splitting the runs gives the same sums") {
+        SimulationEnsemble split(kinetics, {100, 0}, times, {1}, 7);
+        split.run(150);
+        split.run(250);
+        REQUIRE(split.get_statistics().sum(1, 0) == stats.sum(1, 0));
+      }
+      THEN("the statistics survive a round trip through a file") {
+        stats.write("ensemble_statistics.bin");
+        EnsembleStatistics read =
+            EnsembleStatistics::read("ensemble_statistics.bin");
+        REQUIRE(read.get_trajectories() == 400);
+        REQUIRE(read.get_time_points() == times);
+        REQUIRE(read.get_observables() == std::vector<unsigned int>{1});
+        REQUIRE(floating_point_compare(read.variance(1, 0),
+                                       stats.variance(1, 0)));
+      }
+      THEN("a header with more values than the file holds is rejected") {
+        stats.write("ensemble_statistics.bin");
+        {
+          // the counts of time points and observables follow the magic and
+          // the number of trajectories, 2^32 each wraps their product to 0
+          std::fstream file("ensemble_statistics.bin",
+                            std::ios::binary | std::ios::in | std::ios::out);
+          file.seekp(16);
+          uint64_t count = uint64_t{1} << 32U;
+          file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+          file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        }
+        REQUIRE_THROWS_AS(EnsembleStatistics::read("ensemble_statistics.bin"),
+                          std::invalid_argument);
+        std::filesystem::remove("ensemble_statistics.bin");
+      }
+    }
+  }
+}
+
+SCENARIO("The exact sums of an ensemble do not overflow silently") {
+  GIVEN("An ensemble observing two billion copies of A at time 0") {
+    auto kinetics =
+        std::make_shared<const MassActionKinetics>(parse_rs("A -> B , 1.0"));
+    SimulationEnsemble ensemble(kinetics, {2000000000, 0}, {0.0}, {0}, 1);
+    WHEN("the sum of squares fits into 64 bits") {
+      ensemble.run(2);
+      THEN("it is exact") {
+        REQUIRE(ensemble.get_statistics().sum(0, 0) == 4000000000);
+      }
+    }
+    WHEN("a third trajectory exceeds 2^63") {
+      ensemble.run(2);
+      THEN("the run throws") {
+        REQUIRE_THROWS_AS(ensemble.run(1), std::overflow_error);
+        REQUIRE_THROWS_AS(ensemble.get_statistics(), std::overflow_error);
+      }
+    }
+  }
+}
+
+SCENARIO("Simulating large populations by tau-leaping") {
+  GIVEN("The conversion A -> B from a million copies of A") {
+    auto kinetics =
+        std::make_shared<const MassActionKinetics>(parse_rs("A -> B , 1.0"));
+    TauLeapingSimulation leaping(kinetics, {1000000, 0}, 3);
+    WHEN("simulating until time 1") {
+      leaping.run(1.0);
+      THEN("few leaps reach the expected state up to the leap error") {
+        REQUIRE(leaping.get_state()[0] + leaping.get_state()[1] == 1000000);
+        REQUIRE(floating_point_compare(leaping.get_time(), 1.0));
+        REQUIRE(leaping.get_steps() < 100);
+        REQUIRE(std::abs(leaping.get_state()[1] - 632121) < 10000);
+      }
+    }
+  }
+  GIVEN("A dimerization 2A -> B that runs out of A") {
+    auto kinetics =
+        std::make_shared<const MassActionKinetics>(parse_rs("2A -> B , 0.01"));
+    TauLeapingSimulation leaping(kinetics, {100001, 0}, 5);
+    WHEN("simulating until no rule can fire") {
+      leaping.run(1e9);
+      THEN("no count becomes negative and a single A is left") {
+        REQUIRE(leaping.get_state() == std::vector<long>{1, 50000});
+      }
+    }
+  }
+}
+
+SCENARIO("Integrating the mass-action ODE of a rewrite system") {
+  GIVEN("A network with a dimerization and a binding rule") {
+    MassActionOde ode(parse_rs("2A -> B , 3.0\n"
+                               "A + C -> D , 2.0\n"
+                               "D -> D + E , 1.0"));
+    Eigen::VectorXd x(5);
+    x << 0.5, 0.1, 2.0, 0.3, 0.0;
+    WHEN("assembling the Jacobian") {
+      MatDenD J = MatDenD(ode.jacobian(x));
+      THEN("it matches central differences of the right hand side") {
+        const double h = 1e-6;
+        Eigen::VectorXd fPlus;
+        Eigen::VectorXd fMinus;
+        for (long i = 0; i < x.size(); i++) {
+          Eigen::VectorXd dx = Eigen::VectorXd::Zero(x.size());
+          dx[i] = h;
+          ode.rhs(x + dx, fPlus);
+          ode.rhs(x - dx, fMinus);
+          Eigen::VectorXd column = (fPlus - fMinus) / (2 * h);
+          REQUIRE((J.col(i) - column).norm() < 1e-6);
+        }
+      }
+      THEN("another state overwrites the values on the same pattern") {
+        long nonZeros = ode.jacobian(x).nonZeros();
+        Eigen::VectorXd y(5);
+        y << 1.5, 0.2, 0.0, 0.7, 1.0;
+        MatDenD K = MatDenD(ode.jacobian(y));
+        REQUIRE(ode.jacobian(y).nonZeros() == nonZeros);
+        REQUIRE(K(1, 0) == Approx(6.0 * 1.5));
+        REQUIRE(K(3, 0) == 0.0);
+        REQUIRE(K(3, 2) == Approx(2.0 * 1.5));
+      }
+    }
+  }
+  GIVEN("The decay A -> B") {
+    MassActionOde ode(parse_rs("A -> B , 1.0"));
+    Eigen::VectorXd x0(2);
+    x0 << 1.0, 0.0;
+    for (const auto &method : {OdeMethod::DormandPrince, OdeMethod::Rosenbrock}) {
+      WHEN("integrating until time 1 and 2") {
+        OdeIntegrator integrator(method, 1e-8, 1e-10);
+        auto xs = integrator.integrate(ode, x0, {1.0, 2.0});
+        THEN("the exact solution is met") {
+          REQUIRE(std::abs(xs[0][0] - std::exp(-1.0)) < 1e-5);
+          REQUIRE(std::abs(xs[1][0] - std::exp(-2.0)) < 1e-5);
+          REQUIRE(std::abs(xs[1][0] + xs[1][1] - 1.0) < 1e-10);
+        }
+      }
+    }
+  }
+  GIVEN("The stiff Robertson problem") {
+    MassActionOde ode(parse_rs("A -> B , 0.04\n"
+                               "B + C -> A + C , 10000.0\n"
+                               "2B -> B + C , 30000000.0"));
+    Eigen::VectorXd x0(3);
+    x0 << 1.0, 0.0, 0.0;
+    WHEN("integrating until time 40 with both methods") {
+      OdeIntegrator rosenbrock(OdeMethod::Rosenbrock, 1e-4, 1e-8);
+      OdeIntegrator dormandPrince(OdeMethod::DormandPrince, 1e-4, 1e-8);
+      auto xs = rosenbrock.integrate(ode, x0, {40.0});
+      auto ys = dormandPrince.integrate(ode, x0, {40.0});
+      THEN("both meet the reference solution, the implicit one in far fewer "
+           "steps") {
+        REQUIRE(std::abs(xs[0][0] - 0.7158) < 1e-3);
+        REQUIRE(std::abs(xs[0][2] - 0.2842) < 1e-3);
+        REQUIRE(std::abs(xs[0].sum() - 1.0) < 1e-8);
+        REQUIRE(std::abs(ys[0][0] - 0.7158) < 1e-3);
+        REQUIRE(rosenbrock.get_steps() < 1000);
+        REQUIRE(10 * rosenbrock.get_steps() < dormandPrince.get_steps());
+      }
+    }
+  }
+}
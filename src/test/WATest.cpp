@@ -1,6 +1,9 @@
 #include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
 
 #include "../models/weighted_automata/WeightedAutomaton.h"
+#include "../models/weighted_automata/WeightedAutomatonModel.h"
 #include "../util/FloatingPointCompare.h"
 #include "TestUtils.h"
 
@@ -202,3 +205,191 @@ SCENARIO("The equivalence of automata is tested") {
     }
   }
 }
+
+SCENARIO("Sparse automata are read as triplets") {
+  GIVEN("Numbers in the formats of the input files") {
+    std::string_view numbers = " 3 -2 +1.5e2 7.0 x";
+    THEN("they are converted without copies") {
+      REQUIRE(extract_number<size_t>(numbers) == 3);
+      REQUIRE(extract_number<long>(numbers) == -2);
+      REQUIRE(floating_point_compare(extract_number<double>(numbers), 150.0));
+      REQUIRE(extract_number<unsigned int>(numbers) == 7);
+      REQUIRE_THROWS_AS(extract_number<double>(numbers), std::invalid_argument);
+    }
+    THEN("negative values are rejected for unsigned types") {
+      std::string_view negative = " -1 -2.5";
+      REQUIRE_THROWS_AS(extract_number<unsigned int>(negative),
+                        std::invalid_argument);
+      negative = " 1e30";
+      REQUIRE_THROWS_AS(extract_number<int>(negative), std::invalid_argument);
+    }
+  }
+  GIVEN("A sparse automaton that sets one transition twice") {
+    std::string input = "input=sparse;\nstates=3;\ncharacters=2;\n"
+                        "alpha: 0 1;\nmu:\n0 0 1 0.5;\n1 2 0 2;\n"
+                        "0 0 1 0.25;\neta: 2 1;";
+    WHEN("parsing it") {
+      WeightedAutomatonModel model;
+      auto wa = std::static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          model.parse(input));
+      THEN("the later weight wins") {
+        REQUIRE(wa->get_mu()[0]->nonZeros() == 1);
+        REQUIRE(floating_point_compare(wa->get_mu()[0]->coeff(0, 1), 0.25));
+        REQUIRE(floating_point_compare(wa->get_mu()[1]->coeff(2, 0), 2.0));
+      }
+    }
+    WHEN("a transition leaves the states") {
+      std::string broken = input;
+      broken.replace(broken.find("1 2 0 2"), 7, "1 3 0 2");
+      WeightedAutomatonModel model;
+      THEN("it is rejected") {
+        REQUIRE_THROWS_AS(model.parse(broken), std::invalid_argument);
+      }
+    }
+    WHEN("the initial or the final vector leaves the states") {
+      std::string badAlpha = input;
+      badAlpha.replace(badAlpha.find("alpha: 0"), 8, "alpha: 3");
+      std::string badEta = input;
+      badEta.replace(badEta.find("eta: 2"), 6, "eta: 7");
+      std::string negative = input;
+      negative.replace(negative.find("eta: 2"), 6, "eta: -1");
+      WeightedAutomatonModel model;
+      THEN("it is rejected") {
+        REQUIRE_THROWS_AS(model.parse(badAlpha), std::invalid_argument);
+        REQUIRE_THROWS_AS(model.parse(badEta), std::invalid_argument);
+        REQUIRE_THROWS_AS(model.parse(negative), std::invalid_argument);
+      }
+    }
+  }
+}
+
+SCENARIO("Large sparse automata are parsed in chunks") {
+  GIVEN("Several megabytes of transitions with a position set twice") {
+    const long states = 1000;
+    std::string input = "input=sparse;\nstates=1000;\ncharacters=2;\n"
+                        "alpha: 0 1;\nmu:\n0 0 1 0.5;\n";
+    long entries = 1;
+    for (long i = 0; i < states; i++) {
+      for (long j = 0; j < 200; j++) {
+        input += std::to_string(i % 2) + " " + std::to_string(i) + " " +
+                 std::to_string((i + j) % states) + " 1.0;\n";
+        entries++;
+      }
+    }
+    input += "0 0 1 0.25;\neta: 999 1;";
+    WHEN("parsing it") {
+      WeightedAutomatonModel model;
+      auto wa = std::static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          model.parse(input));
+      THEN("every chunk is read and the last entry wins") {
+        REQUIRE(input.size() > (size_t{2} << 20U));
+        REQUIRE(wa->get_mu()[0]->nonZeros() + wa->get_mu()[1]->nonZeros() ==
+                entries - 1);
+        REQUIRE(floating_point_compare(wa->get_mu()[0]->coeff(0, 1), 0.25));
+        REQUIRE(floating_point_compare(wa->get_mu()[1]->coeff(999, 98), 1.0));
+      }
+    }
+  }
+}
+
+SCENARIO("Automata survive a round trip through the binary format") {
+  GIVEN("Our running example in minimized version") {
+    auto wa = gen_wa_hand_min_dense();
+    WHEN("writing it and mapping the file") {
+      MappedWeightedAutomaton::write(*wa, "automaton.wab");
+      MappedWeightedAutomaton mapped("automaton.wab");
+      THEN("the views show the weights and the copy is equivalent") {
+        REQUIRE(WeightedAutomatonModel::is_binary("automaton.wab"));
+        REQUIRE(mapped.get_states() == wa->get_states());
+        REQUIRE(mapped.get_alpha() == *(wa->get_alpha()));
+        REQUIRE(mapped.get_eta() == *(wa->get_eta()));
+        for (size_t i = 0; i < wa->get_mu().size(); i++) {
+          REQUIRE(MatDenD(mapped.get_mu(i)) == *(wa->get_mu()[i]));
+          REQUIRE(reinterpret_cast<uintptr_t>(mapped.get_mu(i).valuePtr()) %
+                      MappedWeightedAutomaton::ALIGNMENT ==
+                  0);
+        }
+        auto copy = mapped.to_automaton();
+        REQUIRE(MatDenD(*(copy->get_mu()[0])) == *(wa->get_mu()[0]));
+        REQUIRE(MatDenD(*(copy->get_eta())) == *(wa->get_eta()));
+      }
+    }
+  }
+  GIVEN("A parsed sparse automaton") {
+    std::string input = "input=sparse;\nstates=3;\ncharacters=2;\n"
+                        "alpha: 0 1;\nmu:\n0 0 1 0.5;\n1 2 0 2;\n"
+                        "1 1 2 3;\neta: 2 1;";
+    WeightedAutomatonModel model;
+    auto parsed = model.parse(input);
+    WHEN("writing it and loading it through the model") {
+      WeightedAutomatonModel::write_binary(parsed, "automaton.wab");
+      WeightedAutomatonModel loader;
+      auto loaded = std::static_pointer_cast<WeightedAutomaton<MatSpD>>(
+          loader.load_binary("automaton.wab"));
+      THEN("the same automaton is read") {
+        REQUIRE(loaded->get_number_input_characters() == 2);
+        REQUIRE(loaded->get_mu()[1]->nonZeros() == 2);
+        REQUIRE(floating_point_compare(loaded->get_mu()[1]->coeff(1, 2), 3.0));
+        REQUIRE(loaded->equivalent(parsed));
+      }
+    }
+    WHEN("the file is truncated") {
+      WeightedAutomatonModel::write_binary(parsed, "automaton.wab");
+      std::filesystem::resize_file("automaton.wab", 200);
+      THEN("it is rejected") {
+        REQUIRE_THROWS_AS(MappedWeightedAutomaton("automaton.wab"),
+                          std::invalid_argument);
+      }
+    }
+    std::filesystem::remove("automaton.wab");
+  }
+  GIVEN("A binary automaton with two transitions in one column") {
+    std::string input = "input=sparse;\nstates=3;\ncharacters=2;\n"
+                        "alpha: 0 1;\nmu:\n0 0 1 0.5;\n0 2 1 1;\n"
+                        "1 1 2 3;\neta: 2 1;";
+    WeightedAutomatonModel model;
+    WeightedAutomatonModel::write_binary(model.parse(input), "automaton.wab");
+    // header, alpha, eta and the directory take the first 256 bytes, the
+    // outer indices {0, 0, 2, 2} and the inner indices {0, 2} of letter 0
+    // follow at 256 and 320
+    auto overwrite = [](long offset, std::initializer_list<int64_t> words) {
+      std::fstream file("automaton.wab",
+                        std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(offset);
+      for (const auto &word : words) {
+        file.write(reinterpret_cast<const char *>(&word), sizeof(word));
+      }
+    };
+    WHEN("an inner index points past the states") {
+      overwrite(320, {0, 7});
+      MappedWeightedAutomaton mapped("automaton.wab");
+      THEN("the copy is rejected") {
+        REQUIRE_THROWS_AS(mapped.to_automaton(), std::invalid_argument);
+      }
+    }
+    WHEN("the inner indices of the column are not sorted") {
+      overwrite(320, {2, 0});
+      MappedWeightedAutomaton mapped("automaton.wab");
+      THEN("the copy is rejected") {
+        REQUIRE_THROWS_AS(mapped.to_automaton(), std::invalid_argument);
+      }
+    }
+    WHEN("an outer index in the middle is not monotone") {
+      overwrite(264, {100000000000L, 1});
+      MappedWeightedAutomaton mapped("automaton.wab");
+      THEN("the copy is rejected") {
+        REQUIRE_THROWS_AS(mapped.to_automaton(), std::invalid_argument);
+      }
+    }
+    WHEN("the file is intact") {
+      MappedWeightedAutomaton mapped("automaton.wab");
+      THEN("the copy holds both transitions") {
+        auto copy = mapped.to_automaton();
+        REQUIRE(copy->get_mu()[0]->nonZeros() == 2);
+        REQUIRE(floating_point_compare(copy->get_mu()[0]->coeff(2, 1), 1.0));
+        REQUIRE(floating_point_compare(copy->get_mu()[1]->coeff(1, 2), 3.0));
+      }
+    }
+    std::filesystem::remove("automaton.wab");
+  }
+}
@@ -0,0 +1,26 @@
+#include "Deadline.h"
+#include "DeadlineExceededException.h"
+
+Deadline::Deadline()
+    : expiry(std::chrono::steady_clock::time_point::max()),
+      cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+Deadline::Deadline(std::chrono::steady_clock::duration timeout)
+    : expiry(std::chrono::steady_clock::now() + timeout),
+      cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+Deadline::~Deadline() = default;
+
+void Deadline::cancel() const { this->cancelled->store(true); }
+
+auto Deadline::expired() const -> bool {
+  return this->cancelled->load() ||
+         (this->expiry != std::chrono::steady_clock::time_point::max() &&
+          std::chrono::steady_clock::now() >= this->expiry);
+}
+
+void Deadline::check() const {
+  if (this->expired()) {
+    throw DeadlineExceededException();
+  }
+}
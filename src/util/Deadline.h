@@ -0,0 +1,32 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_DEADLINE_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_DEADLINE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// Wall-clock deadline doubling as cancellation token. Copies share the
+// cancellation flag, so a copy handed to a reduction can be cancelled from
+// another thread.
+class Deadline {
+private:
+  std::chrono::steady_clock::time_point expiry;
+  std::shared_ptr<std::atomic<bool>> cancelled;
+
+public:
+  // Never expires unless cancelled
+  Deadline();
+
+  explicit Deadline(std::chrono::steady_clock::duration timeout);
+
+  ~Deadline();
+
+  void cancel() const;
+
+  [[nodiscard]] auto expired() const -> bool;
+
+  // Throws a DeadlineExceededException if the deadline expired
+  void check() const;
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_DEADLINE_H
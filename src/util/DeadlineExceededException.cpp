@@ -0,0 +1,8 @@
+#include "DeadlineExceededException.h"
+
+DeadlineExceededException::DeadlineExceededException()
+    : std::runtime_error("Deadline exceeded.") {}
+
+auto DeadlineExceededException::what() const noexcept -> const char * {
+  return "The deadline expired or the computation was cancelled";
+}
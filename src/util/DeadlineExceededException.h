@@ -0,0 +1,15 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_DEADLINEEXCEEDEDEXCEPTION_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_DEADLINEEXCEEDEDEXCEPTION_H
+
+#include <stdexcept>
+
+class DeadlineExceededException : public std::runtime_error {
+public:
+  DeadlineExceededException();
+
+  ~DeadlineExceededException() override = default;
+
+  [[nodiscard]] auto what() const noexcept -> const char * override;
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_DEADLINEEXCEEDEDEXCEPTION_H
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <memory>
 const uint DEFAULT_RANDOM_RANGE_FACTOR = 10;
+const uint DEFAULT_FINITE_HORIZON = 10;
+const double DEFAULT_SVD_TOLERANCE = 1e-6;
 const uint PRINT_PRECISION = 8;
 const std::array<unsigned long long int, 21> FACTORIALS = {1,
                                                            1,
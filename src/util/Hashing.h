@@ -0,0 +1,17 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_HASHING_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_HASHING_H
+
+#include <cstdint>
+
+// Seed of the word-wise FNV-1a hash below.
+constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+
+// Mixes one 64 bit word into h: an FNV-1a step followed by a shift, so the
+// high bits of the word also reach the low bits hash tables index by.
+inline void hash_combine(uint64_t &h, uint64_t value) {
+  h ^= value;
+  h *= 0x100000001b3ULL;
+  h ^= h >> 29U;
+}
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_HASHING_H
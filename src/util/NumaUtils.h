@@ -0,0 +1,110 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_NUMAUTILS_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_NUMAUTILS_H
+
+#include <cctype>
+#include <cerrno>
+#include <fstream>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// Parses a sysfs list like "0-3,8,10-11" into its members
+static inline auto parse_sysfs_list(const std::string &list)
+    -> std::vector<int> {
+  std::vector<int> result = {};
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string range = list.substr(pos, end - pos);
+    size_t dash = range.find('-');
+    if (!range.empty() && std::isdigit(static_cast<unsigned char>(range[0]))) {
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      for (int i = first; i <= last; i++) {
+        result.push_back(i);
+      }
+    }
+    pos = end + 1;
+  }
+  return result;
+}
+
+static inline auto read_sysfs_list(const std::string &path)
+    -> std::vector<int> {
+  std::ifstream in(path);
+  std::string line;
+  if (!in.is_open() || !std::getline(in, line)) {
+    return {};
+  }
+  return parse_sysfs_list(line);
+}
+
+// Returns the ids of all online NUMA nodes; machines without NUMA support
+// report a single node 0
+static inline auto numa_nodes() -> std::vector<int> {
+  std::vector<int> nodes =
+      read_sysfs_list("/sys/devices/system/node/online");
+  if (nodes.empty()) {
+    nodes = {0};
+  }
+  return nodes;
+}
+
+// Pins the calling process to the cpus of the given node. Memory allocated
+// and first touched afterwards is placed on that node by the default policy.
+static inline void bind_to_numa_node(int node) {
+  std::vector<int> cpus = read_sysfs_list("/sys/devices/system/node/node" +
+                                          std::to_string(node) + "/cpulist");
+  if (cpus.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto &cpu : cpus) {
+    CPU_SET(static_cast<size_t>(cpu), &set);
+  }
+  sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+static inline void write_all(int fd, const void *data, size_t bytes) {
+  const char *ptr = static_cast<const char *>(data);
+  while (bytes > 0) {
+    ssize_t written = ::write(fd, ptr, bytes);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written < 0 && errno == EPIPE) {
+      throw std::runtime_error("Failed to write to worker channel, the worker "
+                               "has exited!");
+    }
+    if (written <= 0) {
+      throw std::runtime_error("Failed to write to worker channel!");
+    }
+    ptr += written;
+    bytes -= static_cast<size_t>(written);
+  }
+}
+
+static inline void read_all(int fd, void *data, size_t bytes) {
+  char *ptr = static_cast<char *>(data);
+  while (bytes > 0) {
+    ssize_t read = ::read(fd, ptr, bytes);
+    if (read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (read <= 0) {
+      throw std::runtime_error("Worker channel closed unexpectedly!");
+    }
+    ptr += read;
+    bytes -= static_cast<size_t>(read);
+  }
+}
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_NUMAUTILS_H
@@ -2,131 +2,216 @@
 #define STOCHASTIC_SYSTEM_MINIMIZATION_PARSEUTILS_H
 
 #include "DefsConstants.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <cstring>
+#include <limits>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
 
-enum TrimType { TrimWhiteSpace = 0, TrimNewLines = 1, DontTrim = 2 };
+// The helpers below take views into the input and advance them past what
+// they consumed, so the input is neither copied nor erased from the front
+// and parsing is linear in its length.
 
-inline static auto get_next_line(std::string &str, const char *delim,
-                                 TrimType trimType) noexcept -> std::string {
-  std::string line;
-  std::size_t pos = str.find(delim);
-  if (pos != std::string::npos) {
-    pos = pos + strlen(delim);
-  } else {
-    pos = line.size() - 1;
+static inline auto is_space(char c) -> bool {
+  return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+static inline auto trim(std::string_view view) -> std::string_view {
+  while (!view.empty() && is_space(view.front())) {
+    view.remove_prefix(1);
   }
-  line = str.substr(0, pos);
-  str.erase(0, pos);
-  switch (trimType) {
-  case (TrimType::TrimWhiteSpace): {
-    line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
-    break;
+  while (!view.empty() && is_space(view.back())) {
+    view.remove_suffix(1);
   }
-  case (TrimType::TrimNewLines): {
-    line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
-    break;
+  return view;
+}
+
+// Whether the view starts with the prefix if whitespace in the view is
+// ignored, e.g. "mu = (" starts with "mu=("
+static inline auto starts_with_ignoring_space(std::string_view view,
+                                              std::string_view prefix)
+    -> bool {
+  size_t i = 0;
+  for (const auto &c : prefix) {
+    while (i < view.size() && is_space(view[i])) {
+      i++;
+    }
+    if (i == view.size() || view[i] != c) {
+      return false;
+    }
+    i++;
   }
-  case (TrimType::DontTrim): {
-    break;
+  return true;
+}
+
+// Number of occurrences of the byte, scanned with memchr, which the C
+// library vectorises
+static inline auto count_char(std::string_view view, char c) -> size_t {
+  size_t count = 0;
+  const char *pos = view.data();
+  const char *end = view.data() + view.size();
+  while (pos < end) {
+    const auto *found = static_cast<const char *>(
+        std::memchr(pos, c, static_cast<size_t>(end - pos)));
+    if (found == nullptr) {
+      break;
+    }
+    count++;
+    pos = found + 1;
   }
+  return count;
+}
+
+// Splits an input into tokens at a delimiter by advancing an offset
+class ParseCursor {
+private:
+  std::string_view input;
+  size_t pos;
+
+public:
+  explicit ParseCursor(std::string_view mInput) : input(mInput), pos(0) {}
+
+  [[nodiscard]] inline auto at_end() const -> bool {
+    return this->pos >= this->input.size();
+  }
+
+  [[nodiscard]] inline auto rest() const -> std::string_view {
+    return this->input.substr(std::min(this->pos, this->input.size()));
+  }
+
+  // Token up to the next delimiter, or the rest of the input if there is
+  // none, without the delimiter and surrounding whitespace
+  auto next(char delim) -> std::string_view {
+    if (this->at_end()) {
+      return {};
+    }
+    const char *start = this->input.data() + this->pos;
+    size_t length = this->input.size() - this->pos;
+    const auto *found =
+        static_cast<const char *>(std::memchr(start, delim, length));
+    size_t tokenLength =
+        found == nullptr ? length : static_cast<size_t>(found - start);
+    this->pos += found == nullptr ? length : tokenLength + 1;
+    return trim({start, tokenLength});
   }
-  return line;
+};
+
+static inline auto is_number_start(char c) -> bool {
+  return std::isdigit(static_cast<unsigned char>(c)) != 0 || c == '-' ||
+         c == '+' || c == '.';
 }
 
+// Number at the start of the view after skipping anything that cannot start
+// a number, converted by std::from_chars without allocating and independent
+// of the locale. Integers written with a fraction or exponent are read as
+// doubles and truncated, values outside the range of T (negative ones for
+// unsigned T) are rejected. Returns false and leaves the view empty if there
+// is no number, otherwise the view is advanced past it.
 template <Arithmetic T>
-static inline auto extract_number(std::string &vector) -> T {
-  bool prevDigit = false;
-  size_t firstDigit = 0;
-  unsigned char current = 0;
-
-  for (size_t i = 0; i < vector.size(); i++) {
-    current = static_cast<unsigned char>(vector[i]);
-    if (((std::isdigit(current) != 0) || vector[i] == '-' || vector[i] == '+' ||
-         vector[i] == '.') &&
-        !prevDigit) {
-      prevDigit = true;
-      firstDigit = i;
-      if (i == vector.size() - 1) {
-        T result = static_cast<T>(std::stod(vector.substr(i, 1)));
-        vector.erase(0, i + 1);
-        return result;
+static inline auto parse_number(std::string_view &view, T &value) -> bool {
+  const char *pos = view.data();
+  const char *end = view.data() + view.size();
+  while (pos < end && !is_number_start(*pos)) {
+    pos++;
+  }
+  // from_chars does not accept an explicit plus sign
+  if (pos < end && *pos == '+') {
+    pos++;
+  }
+  if (pos == end) {
+    view = {};
+    return false;
+  }
+  std::from_chars_result result{pos, std::errc::invalid_argument};
+  if constexpr (std::is_integral_v<T>) {
+    result = std::from_chars(pos, end, value);
+    bool fraction = result.ec == std::errc() && result.ptr < end &&
+                    (*result.ptr == '.' || *result.ptr == 'e' ||
+                     *result.ptr == 'E');
+    if (result.ec != std::errc() || fraction) {
+      double real = 0.0;
+      result = std::from_chars(pos, end, real);
+      // the conversion is only defined for values that fit into T
+      if (result.ec == std::errc() &&
+          !(real >= static_cast<double>(std::numeric_limits<T>::min()) &&
+            real < static_cast<double>(std::numeric_limits<T>::max()) + 1.0)) {
+        throw std::invalid_argument(
+            "Number " + std::string(pos, result.ptr) + " is out of range!");
       }
-    } else if (!((std::isdigit(current) != 0) || vector[i] == 'e' ||
-                 vector[i] == '-' || vector[i] == '+' || vector[i] == '.') &&
-               prevDigit) {
-      T result =
-          static_cast<T>(std::stod(vector.substr(firstDigit, i - firstDigit)));
-      vector.erase(0, i);
-      return result;
-    } else if (vector.size() - 1 == i && prevDigit) {
-      T result = static_cast<T>(
-          std::stod(vector.substr(firstDigit, i - firstDigit + 1)));
-      vector.erase(0, i + 1);
-      return result;
+      value = static_cast<T>(real);
     }
+  } else {
+    double real = 0.0;
+    result = std::from_chars(pos, end, real);
+    value = static_cast<T>(real);
+  }
+  if (result.ec != std::errc() || result.ptr == pos) {
+    throw std::invalid_argument("Malformed number " +
+                                std::string(pos, std::min(end - pos, 32L)) +
+                                "!");
+  }
+  view.remove_prefix(static_cast<size_t>(result.ptr - view.data()));
+  return true;
+}
+
+// First number in the view, the view is advanced past it
+template <Arithmetic T>
+static inline auto extract_number(std::string_view &view) -> T {
+  T result{};
+  if (!parse_number(view, result)) {
+    throw std::invalid_argument("No numbers found in the input!");
   }
-  throw std::invalid_argument("No numbers found in the input!");
+  return result;
 }
 
-static inline auto extract_atomic_name(std::string &line) -> std::string {
-  bool prevCapital = false;
+// First capital letter with the lower case letters following it, empty if
+// there is none. The view is advanced past the name.
+static inline auto extract_atomic_name(std::string_view &line)
+    -> std::string_view {
   size_t capital = 0;
-  unsigned char current = 0;
-
-  for (size_t i = 0; i < line.size(); i++) {
-    current = static_cast<unsigned char>(line[i]);
-    if (std::isupper(current) != 0 && !prevCapital) {
-      prevCapital = true;
-      capital = i;
-      if (i == line.size() - 1) {
-        std::string result = line.substr(i, 1);
-        line.erase(0, i + 1);
-        return result;
-      }
-    } else if (std::islower(current) == 0 && prevCapital) {
-      std::string result = line.substr(capital, i - capital);
-      line.erase(0, i);
-      return result;
-    } else if (line.size() - 1 == i && prevCapital) {
-      std::string result = line.substr(capital, i - capital + 1);
-      line.erase(0, i + 1);
-      return result;
-    }
+  while (capital < line.size() &&
+         std::isupper(static_cast<unsigned char>(line[capital])) == 0) {
+    capital++;
+  }
+  if (capital == line.size()) {
+    line.remove_prefix(line.size());
+    return {};
+  }
+  size_t end = capital + 1;
+  while (end < line.size() &&
+         std::islower(static_cast<unsigned char>(line[end])) != 0) {
+    end++;
   }
-  line.erase(0, line.size());
-  return "";
+  std::string_view result = line.substr(capital, end - capital);
+  line.remove_prefix(end);
+  return result;
 }
 
-static inline auto extract_species_name(std::string &line) -> std::string {
-  bool firstCap = false;
+// First capital letter with the alphanumeric characters following it,
+// empty if there is none. The view is advanced past the name.
+static inline auto extract_species_name(std::string_view &line)
+    -> std::string_view {
   size_t capital = 0;
-  unsigned char current = 0;
-
-  line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
-
-  for (size_t i = 0; i < line.size(); i++) {
-    current = static_cast<unsigned char>(line[i]);
-    if (std::isupper(current) != 0 && !firstCap) {
-      firstCap = true;
-      capital = i;
-      if (i == line.size() - 1) {
-        std::string result = line.substr(i, 1);
-        line.erase(0, i + 1);
-        return result;
-      }
-    } else if (std::isalnum(current) == 0 && firstCap) {
-      std::string result = line.substr(capital, i - capital);
-      line.erase(0, i);
-      return result;
-    } else if (line.size() - 1 == i && firstCap) {
-      std::string result = line.substr(capital, i - capital + 1);
-      line.erase(0, i + 1);
-      return result;
-    }
+  while (capital < line.size() &&
+         std::isupper(static_cast<unsigned char>(line[capital])) == 0) {
+    capital++;
+  }
+  if (capital == line.size()) {
+    line.remove_prefix(line.size());
+    return {};
+  }
+  size_t end = capital + 1;
+  while (end < line.size() &&
+         std::isalnum(static_cast<unsigned char>(line[end])) != 0) {
+    end++;
   }
-  line.erase(0, line.size());
-  return "";
+  std::string_view result = line.substr(capital, end - capital);
+  line.remove_prefix(end);
+  return result;
 }
 
 #endif // STOCHASTIC_SYSTEM_MINIMIZATION_PARSEUTILS_H
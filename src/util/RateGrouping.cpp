@@ -0,0 +1,3 @@
+#include "RateGrouping.h"
+
+RateGrouping::~RateGrouping() = default;
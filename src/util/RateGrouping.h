@@ -0,0 +1,171 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_RATEGROUPING_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_RATEGROUPING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "FloatingPointCompare.h"
+#include "Hashing.h"
+
+// Groups rate vectors by equality in expected linear time. Two vectors are
+// equal if their integer keys coincide and all rates are equal as per
+// floating_point_compare. A vector joins the first group whose
+// representative, i.e. its first member, it equals; otherwise it founds a
+// new group. Members are thus always within the tolerance of their
+// representative and close values cannot chain into one group.
+//
+// To find the candidates, rates are mapped monotonically to a scale on which
+// the tolerance has width 1 (linear up to magnitude 1, logarithmic beyond)
+// and snapped to buckets of width BUCKET_WIDTH. An equal representative lies
+// in the same bucket or, if the rate is within the tolerance of the bucket
+// edge, in the neighbouring one. The hash of a vector is the sum of the
+// hashes of its keys and of each (position, bucket) pair, so moving one rate
+// to its neighbouring bucket updates it in constant time. Up to
+// MAX_NEIGHBOURS near-edge rates, all combinations of own and neighbouring
+// buckets are looked up; with more, the representatives with the same keys
+// are compared one by one, so equal vectors always share a group.
+class RateGrouping {
+private:
+  static constexpr double BUCKET_WIDTH = 16.0;
+  static constexpr double STEPS = 1e6;
+  static constexpr size_t MAX_NEIGHBOURS = 4;
+
+  // group ids by hash of keys and buckets of their representative
+  std::unordered_map<uint64_t, std::vector<size_t>> index;
+  // group ids by hash of keys only, for the exhaustive fallback
+  std::unordered_map<uint64_t, std::vector<size_t>> byKeys;
+  std::vector<std::vector<long long>> keys;
+  std::vector<std::vector<double>> representatives;
+
+  // monotone, |scale(x) - scale(y)| <= 1 (up to rounding) if x equals y
+  static auto scale(double x) -> double {
+    double ax = std::fabs(x);
+    double s = ax <= 1.0 ? ax * STEPS : STEPS * (1.0 + std::log(ax));
+    return x < 0 ? -s : s;
+  }
+
+  static auto hash_keys(std::span<const long long> groupKeys) -> uint64_t {
+    uint64_t h = HASH_SEED;
+    for (const auto &key : groupKeys) {
+      hash_combine(h, static_cast<uint64_t>(key));
+    }
+    hash_combine(h, groupKeys.size());
+    return h;
+  }
+
+  // splitmix64 finaliser of the position and bucket of one rate
+  static auto hash_bucket(size_t position, long long bucket) -> uint64_t {
+    uint64_t h = (static_cast<uint64_t>(position) << 40U) ^
+                 static_cast<uint64_t>(bucket) ^ 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27U)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31U);
+  }
+
+  // first matching group of the ids, or size() if there is none
+  [[nodiscard]] auto
+  find_in(const std::unordered_map<uint64_t, std::vector<size_t>> &map,
+          uint64_t h, std::span<const long long> groupKeys,
+          std::span<const double> rates) const -> size_t {
+    auto it = map.find(h);
+    if (it != map.end()) {
+      for (const auto &group : it->second) {
+        if (matches(group, groupKeys, rates)) {
+          return group;
+        }
+      }
+    }
+    return this->size();
+  }
+
+  [[nodiscard]] auto matches(size_t group, std::span<const long long> groupKeys,
+                             std::span<const double> rates) const -> bool {
+    const auto &repKeys = this->keys[group];
+    const auto &rep = this->representatives[group];
+    if (repKeys.size() != groupKeys.size() || rep.size() != rates.size() ||
+        !std::equal(repKeys.begin(), repKeys.end(), groupKeys.begin())) {
+      return false;
+    }
+    for (size_t i = 0; i < rates.size(); i++) {
+      if (!floating_point_compare(rep[i], rates[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  RateGrouping() = default;
+
+  ~RateGrouping();
+
+  // Id of the group of the rates with the given keys; ids are assigned
+  // consecutively from 0 in order of the first member
+  auto insert(std::span<const long long> groupKeys,
+              std::span<const double> rates) -> size_t {
+    const uint64_t keyHash = hash_keys(groupKeys);
+    uint64_t h = keyHash;
+    // hash differences of moving a near-edge rate to its neighbouring bucket
+    std::vector<uint64_t> neighbours = {};
+    // slack for the rounding of scale
+    const double edge = 1.01 / BUCKET_WIDTH;
+    double s;
+    double lower;
+    long long bucket;
+    for (size_t i = 0; i < rates.size(); i++) {
+      s = scale(rates[i]) / BUCKET_WIDTH;
+      lower = std::floor(s);
+      bucket = static_cast<long long>(lower);
+      h += hash_bucket(i, bucket);
+      if (s - lower <= edge) {
+        neighbours.push_back(hash_bucket(i, bucket - 1) -
+                             hash_bucket(i, bucket));
+      } else if (lower + 1.0 - s <= edge) {
+        neighbours.push_back(hash_bucket(i, bucket + 1) -
+                             hash_bucket(i, bucket));
+      }
+    }
+
+    size_t group = this->size();
+    if (neighbours.size() <= MAX_NEIGHBOURS) {
+      // own buckets first, then every combination of neighbouring ones
+      for (size_t mask = 0;
+           mask < (size_t{1} << neighbours.size()) && group == this->size();
+           mask++) {
+        uint64_t candidate = h;
+        for (size_t j = 0; j < neighbours.size(); j++) {
+          if ((mask >> j) & 1U) {
+            candidate += neighbours[j];
+          }
+        }
+        group = this->find_in(this->index, candidate, groupKeys, rates);
+      }
+    } else {
+      group = this->find_in(this->byKeys, keyHash, groupKeys, rates);
+    }
+    if (group < this->size()) {
+      return group;
+    }
+
+    this->keys.emplace_back(groupKeys.begin(), groupKeys.end());
+    this->representatives.emplace_back(rates.begin(), rates.end());
+    this->index[h].push_back(group);
+    this->byKeys[keyHash].push_back(group);
+    return group;
+  }
+
+  inline auto insert(double rate) -> size_t {
+    return insert(std::span<const long long>(),
+                  std::span<const double>(&rate, 1));
+  }
+
+  [[nodiscard]] inline auto size() const -> size_t {
+    return this->representatives.size();
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_RATEGROUPING_H
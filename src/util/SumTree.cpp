@@ -0,0 +1,3 @@
+#include "SumTree.h"
+
+SumTree::~SumTree() = default;
@@ -0,0 +1,73 @@
+#ifndef STOCHASTIC_SYSTEM_MINIMIZATION_SUMTREE_H
+#define STOCHASTIC_SYSTEM_MINIMIZATION_SUMTREE_H
+
+#include <algorithm>
+#include <vector>
+
+// Complete binary tree over non-negative weights where each inner node holds
+// the sum of its children. Updating a weight and drawing an index with
+// probability proportional to its weight take O(log n). Inner nodes are
+// recomputed from their children instead of being adjusted by differences,
+// so rounding errors do not accumulate over many updates.
+class SumTree {
+private:
+  // leaves start at capacity, node i has the children 2i and 2i + 1
+  size_t capacity;
+  size_t n;
+  std::vector<double> nodes;
+
+public:
+  explicit SumTree(size_t mSize = 0) : capacity(1), n(mSize), nodes({}) {
+    while (this->capacity < mSize) {
+      this->capacity *= 2;
+    }
+    this->nodes = std::vector<double>(2 * this->capacity, 0.0);
+  }
+
+  ~SumTree();
+
+  [[nodiscard]] inline auto size() const -> size_t { return this->n; }
+
+  [[nodiscard]] inline auto total() const -> double { return this->nodes[1]; }
+
+  [[nodiscard]] inline auto get(size_t i) const -> double {
+    return this->nodes[this->capacity + i];
+  }
+
+  void set(size_t i, double weight) {
+    size_t node = this->capacity + i;
+    this->nodes[node] = weight;
+    for (node /= 2; node > 0; node /= 2) {
+      this->nodes[node] = this->nodes[2 * node] + this->nodes[2 * node + 1];
+    }
+  }
+
+  // Sets all weights at once in O(n)
+  void assign(const std::vector<double> &weights) {
+    std::fill(this->nodes.begin(), this->nodes.end(), 0.0);
+    std::copy(weights.begin(), weights.end(),
+              this->nodes.begin() + static_cast<long>(this->capacity));
+    for (size_t node = this->capacity - 1; node > 0; node--) {
+      this->nodes[node] = this->nodes[2 * node] + this->nodes[2 * node + 1];
+    }
+  }
+
+  // Index i with sum(w_0 ... w_{i-1}) <= target < sum(w_0 ... w_i) for
+  // 0 <= target < total(). Subtrees of weight 0 are never entered, even if
+  // rounding pushes the target past the last positive weight.
+  [[nodiscard]] auto find(double target) const -> size_t {
+    size_t node = 1;
+    while (node < this->capacity) {
+      double left = this->nodes[2 * node];
+      if (target < left || this->nodes[2 * node + 1] <= 0.0) {
+        node = 2 * node;
+      } else {
+        target -= left;
+        node = 2 * node + 1;
+      }
+    }
+    return node - this->capacity;
+  }
+};
+
+#endif // STOCHASTIC_SYSTEM_MINIMIZATION_SUMTREE_H